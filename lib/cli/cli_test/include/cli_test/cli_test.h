@@ -0,0 +1,54 @@
+/*
+ * Test / benchmark package for the CLI module
+ *
+ *	Usage:
+ *		clitest bench <iterations>
+ *		clitest loop [-v] [-d <d>] <a> <b>
+ *		clitest registry <lookups>
+ *		clitest flood <rate> <seconds>
+ *		clitest spin
+ *		clitest stream <bytes>
+ *		clitest hex <hex>
+ */
+
+#ifndef __CLI_TEST_H__
+#define __CLI_TEST_H__
+
+#include <inttypes.h>
+
+/* Registers the "clitest" namespace */
+void cli_test_cli_init(void);
+
+/* Measures the parse path of the CLI module, and the text and binary frame
+ * paths from a received command to its callback, and prints one CSV line per
+ * result */
+void cli_test_bench(uint32_t iterations);
+
+/* Looks namespaces up from CLI_TEST_READERS tasks while a higher priority
+ * task registers new ones, and prints the lookup rate and the number of
+ * lookups which missed an already registered namespace, which must be 0.
+ * Must be called from a task of higher priority than CLI_TEST_TASK_PRIO */
+void cli_test_registry(uint32_t lookups);
+
+/* Floods the shell session with rate lines/s of "clitest spin" for the given
+ * number of seconds, as a host would through the console, and prints the CPU
+ * time taken by the dispatcher and the lines it ran, and the counters of the
+ * rate limit of the session (see cli_limit.h) */
+void cli_test_flood(uint32_t rate, uint32_t seconds);
+
+/* Takes 200 us of CPU; the command run by the flood */
+void cli_test_spin(void);
+
+/* Feeds the given number of bytes to a stream (see cli_stream.h) in
+ * console-sized pieces, then carries them as hex arguments of "clitest hex"
+ * lines, and prints the time taken by each path and the number of times the
+ * stream accepted fewer bytes than fed. Must be called from the shell task:
+ * with the CLI worker on a lower priority task, the chunk buffers fill up
+ * before the sink runs */
+void cli_test_stream(uint32_t bytes);
+
+/* Counts the bytes of a hex argument; the command run by the hex path of the
+ * stream benchmark */
+void cli_test_hex(uint16_t len);
+
+#endif // __CLI_TEST_H__
@@ -0,0 +1,164 @@
+/*
+ * Benchmarks of the CLI module
+ */
+
+#include <string.h>
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_parse.h"
+#include "cli/cli_frame.h"
+#include "cli_test/cli_test.h"
+
+#define CLI_TEST_BENCH_NUM_OPTS 		4
+
+/* Command parsed by the benchmarks: x [-zb] [-a <a>] [-m <m>] <arg> */
+static const cli_option_s cli_test_bench_opts[CLI_TEST_BENCH_NUM_OPTS] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'z', 		false, 		false, 		NULL },
+	{ 	'a', 		false, 		true, 		NULL },
+	{ 	'b', 		false, 		false, 		NULL },
+	{ 	'm', 		false, 		true, 		NULL },
+};
+
+static const cli_command_s cli_test_bench_cmd = {
+	"x", 1, CLI_TEST_BENCH_NUM_OPTS, cli_test_bench_opts, NULL, NULL, 0, NULL
+};
+
+/* Tokens of "x -zb -a X arg", after the command name */
+static char cli_test_bench_tok_zb[] = "-zb";
+static char cli_test_bench_tok_a[] = "-a";
+static char cli_test_bench_tok_x[] = "X";
+static char cli_test_bench_tok_arg[] = "arg";
+
+/* Prints one machine-readable result line:
+ * bench,<name>,<iterations>,<usecs>,<per second> */
+static void cli_test_bench_report(const char * name, uint32_t iterations,
+	uint32_t ticks)
+{
+	uint32_t usecs = os_cputime_ticks_to_usecs(ticks);
+	uint32_t rate = 0;
+
+	if(usecs != 0)
+	{
+		rate = (uint32_t)(((uint64_t)iterations * 1000000) / usecs);
+	}
+
+	console_printf("bench,%s,%lu,%lu,%lu\n", name, (unsigned long)iterations,
+		(unsigned long)usecs, (unsigned long)rate);
+}
+
+/* Parses the arguments and options of the benchmark command line, with the
+ * option list compiled once as for registered commands, or on each parse */
+static void cli_test_bench_parse(uint32_t iterations, bool compiled)
+{
+	cli_option_map_s map;
+	cli_ctx_s ctx;
+	char * argv[4];
+	uint32_t start;
+	uint32_t i;
+
+	cli_parse_compile_options(&cli_test_bench_cmd, &map);
+	cli_ctx_init(&ctx, CLI_CTX_F_QUIET, NULL);
+	ctx.cmd = &cli_test_bench_cmd;
+	ctx.opt_map = compiled ? &map : NULL;
+
+	start = os_cputime_get32();
+	for(i = 0; i < iterations; i++)
+	{
+		argv[0] = cli_test_bench_tok_zb;
+		argv[1] = cli_test_bench_tok_a;
+		argv[2] = cli_test_bench_tok_x;
+		argv[3] = cli_test_bench_tok_arg;
+		cli_parse_command_args(&ctx, 4, argv);
+	}
+	cli_test_bench_report(compiled ? "parse" : "parse_compile", iterations,
+		os_cputime_get32() - start);
+}
+
+/* Splits a line into tokens at each space, in place, as the shell does */
+static int cli_test_bench_tokenize(char * line, char ** argv, int max)
+{
+	int argc = 0;
+
+	while((*line != '\0') && (argc < max))
+	{
+		argv[argc++] = line;
+		while((*line != '\0') && (*line != ' '))
+		{
+			line++;
+		}
+		while(*line == ' ')
+		{
+			*line++ = '\0';
+		}
+	}
+
+	return argc;
+}
+
+/* Executes "clitest loop -vd 12 abc 1000" through the text path, from a
+ * received line to the callback */
+static void cli_test_bench_loopback_text(uint32_t iterations)
+{
+	static const char text[] = "clitest loop -vd 12 abc 1000";
+	char line[sizeof(text)];
+	char * argv[8];
+	cli_ctx_s ctx;
+	uint32_t start;
+	uint32_t i;
+	int argc;
+
+	cli_ctx_init(&ctx, CLI_CTX_F_QUIET, NULL);
+
+	start = os_cputime_get32();
+	for(i = 0; i < iterations; i++)
+	{
+		memcpy(line, text, sizeof(text));
+		argc = cli_test_bench_tokenize(line, argv, 8);
+		cli_namespace_execute(&ctx, argc, argv);
+	}
+	cli_test_bench_report("loopback_text", iterations,
+		os_cputime_get32() - start);
+}
+
+/* Executes the binary frame equivalent to the line of the text benchmark */
+static void cli_test_bench_loopback_frame(uint32_t iterations)
+{
+	uint8_t frame[] = {
+		0, 0, 				// namespace and command ids, filled below
+		0x03, 0, 0, 0, 		// -v -d
+		CLI_FRAME_T_UINT, 12, 0, 0, 0,
+		CLI_FRAME_T_STR, 4, 'a', 'b', 'c', 0,
+		CLI_FRAME_T_UINT, 0xe8, 0x03, 0, 0,
+	};
+	uint8_t buf[sizeof(frame)];
+	cli_ctx_s ctx;
+	uint32_t start;
+	uint32_t i;
+
+	if(cli_namespace_get_ids("clitest", "loop", &frame[0], &frame[1]) != 0)
+	{
+		return;
+	}
+
+	cli_ctx_init(&ctx, CLI_CTX_F_QUIET, NULL);
+
+	start = os_cputime_get32();
+	for(i = 0; i < iterations; i++)
+	{
+		memcpy(buf, frame, sizeof(frame));
+		cli_frame_execute(&ctx, buf, sizeof(buf));
+	}
+	cli_test_bench_report("loopback_frame", iterations,
+		os_cputime_get32() - start);
+}
+
+void cli_test_bench(uint32_t iterations)
+{
+	cli_test_bench_parse(iterations, true);
+	cli_test_bench_parse(iterations, false);
+	cli_test_bench_loopback_text(iterations);
+	cli_test_bench_loopback_frame(iterations);
+}
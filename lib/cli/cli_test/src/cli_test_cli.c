@@ -0,0 +1,143 @@
+/*
+ * "clitest" namespace of the CLI test package
+ */
+
+#include "cli/cli_namespace.h"
+#include "cli_test/cli_test.h"
+
+#define NUM_ARGS_BENCH 					1
+#define NUM_ARGS_LOOP 					2
+#define NUM_ARGS_REGISTRY 				1
+#define NUM_ARGS_FLOOD 					2
+#define NUM_ARGS_SPIN 					0
+#define NUM_ARGS_STREAM 				1
+#define NUM_ARGS_HEX 					1
+
+#define NUM_OPTS_BENCH 					0
+#define NUM_OPTS_LOOP 					2
+#define NUM_OPTS_REGISTRY 				0
+#define NUM_OPTS_FLOOD 					0
+#define NUM_OPTS_SPIN 					0
+#define NUM_OPTS_STREAM 				0
+#define NUM_OPTS_HEX 					0
+
+/* Command Callbacks */
+static int on_bench(cli_ctx_s * ctx, char ** args);
+static int on_loop(cli_ctx_s * ctx, char ** args);
+static int on_registry(cli_ctx_s * ctx, char ** args);
+static int on_flood(cli_ctx_s * ctx, char ** args);
+static int on_spin(cli_ctx_s * ctx, char ** args);
+static int on_stream(cli_ctx_s * ctx, char ** args);
+static int on_hex(cli_ctx_s * ctx, char ** args);
+
+/* Help */
+static const char cli_test_help_dialog[] =
+	"\nusage:\n"
+	"\tclitest bench <iterations>\n"
+	"\t\t\t\t- Measure the parse path\n"
+	"\tclitest loop [-v] [-d <d>] <a> <b>\n"
+	"\t\t\t\t- Do nothing; target of the loopback benchmark\n"
+	"\tclitest registry <lookups>\n"
+	"\t\t\t\t- Look namespaces up while others are registered\n"
+	"\tclitest flood <rate> <seconds>\n"
+	"\t\t\t\t- Flood the shell session with <rate> lines/s\n"
+	"\tclitest spin\t\t- Take 200 us of CPU; target of the flood\n"
+	"\tclitest stream <bytes>\n"
+	"\t\t\t\t- Stream <bytes> against hex arguments\n"
+	"\tclitest hex <hex>\t- Count the bytes; target of the stream\n"
+	"\n";
+
+static const cli_arg_type_s cli_test_iterations_type[1] = {
+	{ 	CLI_ARG_T_UINT, 1, UINT32_MAX, NULL },
+};
+
+static const cli_arg_type_s cli_test_flood_types[NUM_ARGS_FLOOD] = {
+	{ 	CLI_ARG_T_UINT, 1, 1000000, NULL },
+	{ 	CLI_ARG_T_UINT, 1, 3600, NULL },
+};
+
+static const cli_arg_type_s cli_test_hex_types[NUM_ARGS_HEX] = {
+	{ 	CLI_ARG_T_BYTES, 0, 0, NULL },
+};
+
+static cli_option_s cli_test_loop_opts[NUM_OPTS_LOOP] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'v', 		false, 		false, 		NULL },
+	{ 	'd', 		false, 		true, 		NULL },
+};
+
+static cli_command_s cli_test_commands[] = {
+// 		name 		num_args 		num_options 	opt_list
+// 		cb 			help 			flags 			arg_types
+	{ 	"bench", 	NUM_ARGS_BENCH, NUM_OPTS_BENCH, NULL,
+		on_bench, 	NULL, 			CLI_CMD_F_ASYNC, cli_test_iterations_type },
+	{ 	"loop", 	NUM_ARGS_LOOP, 	NUM_OPTS_LOOP, 	cli_test_loop_opts,
+		on_loop, 	NULL, 			0, 				NULL },
+	{ 	"registry", NUM_ARGS_REGISTRY, NUM_OPTS_REGISTRY, NULL,
+		on_registry, NULL, 			CLI_CMD_F_ASYNC, cli_test_iterations_type },
+	{ 	"flood", 	NUM_ARGS_FLOOD, NUM_OPTS_FLOOD, NULL,
+		on_flood, 	NULL, 			CLI_CMD_F_ASYNC, cli_test_flood_types },
+	{ 	"spin", 	NUM_ARGS_SPIN, 	NUM_OPTS_SPIN, 	NULL,
+		on_spin, 	NULL, 			0, 				NULL },
+	{ 	"stream", 	NUM_ARGS_STREAM, NUM_OPTS_STREAM, NULL,
+		on_stream, 	NULL, 			0, 				cli_test_iterations_type },
+	{ 	"hex", 		NUM_ARGS_HEX, 	NUM_OPTS_HEX, 	NULL,
+		on_hex, 	NULL, 			0, 				cli_test_hex_types },
+	{ 	NULL, 		0, 				0, 				NULL,
+		NULL, 		NULL, 			0, 				NULL },
+};
+
+/* Namespace Definition */
+static cli_namespace_s cli_test_namespace = {
+	.name = "clitest",
+	.commands = cli_test_commands,
+	.help = cli_test_help_dialog,
+};
+
+/* Command callback implementations */
+
+static int on_bench(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_bench(ctx->values[0].u);
+	return 0;
+}
+
+static int on_loop(cli_ctx_s * ctx, char ** args)
+{
+	return 0;
+}
+
+static int on_registry(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_registry(ctx->values[0].u);
+	return 0;
+}
+
+static int on_flood(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_flood(ctx->values[0].u, ctx->values[1].u);
+	return 0;
+}
+
+static int on_spin(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_spin();
+	return 0;
+}
+
+static int on_stream(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_stream(ctx->values[0].u);
+	return 0;
+}
+
+static int on_hex(cli_ctx_s * ctx, char ** args)
+{
+	cli_test_hex(ctx->values[0].bytes.len);
+	return 0;
+}
+
+void cli_test_cli_init(void)
+{
+	cli_namespace_register(&cli_test_namespace);
+}
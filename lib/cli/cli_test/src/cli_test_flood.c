@@ -0,0 +1,99 @@
+/*
+ * Stress test of the shell session under an input flood
+ */
+
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_limit.h"
+#include "cli_test/cli_test.h"
+
+/* CPU time taken by each flooded line */
+#define CLI_TEST_FLOOD_WORK_USECS 		200
+
+/* Lines run so far, and CPU time of those run from the input queue */
+static uint32_t cli_test_flood_runs;
+static uint32_t cli_test_flood_queued_ticks;
+
+/* Set while the flood is in the dispatcher, whose time is measured as a
+ * whole */
+static bool cli_test_flood_in_rx;
+
+void cli_test_spin(void)
+{
+	uint32_t ticks = os_cputime_usecs_to_ticks(CLI_TEST_FLOOD_WORK_USECS);
+	uint32_t start = os_cputime_get32();
+
+	while(os_cputime_get32() - start < ticks)
+	{
+	}
+
+	if(!__atomic_load_n(&cli_test_flood_in_rx, __ATOMIC_RELAXED))
+	{
+		__atomic_fetch_add(&cli_test_flood_queued_ticks,
+			os_cputime_get32() - start, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&cli_test_flood_runs, 1, __ATOMIC_RELAXED);
+}
+
+void cli_test_flood(uint32_t rate, uint32_t seconds)
+{
+	char nmspc_tok[] = "clitest";
+	char cmd_tok[] = "spin";
+	char * argv[2];
+	cli_limit_stats_s before, after;
+	cli_ctx_s ctx;
+	uint16_t limit, burst;
+	os_time_t start, end, now;
+	uint32_t busy_ticks = 0;
+	uint32_t sent = 0;
+	uint32_t due;
+	uint32_t t0, t;
+
+	cli_ctx_init(&ctx, CLI_CTX_F_QUIET, NULL);
+	cli_limit_shell_get(&limit, &burst);
+	cli_limit_shell_get_stats(&before);
+	__atomic_store_n(&cli_test_flood_runs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cli_test_flood_queued_ticks, 0, __ATOMIC_RELAXED);
+
+	// Send the lines due by each tick, then leave the tick to the other tasks
+	t0 = os_cputime_get32();
+	start = os_time_get();
+	end = start + seconds * OS_TICKS_PER_SEC;
+	while(OS_TIME_TICK_LT((now = os_time_get()), end))
+	{
+		due = (uint32_t)(((uint64_t)(now - start) * rate) / OS_TICKS_PER_SEC);
+		while((sent < due) && OS_TIME_TICK_LT(os_time_get(), end))
+		{
+			argv[0] = nmspc_tok;
+			argv[1] = cmd_tok;
+
+			__atomic_store_n(&cli_test_flood_in_rx, true, __ATOMIC_RELAXED);
+			t = os_cputime_get32();
+			cli_limit_shell_rx(&ctx, 2, argv);
+			busy_ticks += os_cputime_get32() - t;
+			__atomic_store_n(&cli_test_flood_in_rx, false, __ATOMIC_RELAXED);
+
+			sent++;
+		}
+
+		os_time_delay(1);
+	}
+	t = os_cputime_get32() - t0;
+
+	busy_ticks += __atomic_load_n(&cli_test_flood_queued_ticks,
+		__ATOMIC_RELAXED);
+	cli_limit_shell_get_stats(&after);
+
+	console_printf("bench,flood,%lu,%lu,%lu,%lu,%lu\n", (unsigned long)rate,
+		(unsigned long)sent,
+		(unsigned long)__atomic_load_n(&cli_test_flood_runs, __ATOMIC_RELAXED),
+		(unsigned long)os_cputime_ticks_to_usecs(busy_ticks),
+		(unsigned long)os_cputime_ticks_to_usecs(t));
+	console_printf("flood,limit,%u,burst,%u,accepted,%lu,deferred,%lu,"
+		"dropped,%lu\n", limit, burst,
+		(unsigned long)(after.accepted - before.accepted),
+		(unsigned long)(after.deferred - before.deferred),
+		(unsigned long)(after.dropped - before.dropped));
+}
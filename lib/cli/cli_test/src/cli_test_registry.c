@@ -0,0 +1,186 @@
+/*
+ * Concurrency test of the namespace registry: several tasks look namespaces
+ * up while another one registers new namespaces
+ */
+
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli_test/cli_test.h"
+
+#define CLI_TEST_READERS 				MYNEWT_VAL(CLI_TEST_READERS)
+#define CLI_TEST_NAMESPACES 			4
+#define CLI_TEST_STACK_SIZE 			OS_STACK_ALIGN(256)
+
+/* Task of the test. The writer runs above the readers, and sleeps a tick
+ * after each registration, so that it preempts them in the middle of their
+ * lookups */
+typedef struct
+{
+	struct os_task 					task;
+	struct os_sem 					start;			// Released to start a run
+	uint32_t 						count;			// Number of lookups of a reader
+	uint32_t 						misses;			// Registered namespaces a reader did not find
+	os_stack_t 						stack[CLI_TEST_STACK_SIZE];
+} cli_test_registry_task_s;
+
+static int on_nop(cli_ctx_s * ctx, char ** args);
+
+static cli_command_s cli_test_registry_commands[] = {
+// 		name 		num_args 	num_options 	opt_list
+// 		cb 			help 		flags 			arg_types
+	{ 	"z", 		0, 			0, 				NULL,
+		on_nop, 	NULL, 		0, 				NULL },
+	{ 	"y", 		0, 			0, 				NULL,
+		on_nop, 	NULL, 		0, 				NULL },
+	{ 	NULL, 		0, 			0, 				NULL,
+		NULL, 		NULL, 		0, 				NULL },
+};
+
+/* Namespaces registered by the first run; later runs only look them up */
+static cli_namespace_s cli_test_registry_namespaces[CLI_TEST_NAMESPACES] = {
+	{ .name = "reg0", .commands = cli_test_registry_commands },
+	{ .name = "reg1", .commands = cli_test_registry_commands },
+	{ .name = "reg2", .commands = cli_test_registry_commands },
+	{ .name = "reg3", .commands = cli_test_registry_commands },
+};
+
+/* Set once the namespace of the same index is registered */
+static bool cli_test_registry_done[CLI_TEST_NAMESPACES];
+
+static cli_test_registry_task_s cli_test_registry_writer;
+static cli_test_registry_task_s cli_test_registry_readers[CLI_TEST_READERS];
+static struct os_sem cli_test_registry_finished;
+static bool cli_test_registry_started;
+
+static int on_nop(cli_ctx_s * ctx, char ** args)
+{
+	return 0;
+}
+
+static void cli_test_registry_write(void * arg)
+{
+	cli_test_registry_task_s * task = arg;
+	int i;
+
+	for(;;)
+	{
+		os_sem_pend(&task->start, OS_TIMEOUT_NEVER);
+
+		for(i = 0; i < CLI_TEST_NAMESPACES; i++)
+		{
+			if(!cli_test_registry_done[i] &&
+				(cli_namespace_register(&cli_test_registry_namespaces[i]) == 0))
+			{
+				__atomic_store_n(&cli_test_registry_done[i], true,
+					__ATOMIC_RELEASE);
+				os_time_delay(1);
+			}
+		}
+
+		os_sem_release(&cli_test_registry_finished);
+	}
+}
+
+static void cli_test_registry_read(void * arg)
+{
+	cli_test_registry_task_s * task = arg;
+	uint8_t nmspc_id, cmd_id;
+	bool registered;
+	uint32_t i;
+	int k;
+
+	for(;;)
+	{
+		os_sem_pend(&task->start, OS_TIMEOUT_NEVER);
+
+		task->misses = 0;
+		for(i = 0; i < task->count; i++)
+		{
+			// A namespace must be found once its registration has returned
+			k = i % CLI_TEST_NAMESPACES;
+			registered = __atomic_load_n(&cli_test_registry_done[k],
+				__ATOMIC_ACQUIRE);
+			if((cli_namespace_get_ids(cli_test_registry_namespaces[k].name,
+				"y", &nmspc_id, &cmd_id) != 0) && registered)
+			{
+				task->misses++;
+			}
+		}
+
+		os_sem_release(&cli_test_registry_finished);
+	}
+}
+
+static void cli_test_registry_init_task(cli_test_registry_task_s * task,
+	os_task_func_t func, uint8_t prio)
+{
+	os_sem_init(&task->start, 0);
+	os_task_init(&task->task, "cli_test", func, task, prio, OS_WAIT_FOREVER,
+		task->stack, CLI_TEST_STACK_SIZE);
+}
+
+/* Creates the tasks the first time they are needed */
+static void cli_test_registry_start(void)
+{
+	int r;
+
+	if(cli_test_registry_started)
+	{
+		return;
+	}
+
+	os_sem_init(&cli_test_registry_finished, 0);
+
+	cli_test_registry_init_task(&cli_test_registry_writer,
+		cli_test_registry_write, MYNEWT_VAL(CLI_TEST_TASK_PRIO));
+	for(r = 0; r < CLI_TEST_READERS; r++)
+	{
+		cli_test_registry_init_task(&cli_test_registry_readers[r],
+			cli_test_registry_read, MYNEWT_VAL(CLI_TEST_TASK_PRIO) + 1 + r);
+	}
+
+	cli_test_registry_started = true;
+}
+
+void cli_test_registry(uint32_t lookups)
+{
+	uint32_t misses = 0;
+	uint32_t usecs;
+	uint32_t start;
+	uint32_t rate = 0;
+	uint32_t r;
+
+	cli_test_registry_start();
+
+	start = os_cputime_get32();
+	for(r = 0; r < CLI_TEST_READERS; r++)
+	{
+		cli_test_registry_readers[r].count = lookups / CLI_TEST_READERS +
+			((r < lookups % CLI_TEST_READERS) ? 1 : 0);
+		os_sem_release(&cli_test_registry_readers[r].start);
+	}
+	os_sem_release(&cli_test_registry_writer.start);
+
+	for(r = 0; r < CLI_TEST_READERS + 1; r++)
+	{
+		os_sem_pend(&cli_test_registry_finished, OS_TIMEOUT_NEVER);
+	}
+	usecs = os_cputime_ticks_to_usecs(os_cputime_get32() - start);
+
+	for(r = 0; r < CLI_TEST_READERS; r++)
+	{
+		misses += cli_test_registry_readers[r].misses;
+	}
+
+	if(usecs != 0)
+	{
+		rate = (uint32_t)(((uint64_t)lookups * 1000000) / usecs);
+	}
+
+	console_printf("bench,registry,%lu,%lu,%lu\n", (unsigned long)lookups,
+		(unsigned long)usecs, (unsigned long)rate);
+	console_printf("registry,readers,%d,misses,%lu\n", CLI_TEST_READERS,
+		(unsigned long)misses);
+}
@@ -0,0 +1,170 @@
+/*
+ * Benchmark of the bulk data stream against hex command arguments
+ */
+
+#include <string.h>
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_stream.h"
+#include "cli_test/cli_test.h"
+
+/* Bytes received from the console at once, and length of the command lines
+ * of the hex path, terminator included */
+#define CLI_TEST_STREAM_LINE 			128
+
+/* Bytes carried by a "clitest hex <hex>" line */
+#define CLI_TEST_STREAM_HEX_BYTES 		((CLI_TEST_STREAM_LINE - 1 - \
+	(sizeof("clitest hex ") - 1)) / 2)
+
+/* Bytes consumed by the sink of the stream or by "clitest hex" */
+static uint32_t cli_test_stream_count;
+
+/* Set once the stream ends, with its result */
+static bool cli_test_stream_done;
+static int cli_test_stream_rc;
+
+void cli_test_hex(uint16_t len)
+{
+	__atomic_fetch_add(&cli_test_stream_count, len, __ATOMIC_RELAXED);
+}
+
+static int cli_test_stream_sink(void * arg, const uint8_t * data, uint16_t len)
+{
+	cli_test_hex(len);
+	return 0;
+}
+
+static void cli_test_stream_on_done(void * arg, int rc)
+{
+	cli_test_stream_rc = rc;
+	__atomic_store_n(&cli_test_stream_done, true, __ATOMIC_RELEASE);
+}
+
+/* Feeds bytes to a stream in console-sized pieces. When all the chunk buffers
+ * wait for the sink, the rest of the piece is held and fed again after a
+ * tick, as a transport holding off its sender would. Returns the time taken
+ * until the stream ended, and the number of short accepts in shorts */
+static int cli_test_stream_feed(uint32_t bytes, uint32_t * ticks,
+	uint32_t * shorts)
+{
+	static const uint8_t piece[CLI_TEST_STREAM_LINE];
+	uint32_t fed = 0;
+	uint32_t start;
+	uint16_t len;
+	int rc;
+
+	*shorts = 0;
+	__atomic_store_n(&cli_test_stream_count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cli_test_stream_done, false, __ATOMIC_RELAXED);
+
+	start = os_cputime_get32();
+	rc = cli_stream_open(bytes, cli_test_stream_sink, cli_test_stream_on_done,
+		NULL);
+	if(rc != 0)
+	{
+		return rc;
+	}
+
+	while(fed < bytes)
+	{
+		len = (bytes - fed < sizeof(piece)) ?
+			(uint16_t)(bytes - fed) : sizeof(piece);
+
+		rc = cli_stream_feed(piece, len);
+		if(rc < 0)
+		{
+			cli_stream_abort();
+			return rc;
+		}
+
+		fed += rc;
+		if(rc < len)
+		{
+			(*shorts)++;
+			os_time_delay(1);
+		}
+	}
+
+	// The last chunks may still be with the sink on the worker
+	while(!__atomic_load_n(&cli_test_stream_done, __ATOMIC_ACQUIRE))
+	{
+		os_time_delay(1);
+	}
+	*ticks = os_cputime_get32() - start;
+
+	return cli_test_stream_rc;
+}
+
+/* Executes the "clitest hex" lines carrying bytes, from a received line to the
+ * callback. Returns the time taken */
+static uint32_t cli_test_stream_hex(uint32_t bytes)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	char hex[CLI_TEST_STREAM_HEX_BYTES * 2 + 1];
+	char line[sizeof(hex)];
+	char nmspc_tok[] = "clitest";
+	char cmd_tok[] = "hex";
+	char * argv[3];
+	cli_ctx_s ctx;
+	uint32_t start;
+	uint32_t sent;
+	uint32_t n;
+	uint32_t i;
+
+	for(i = 0; i < CLI_TEST_STREAM_HEX_BYTES; i++)
+	{
+		hex[2 * i] = hex_digits[(i >> 4) & 0xf];
+		hex[2 * i + 1] = hex_digits[i & 0xf];
+	}
+
+	cli_ctx_init(&ctx, CLI_CTX_F_QUIET, NULL);
+	__atomic_store_n(&cli_test_stream_count, 0, __ATOMIC_RELAXED);
+
+	start = os_cputime_get32();
+	for(sent = 0; sent < bytes; sent += n)
+	{
+		n = (bytes - sent < CLI_TEST_STREAM_HEX_BYTES) ?
+			bytes - sent : CLI_TEST_STREAM_HEX_BYTES;
+
+		// The argument is decoded in place, as the console line would be
+		memcpy(line, hex, 2 * n);
+		line[2 * n] = '\0';
+
+		argv[0] = nmspc_tok;
+		argv[1] = cmd_tok;
+		argv[2] = line;
+		cli_namespace_execute(&ctx, 3, argv);
+	}
+
+	return os_cputime_get32() - start;
+}
+
+void cli_test_stream(uint32_t bytes)
+{
+	uint32_t stream_ticks = 0;
+	uint32_t hex_ticks;
+	uint32_t shorts;
+	uint32_t consumed;
+	int rc;
+
+	rc = cli_test_stream_feed(bytes, &stream_ticks, &shorts);
+	consumed = __atomic_load_n(&cli_test_stream_count, __ATOMIC_RELAXED);
+	if(rc != 0)
+	{
+		console_printf("stream: error %d\n", rc);
+		return;
+	}
+
+	hex_ticks = cli_test_stream_hex(bytes);
+
+	console_printf("bench,stream,%lu,%lu,%lu\n", (unsigned long)bytes,
+		(unsigned long)os_cputime_ticks_to_usecs(stream_ticks),
+		(unsigned long)os_cputime_ticks_to_usecs(hex_ticks));
+	console_printf("stream,chunks,%d,short,%lu,consumed,%lu,hex,%lu\n",
+		MYNEWT_VAL(CLI_STREAM_CHUNKS), (unsigned long)shorts,
+		(unsigned long)consumed,
+		(unsigned long)__atomic_load_n(&cli_test_stream_count,
+			__ATOMIC_RELAXED));
+}
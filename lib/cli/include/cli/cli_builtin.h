@@ -0,0 +1,28 @@
+/*
+ * Built-in "cli" namespace of the CLI module
+ *
+ *	Usage:
+ *		cli run [-cq] <command> [; <command> ...]
+ *		cli jobs
+ *		cli stats [-r]
+ *		cli complete [-u] [<namespace> [<command>]]
+ *		cli stream [-a]
+ *		cli limit [-r <rate>] [-b <burst>]
+ *
+ *	Options:
+ *		-c 			Keep going after a command failed
+ *		-q 			Suppress the output of the commands
+ *		-r 			Clear the statistics once shown
+ *		-u 			Show the memory used by the name trie
+ *		-a 			Abort the data stream
+ *		-r 			Limit the shell session to <rate> lines per second
+ *		-b 			Let the shell session run bursts of <burst> lines
+ */
+
+#ifndef __CLI_BUILTIN_H__
+#define __CLI_BUILTIN_H__
+
+/* Registers the built-in namespace with the shell */
+int cli_builtin_register(void);
+
+#endif // __CLI_BUILTIN_H__
@@ -0,0 +1,59 @@
+/*
+ * Prefix matching and completion of namespace and command names. Registered
+ * names are indexed in a character trie, built in a static node pool (syscfg
+ * CLI_TRIE_NODES) as namespaces are registered. Resolving a prefix or
+ * completing it walks one trie node per character of the input, whatever the
+ * number of registered names.
+ *
+ * A command name may be abbreviated to any prefix that no other command of
+ * its namespace shares: with flip, flop and floop registered, "hsm fli" runs
+ * flip while "hsm fl" is rejected with the list of the candidates. Namespace
+ * names must be entered in full, as the shell matches them.
+ *
+ * cli_complete is not hooked to the tab key of the console, whose completion
+ * callback belongs to the Mynewt shell: an application wanting it installs
+ * its own callback calling cli_complete. The "cli complete" command exposes
+ * it to hosts.
+ */
+
+#ifndef __CLI_COMPLETE_H__
+#define __CLI_COMPLETE_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "cli/cli_namespace.h"
+
+/* Called for each name matching a prefix, in alphabetical order */
+typedef void cli_complete_fn(const char * name, void * arg);
+
+/* Memory used by the name trie */
+typedef struct
+{
+	uint16_t 						nodes_used;		// Nodes holding registered names
+	uint16_t 						nodes_total;	// Nodes of the pool (CLI_TRIE_NODES)
+	uint16_t 						node_size;		// Size of a node, in bytes
+} cli_complete_usage_s;
+
+/**
+ * @brief Completes the last token of a partial command line: a namespace name
+ *        if it is the first token, else a command name of the namespace named
+ *        by the first token. A line ending with a blank completes a new,
+ *        empty token.
+ *
+ * @param line                  The partial command line.
+ * @param suffix                Receives the characters which extend the last
+ *                              token to the longest prefix shared by all
+ *                              matching names, NUL-terminated. May be NULL.
+ * @param size                  Size of suffix.
+ * @param cb                    Called for each matching name. May be NULL.
+ * @param arg                   Passed to cb.
+ *
+ * @return                      The number of matching names; 0 if none.
+ */
+int cli_complete(const char * line, char * suffix, size_t size,
+	cli_complete_fn * cb, void * arg);
+
+/* Reports the memory used by the name trie */
+void cli_complete_get_usage(cli_complete_usage_s * usage);
+
+#endif // __CLI_COMPLETE_H__
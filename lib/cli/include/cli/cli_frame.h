@@ -0,0 +1,80 @@
+/*
+ * Binary command frames. Machine clients may invoke the commands of the
+ * registered namespaces with binary frames instead of text lines. A frame is
+ * dispatched straight to the command callback, without tokenization, name
+ * lookup or option parsing. Delimiting and checking the frames is left to the
+ * transport. Frames are executed on the transport's task, including those
+ * of CLI_CMD_F_ASYNC commands.
+ *
+ * Frame layout (multi-byte values are little-endian):
+ *
+ *	u8 		namespace id 	(see cli_namespace_get_ids)
+ *	u8 		command id
+ *	u32 	option mask 	(bit i set if opt_list[i] is given)
+ *	fields 	one per given option requiring an argument, in opt_list order,
+ *			followed by one per command argument
+ *
+ * A CLI_CMD_F_RAW command takes at least num_args argument fields, and
+ * possibly more, up to CLI_FRAME_MAX_FIELDS fields in all: as with a text
+ * line, its argument fields are passed untyped in raw_argv, the first
+ * num_args of them also in args. "cli run" thus takes the tokens of its
+ * script as string fields.
+ *
+ * Field layout:
+ *
+ *	u8 		type 			(CLI_FRAME_T_*)
+ *	STR: 	u8 length, then the string including its terminating NUL
+ *	INT: 	i32
+ *	UINT: 	u32
+ *	FLOAT: 	IEEE 754 single precision
+ *	BYTES: 	u8 length, then the bytes
+ *
+ * Fields of arguments with a declared type (cli_arg_type_s) are converted
+ * straight to cli_ctx_s.values or cli_ctx_s.opt_values, and their entry in
+ * args or opt_args is NULL unless the field is a string. FLOAT and BYTES
+ * fields are only accepted for typed arguments.
+ *
+ * Sample frame for "hsm bench -d 4 1000", if hsm is namespace 0:
+ *
+ *	00 05 01 00 00 00 	01 04 00 00 00 	02 e8 03 00 00
+ */
+
+#ifndef __CLI_FRAME_H__
+#define __CLI_FRAME_H__
+
+#include <inttypes.h>
+#include "cli/cli_namespace.h"
+
+#define CLI_FRAME_T_STR 				0
+#define CLI_FRAME_T_INT 				1
+#define CLI_FRAME_T_UINT 				2
+#define CLI_FRAME_T_FLOAT 				3
+#define CLI_FRAME_T_BYTES 				4
+
+/* Size of the frame header */
+#define CLI_FRAME_HDR_LEN 				6
+
+/* Largest number of fields of a frame */
+#define CLI_FRAME_MAX_FIELDS 			(MYNEWT_VAL(CLI_MAX_NUM_ARGS) + \
+										MYNEWT_VAL(CLI_MAX_NUM_OPTIONS))
+
+/**
+ * @brief Executes a binary command frame.
+ *
+ * String fields are passed to the command in place. Numeric fields of
+ * untyped arguments are converted to decimal strings. The argument fields
+ * of a CLI_CMD_F_RAW command, however many, are passed in raw_argv.
+ *
+ * @param ctx                   The parse context, prepared by cli_ctx_init.
+ * @param buf                   The frame.
+ * @param len                   The length of the frame.
+ *
+ * @return                      The error of the command callback,
+ *                              CLI_ERROR_BAD_ARG if the frame is malformed
+ *                              or holds an invalid value,
+ *                              or SYS_ENOENT if the namespace or command is
+ *                              not registered.
+ */
+int cli_frame_execute(cli_ctx_s * ctx, uint8_t * buf, uint16_t len);
+
+#endif // __CLI_FRAME_H__
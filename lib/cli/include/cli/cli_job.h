@@ -0,0 +1,55 @@
+/*
+ * Asynchronous CLI commands. Commands flagged CLI_CMD_F_ASYNC are parsed and
+ * checked on the caller's task, then run as jobs on a worker event queue
+ * provided by the application, so that a slow command does not hold up the
+ * shell. The caller gets the job id straight away; the job keeps its own copy
+ * of the command line.
+ *
+ * At most CLI_MAX_JOBS jobs are queued or running at once; further
+ * asynchronous commands are rejected until one completes. The slot of a
+ * completed job keeps its result until the slot is reused.
+ *
+ * Until cli_job_init is called, asynchronous commands run synchronously.
+ */
+
+#ifndef __CLI_JOB_H__
+#define __CLI_JOB_H__
+
+#include <inttypes.h>
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+
+/* Job states */
+#define CLI_JOB_QUEUED 					1
+#define CLI_JOB_RUNNING 				2
+#define CLI_JOB_DONE 					3
+
+/* Status of a job */
+typedef struct
+{
+	uint16_t 						id;				// Job id
+	uint8_t 						state;			// CLI_JOB_*
+	int 							rc;				// Return code of the command (CLI_JOB_DONE)
+	const char * 					name;			// Command name
+} cli_job_info_s;
+
+/* Sets the event queue on which asynchronous commands run. Its task should
+ * have a lower priority than the shell */
+void cli_job_init(struct os_eventq * evq);
+
+/* Returns the status of a job. Returns 0, or SYS_ENOENT if the job is unknown
+ * or its slot was reused */
+int cli_job_get_info(uint16_t id, cli_job_info_s * info);
+
+/* Returns the status of up to max jobs, in slot order. Returns the number of
+ * jobs reported */
+int cli_job_list(cli_job_info_s * infos, int max);
+
+/* Prints output of a command (see cli_printf). Output of a job is prefixed
+ * with its id, so that it can be told apart from the shell output. It is
+ * written to the console whenever the output buffer of the job fills, so that
+ * it streams as the job runs */
+void cli_job_printf(const cli_ctx_s * ctx, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#endif // __CLI_JOB_H__
@@ -0,0 +1,67 @@
+/*
+ * Input rate limiting of the CLI sessions. Each session may get a token
+ * bucket: a command line takes a token, tokens come back at a fixed rate, and
+ * the bucket holds at most a burst of tokens. A host flooding the console can
+ * then not keep the shell task busy running commands at the expense of the
+ * other tasks.
+ *
+ * The shell session is limited by syscfg CLI_RATE_LIMIT and CLI_RATE_BURST,
+ * or by cli_limit_shell_set. A line received while its bucket is empty is
+ * copied to a queue of CLI_INPUT_QUEUE_LEN lines, answered with "busy:"
+ * followed by its namespace and command, and run in order once tokens come
+ * back. A line received while the queue is full, or too long to be queued, is
+ * answered likewise with "overflow:" and dropped.
+ * Queued lines are run on the default event queue, where the shell runs
+ * unless moved elsewhere, with an output buffer of their own.
+ */
+
+#ifndef __CLI_LIMIT_H__
+#define __CLI_LIMIT_H__
+
+#include <inttypes.h>
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+
+/* Counters of a rate-limited session */
+typedef struct
+{
+	uint32_t 						accepted;		// Lines run as soon as received
+	uint32_t 						deferred;		// Lines queued, answered with "busy"
+	uint32_t 						dropped;		// Lines dropped, answered with "overflow"
+	uint16_t 						queue_max;		// Largest number of queued lines
+} cli_limit_stats_s;
+
+/* Token bucket of a session */
+typedef struct
+{
+	uint16_t 						rate;			// Lines per second; 0 if unlimited
+	uint16_t 						burst;			// Largest number of lines run back to back
+	uint32_t 						tokens;			// Available lines, in 1/OS_TICKS_PER_SEC units
+	os_time_t 						last;			// Time of the last refill
+} cli_limit_s;
+
+/* Prepares the token bucket of a session, full. A rate of 0 lifts the
+ * limit */
+void cli_limit_init(cli_limit_s * limit, uint16_t rate, uint16_t burst);
+
+/* Takes a token for a line. Returns false if the session is over its rate */
+bool cli_limit_take(cli_limit_s * limit);
+
+/* Returns the number of ticks until the next token of a session */
+os_time_t cli_limit_delay(cli_limit_s * limit);
+
+/* Runs a command line received by the shell session with the caller's parse
+ * context, or else queues or drops it if the session is over its rate. The
+ * shell calls it for each line; a test may call it to flood the session */
+int cli_limit_shell_rx(cli_ctx_s * ctx, int argc, char ** argv);
+
+/* Sets the rate limit of the shell session */
+void cli_limit_shell_set(uint16_t rate, uint16_t burst);
+
+/* Returns the rate limit of the shell session */
+void cli_limit_shell_get(uint16_t * rate, uint16_t * burst);
+
+/* Returns the counters of the shell session */
+void cli_limit_shell_get_stats(cli_limit_stats_s * stats);
+
+#endif // __CLI_LIMIT_H__
@@ -11,6 +11,11 @@
  *	- All options are single character flags. Long options (e.g. --help)
  *	  are invalid
  *	- Command lists must be terminated with a NULL value in the name field
+ *	- Arguments and option arguments may declare a type (cli_arg_type_s).
+ *	  They are then converted and range-checked while the command line is
+ *	  parsed, and delivered in cli_ctx_s.values and cli_ctx_s.opt_values.
+ *	  A command line with an invalid value is rejected before the command
+ *	  is called
  *
  * Sample Namespace implementation:
 
@@ -71,17 +76,58 @@ static cli_namespace_s test_namespace = {
 /* Forward struct declarations */
 typedef struct cli_command_s cli_command_s;
 typedef struct cli_namespace_s cli_namespace_s;
+typedef struct cli_ctx_s cli_ctx_s;
+typedef struct cli_out_s cli_out_s;
 
-/* Command callback prototype */
-typedef int cli_command_fn(cli_command_s * cmd, char ** args);
+/* Command callback prototype. args is ctx->args */
+typedef int cli_command_fn(cli_ctx_s * ctx, char ** args);
+
+/* Types of command arguments and option arguments */
+typedef enum
+{
+	CLI_ARG_T_STR 		= 0,	// String, value.str
+	CLI_ARG_T_INT,				// Signed 32-bit integer, value.i
+	CLI_ARG_T_UINT,				// Unsigned 32-bit integer, value.u
+	CLI_ARG_T_FLOAT,			// Single precision float, value.f
+	CLI_ARG_T_BOOL,				// 1/0, true/false, on/off, value.b
+	CLI_ARG_T_ENUM,				// One of the names of the type, value.e is its index
+	CLI_ARG_T_BYTES,			// Hex string decoded in place, value.bytes
+} cli_arg_type_e;
+
+/* Declared type of an argument. Integers may be given in decimal or in
+ * hexadecimal (0x prefix). The range is ignored if min and max are both 0 */
+typedef struct
+{
+	uint8_t 						type;			// One of cli_arg_type_e
+	int64_t 						min;			// Smallest value (INT, UINT, FLOAT) or length (STR, BYTES)
+	int64_t 						max;			// Largest value (INT, UINT, FLOAT) or length (STR, BYTES)
+	const char * const * 			names;			// NULL-terminated enumerator names (ENUM)
+} cli_arg_type_s;
+
+/* Argument value converted to its declared type */
+typedef union
+{
+	const char * 					str;
+	int32_t 						i;
+	uint32_t 						u;
+	float 							f;
+	bool 							b;
+	int 							e;
+	struct
+	{
+		uint8_t * 					data;
+		uint16_t 					len;
+	} bytes;
+} cli_value_u;
 
 /* Command option */
 typedef struct
 {
 	const char 						name;			// Option names are a single character
-	bool 							value;			// Indicates if the option was found
+	bool 							value;			// Unused; see cli_opt_found
 	bool 							has_arg;		// Indicates if the option requires an arg
-	char * 							arg_value; 		// Arg value if the option was found
+	char * 							arg_value; 		// Unused; see cli_ctx_s.opt_args
+	const cli_arg_type_s * 			arg_type;		// Optional type of the option argument; string if NULL
 } cli_option_s;
 
 /* Command definition */
@@ -93,6 +139,8 @@ struct cli_command_s
 	const cli_option_s *			opt_list;		// Option details
 	cli_command_fn * 				cb;				// Function called if the command was entered properly
 	const char * 					help; 			// Command help text
+	uint8_t 						flags;			// CLI_CMD_F_* flags
+	const cli_arg_type_s * 			arg_types;		// Optional types of the num_args arguments; strings if NULL
 };
 
 /* Name space to group multiple commands */
@@ -101,10 +149,106 @@ struct cli_namespace_s
 	const char * 					name;			// Namespace name
 	const cli_command_s * 			commands;		// Commands belonging to the namespace
 	const char *  					help; 			// Namespace help text
-	SLIST_ENTRY(cli_namespace_s) 	next;
+
+	// Lookup index, managed by the CLI module
+	uint32_t						hash;			// Hash of the namespace name
+	uint8_t 						id;				// Registration order, used by binary frames
+	uint16_t						num_commands;	// Number of commands in the list
+	uint16_t						cmd_base;		// First entry in the command hash index
+	uint16_t						slot_base;		// First slot in the command hash table
+	uint16_t						slot_mask;		// Number of command hash slots - 1
+	uint16_t 						trie_root;		// Root of the command name trie
+};
+
+#if MYNEWT_VAL(CLI_MAX_NUM_OPTIONS) > 32
+#error "CLI_MAX_NUM_OPTIONS cannot exceed 32"
+#endif
+
+/* Only the options before the first argument are parsed. The first argument
+ * and all the tokens after it, however many, are left in cli_ctx_s.raw_argv;
+ * num_args is the minimum number of such tokens */
+#define CLI_CMD_F_RAW 					0x01
+/* The command is run as a job on the CLI worker event queue (see cli_job.h).
+ * Its command line is parsed and checked first, and the caller gets the job
+ * id in cli_ctx_s.job_id */
+#define CLI_CMD_F_ASYNC 				0x02
+/* An error returned by the callback is the outcome of the command rather
+ * than a misuse of it, so the help of the command is not printed */
+#define CLI_CMD_F_NO_ERROR_HELP 		0x04
+
+/* Suppress the output of the CLI module and of the command */
+#define CLI_CTX_F_QUIET 				0x01
+
+/* Option list of a command compiled for single-pass option parsing. The option
+ * declared for a character c is found by testing bit c of chars; its index in
+ * opt_list is index[number of declared characters lower than c]. This takes
+ * the place of a 128-entry character lookup table in a fraction of its RAM */
+typedef struct
+{
+	uint32_t 						chars[4];		// Bitmap of the declared option characters (ASCII)
+	uint32_t 						has_arg;		// Bitmask of the options requiring an argument
+	uint8_t 						rank_base[4];	// Number of declared characters below each word of chars
+	uint8_t 						index[MYNEWT_VAL(CLI_MAX_NUM_OPTIONS)];	// opt_list index by character rank
+} cli_option_map_s;
+
+/* Output buffer of a session. The output of the CLI and of the commands
+ * (cli_printf, cli_puts) is gathered here and written to the console at once
+ * when the command completes or the buffer fills (see cli_out.h) */
+struct cli_out_s
+{
+	char * 							buf;			// Storage
+	uint16_t 						size;			// Size of buf
+	uint16_t 						len;			// Number of pending characters in buf
+};
+
+/* Parse results of a single command invocation. Owned by the caller (usually
+ * on its stack), so that several sessions can execute commands concurrently */
+struct cli_ctx_s
+{
+	uint8_t 						flags;			// CLI_CTX_F_* flags, set by the caller
+	cli_out_s * 					out;			// Output buffer of the session, set by the caller; NULL to write through
+	const cli_command_s * 			cmd;			// Command being executed
+	const cli_option_map_s * 		opt_map;		// Compiled option list of cmd; NULL to compile it on each parse
+	char * 							args[MYNEWT_VAL(CLI_MAX_NUM_ARGS)];			// Arguments, in order
+	uint32_t 						opt_mask;		// Bit i is set if opt_list[i] was found
+	char * 							opt_args[MYNEWT_VAL(CLI_MAX_NUM_OPTIONS)];	// Option arguments, in opt_list order
+	cli_value_u 					values[MYNEWT_VAL(CLI_MAX_NUM_ARGS)];		// Arguments converted to their types
+	cli_value_u 					opt_values[MYNEWT_VAL(CLI_MAX_NUM_OPTIONS)];	// Option arguments converted to their types
+	int 							raw_argc;		// Number of unparsed tokens (CLI_CMD_F_RAW)
+	char ** 						raw_argv;		// Unparsed tokens (CLI_CMD_F_RAW)
+	uint16_t 						job_id;			// Job started by the caller, or job running the command; 0 if none
 };
 
-/* Called by each namespace to register its name with the Mynewt shell */
+/* Prepares a parse context for a session */
+static inline void cli_ctx_init(cli_ctx_s * ctx, uint8_t flags, cli_out_s * out)
+{
+	ctx->flags = flags;
+	ctx->out = out;
+	ctx->job_id = 0;
+}
+
+/* Indicates whether option opt_list[idx] was given */
+static inline bool cli_opt_found(const cli_ctx_s * ctx, int idx)
+{
+	return (ctx->opt_mask & ((uint32_t)1 << idx)) != 0;
+}
+
+/* Called by each namespace to register its name with the Mynewt shell. The
+ * namespace and its commands are indexed by name so that the shell lines are
+ * dispatched without scanning the registered names. Their names are also
+ * indexed for prefix matching and completion (see cli_complete.h) */
 int cli_namespace_register(cli_namespace_s * new_namespace);
 
+/* Looks up the ids under which a namespace command is reached by binary
+ * frames (see cli_frame.h). Returns 0, or SYS_ENOENT if either is not
+ * registered */
+int cli_namespace_get_ids(const char * nmspc_name, const char * cmd_name,
+	uint8_t * nmspc_id, uint8_t * cmd_id);
+
+/* Executes a tokenized command line (argv[0] being the namespace name) using
+ * the caller's parse context, prepared by cli_ctx_init. The output of the
+ * command is flushed before returning. Returns 0 or the error of the lookup,
+ * the parse or the command callback */
+int cli_namespace_execute(cli_ctx_s * ctx, int argc, char ** argv);
+
 #endif // __CLI_NAMESPACE_H__
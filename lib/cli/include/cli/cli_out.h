@@ -0,0 +1,34 @@
+/*
+ * Buffered output of the CLI sessions. Commands and the CLI module write their
+ * output through the session of the command (cli_ctx_s.out) rather than
+ * straight to the console. The output is gathered in the session buffer and
+ * written with a single console_write when the command completes or the
+ * buffer fills, so that a response is not interleaved with other output and
+ * does not pay for many small console writes.
+ *
+ * Output of a session without a buffer is written through to the console.
+ * Output of a session executing with CLI_CTX_F_QUIET is discarded.
+ */
+
+#ifndef __CLI_OUT_H__
+#define __CLI_OUT_H__
+
+#include <stdarg.h>
+#include "cli/cli_namespace.h"
+
+/* Prints formatted output of a command */
+void cli_printf(const cli_ctx_s * ctx, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Prints formatted output of a command */
+void cli_vprintf(const cli_ctx_s * ctx, const char * fmt, va_list ap);
+
+/* Prints a string as is. Prefer it to cli_printf for constant strings, as it
+ * skips the formatting */
+void cli_puts(const cli_ctx_s * ctx, const char * str);
+
+/* Writes the pending output of a session to the console. Called by the CLI
+ * module once a command completes */
+void cli_flush(const cli_ctx_s * ctx);
+
+#endif // __CLI_OUT_H__
@@ -14,9 +14,33 @@
 #define CLI_ERROR_OPTION_NOT_FOUND          2
 #define CLI_ERROR_HELP_REQUESTED            3
 
-/* Parses arguments and options with respect to the given command */
-int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
-	char ** arg_list);
+/* Parses arguments and options with respect to ctx->cmd into ctx */
+int cli_parse_command_args(cli_ctx_s * ctx, int argc, char ** argv);
+
+/**
+ * @brief Compiles the option list of a command for cli_parse_command_args.
+ *
+ * @param cmd                   The command whose options are compiled.
+ * @param map                   The compiled option list.
+ *
+ * @return                      CLI_ERROR_NONE, or CLI_ERROR_BAD_ARG if an
+ *                              option name is not ASCII or is declared twice.
+ */
+int cli_parse_compile_options(const cli_command_s * cmd, cli_option_map_s * map);
+
+/**
+ * @brief Converts a string to a declared argument type and checks its range.
+ *
+ * @param type                  The argument type.
+ * @param str                   The string. CLI_ARG_T_BYTES strings are
+ *                              decoded in place.
+ * @param value                 The converted value.
+ *
+ * @return                      CLI_ERROR_NONE, or CLI_ERROR_BAD_ARG if the
+ *                              string is not a valid value of the type.
+ */
+int cli_parse_value(const cli_arg_type_s * type, char * str,
+	cli_value_u * value);
 
 /**
  * @brief Indicates whether the provided CLI argument is a request for help.
@@ -0,0 +1,70 @@
+/*
+ * Batch execution of CLI commands. A script holds commands separated by ';'
+ * or new lines, whose tokens are separated by spaces or tabs. Lines starting
+ * with '#' are comments. The script is tokenized in place, without copies,
+ * and its commands are executed back to back as if each had been entered at
+ * the shell. Only commands of registered CLI namespaces can be executed.
+ *
+ * Sample script:
+
+	# Toggle the test state machine
+	hsm enter
+	hsm flip; hsm flop; hsm floop
+	hsm exit
+
+ */
+
+#ifndef __CLI_RUN_H__
+#define __CLI_RUN_H__
+
+#include <inttypes.h>
+#include "cli/cli_namespace.h"
+
+/* Keep executing the commands of a script after one of them failed */
+#define CLI_RUN_F_CONTINUE 				0x01
+/* Suppress the output of the executed commands */
+#define CLI_RUN_F_QUIET 				0x02
+
+/* Outcome of the execution of a script */
+typedef struct
+{
+	uint32_t 						executed;		// Number of commands executed
+	uint32_t 						failed;			// Number of commands which returned an error
+	uint32_t 						first_failed;	// 1-based index of the first failed command; 0 if none
+	int 							rc;				// Error returned by the first failed command
+} cli_run_summary_s;
+
+/**
+ * @brief Executes the commands of a script.
+ *
+ * @param buf                   The script, as a writable NUL-terminated
+ *                              string. Separators are overwritten with NULs.
+ * @param flags                 CLI_RUN_F_* flags.
+ * @param out                   The output buffer of the session, or NULL.
+ * @param summary               The outcome of the execution.
+ *
+ * @return                      0 if all commands succeeded, else the error of
+ *                              the first failed command.
+ */
+int cli_run_buf(char * buf, uint8_t flags, cli_out_s * out,
+	cli_run_summary_s * summary);
+
+/**
+ * @brief Executes the commands of a script already split into tokens, as
+ *        received from the shell. Commands are separated by ';', either as
+ *        tokens of their own or within tokens.
+ *
+ * @param argc                  The number of tokens.
+ * @param argv                  The tokens. Separators are overwritten with
+ *                              NULs.
+ * @param flags                 CLI_RUN_F_* flags.
+ * @param out                   The output buffer of the session, or NULL.
+ * @param summary               The outcome of the execution.
+ *
+ * @return                      0 if all commands succeeded, else the error of
+ *                              the first failed command.
+ */
+int cli_run_argv(int argc, char ** argv, uint8_t flags, cli_out_s * out,
+	cli_run_summary_s * summary);
+
+#endif // __CLI_RUN_H__
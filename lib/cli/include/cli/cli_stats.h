@@ -0,0 +1,57 @@
+/*
+ * Invocation statistics of the CLI commands (syscfg CLI_STATS). For each
+ * namespace and each command, the CLI counts the invocations and failures and
+ * keeps histograms of the time spent looking up, parsing and running them,
+ * measured with os_cputime. Histogram bucket i counts the durations of
+ * 2^i to 2^(i+1) - 1 ticks (bucket 0 also counts 0); the last bucket counts
+ * all longer durations.
+ *
+ * All storage is static. Counters are updated without locks, so sessions
+ * running on different tasks may occasionally lose a count.
+ */
+
+#ifndef __CLI_STATS_H__
+#define __CLI_STATS_H__
+
+#include <inttypes.h>
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+
+#define CLI_STATS_BUCKETS 				MYNEWT_VAL(CLI_STATS_BUCKETS)
+
+/* Statistics of a namespace */
+typedef struct
+{
+	uint32_t 						lookups;		// Command lines addressed to the namespace
+	uint32_t 						unknown;		// Command lines naming an unknown command
+	uint32_t 						lookup_hist[CLI_STATS_BUCKETS];	// Namespace and command lookup time
+} cli_namespace_stats_s;
+
+/* Statistics of a command */
+typedef struct
+{
+	uint32_t 						invocations;	// Command lines addressed to the command
+	uint32_t 						parse_errors;	// Command lines rejected by the parse
+	uint32_t 						cb_errors;		// Callbacks which returned an error
+	uint32_t 						parse_hist[CLI_STATS_BUCKETS];	// Parse time
+	uint32_t 						cb_hist[CLI_STATS_BUCKETS];		// Callback time
+} cli_command_stats_s;
+
+/* Returns the statistics of a namespace. Returns 0, or SYS_ENOENT if the
+ * namespace is not registered or statistics are disabled */
+int cli_stats_get_namespace(const char * nmspc_name,
+	cli_namespace_stats_s * stats);
+
+/* Returns the statistics of a command. Returns 0, or SYS_ENOENT if the
+ * command is not registered or statistics are disabled */
+int cli_stats_get_command(const char * nmspc_name, const char * cmd_name,
+	cli_command_stats_s * stats);
+
+/* Prints the statistics of every namespace and command to the output of a
+ * session */
+void cli_stats_print(const cli_ctx_s * ctx);
+
+/* Clears all statistics */
+void cli_stats_reset(void);
+
+#endif // __CLI_STATS_H__
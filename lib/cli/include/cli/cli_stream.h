@@ -0,0 +1,87 @@
+/*
+ * Streaming of bulk data to CLI commands. A command receiving a blob too
+ * large for a command line (a calibration table, a state machine recording)
+ * takes its size as an argument and opens a stream from its callback. The
+ * transport then feeds the bytes of the blob to cli_stream_feed, without
+ * splitting them into commands: they are gathered into CLI_STREAM_CHUNKS
+ * buffers of CLI_STREAM_CHUNK_SIZE bytes, and each full buffer is passed to
+ * the sink of the command. Only one stream is open at a time.
+ *
+ * The sink runs on the CLI worker event queue if one is set (see cli_job.h),
+ * so that the transport fills a buffer while the sink consumes another, or
+ * else on the task feeding the stream. When all buffers wait for the sink,
+ * cli_stream_feed accepts fewer bytes than given: the transport must hold
+ * the rest, e.g. by no longer reading its UART and letting its hardware flow
+ * control hold off the sender, and feed them again later.
+ *
+ * Sample command:
+
+	static int on_load(cli_ctx_s * ctx, char ** args)
+	{
+		return cli_stream_open(ctx->values[0].u, load_sink, load_done, NULL);
+	}
+
+ */
+
+#ifndef __CLI_STREAM_H__
+#define __CLI_STREAM_H__
+
+#include <inttypes.h>
+#include "os/os.h"
+
+/* Consumes a chunk of the stream. Every chunk but the last is
+ * CLI_STREAM_CHUNK_SIZE bytes long. Returns 0, or an error which ends the
+ * stream */
+typedef int cli_stream_sink_fn(void * arg, const uint8_t * data, uint16_t len);
+
+/* Called once the stream ends, with 0 if all its bytes were consumed, else
+ * the error of the sink, or SYS_EIO if the stream was aborted */
+typedef void cli_stream_done_fn(void * arg, int rc);
+
+/* Status of the current or last stream */
+typedef struct
+{
+	bool 							open;			// The stream is receiving or consuming data
+	uint32_t 						size;			// Number of bytes of the stream
+	uint32_t 						received;		// Number of bytes fed
+	uint32_t 						consumed;		// Number of bytes passed to the sink
+	int 							rc;				// 0, or the error which ended the stream
+} cli_stream_info_s;
+
+/**
+ * @brief Opens a stream, usually from the callback of the command receiving
+ *        it.
+ *
+ * @param size                  The number of bytes of the stream.
+ * @param sink                  Called with each chunk of the stream.
+ * @param done                  Called once the stream ends. May be NULL.
+ * @param arg                   Passed to sink and done.
+ *
+ * @return                      0, SYS_EINVAL if size is 0, or SYS_EBUSY if a
+ *                              stream is open.
+ */
+int cli_stream_open(uint32_t size, cli_stream_sink_fn * sink,
+	cli_stream_done_fn * done, void * arg);
+
+/**
+ * @brief Feeds bytes to the open stream. Bytes beyond the size of the stream
+ *        are not accepted.
+ *
+ * @param data                  The bytes.
+ * @param len                   The number of bytes.
+ *
+ * @return                      The number of bytes accepted, fewer than len
+ *                              if the chunk buffers are full; the error which
+ *                              ended the stream; or SYS_EINVAL if no stream
+ *                              is open.
+ */
+int cli_stream_feed(const uint8_t * data, uint16_t len);
+
+/* Ends the open stream, without consuming the bytes not yet passed to the
+ * sink */
+void cli_stream_abort(void);
+
+/* Returns the status of the current or last stream */
+void cli_stream_get_info(cli_stream_info_s * info);
+
+#endif // __CLI_STREAM_H__
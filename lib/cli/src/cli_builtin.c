@@ -0,0 +1,297 @@
+/*
+ * Built-in "cli" namespace of the CLI module
+ */
+
+#include <stdio.h>
+#include "cli/cli_namespace.h"
+#include "cli/cli_parse.h"
+#include "cli/cli_out.h"
+#include "cli/cli_run.h"
+#include "cli/cli_job.h"
+#include "cli/cli_stats.h"
+#include "cli/cli_complete.h"
+#include "cli/cli_stream.h"
+#include "cli/cli_limit.h"
+#include "cli/cli_builtin.h"
+
+#define NUM_ARGS_RUN 					1
+#define NUM_ARGS_JOBS 					0
+#define NUM_ARGS_STATS 					0
+#define NUM_ARGS_COMPLETE 				0
+#define NUM_ARGS_STREAM 				0
+#define NUM_ARGS_LIMIT 					0
+
+#define NUM_OPTS_RUN 					2
+#define NUM_OPTS_JOBS 					0
+#define NUM_OPTS_STATS 					1
+#define NUM_OPTS_COMPLETE 				1
+#define NUM_OPTS_STREAM 				1
+#define NUM_OPTS_LIMIT 					2
+
+#define RUN_OPT_CONTINUE 				0
+#define RUN_OPT_QUIET 					1
+
+#define STATS_OPT_RESET 				0
+
+#define COMPLETE_OPT_USAGE 				0
+
+#define STREAM_OPT_ABORT 				0
+
+#define LIMIT_OPT_RATE 					0
+#define LIMIT_OPT_BURST 				1
+
+/* Command Callbacks */
+static int on_run(cli_ctx_s * ctx, char ** args);
+static int on_jobs(cli_ctx_s * ctx, char ** args);
+static int on_stats(cli_ctx_s * ctx, char ** args);
+static int on_complete(cli_ctx_s * ctx, char ** args);
+static int on_stream(cli_ctx_s * ctx, char ** args);
+static int on_limit(cli_ctx_s * ctx, char ** args);
+
+/* Help */
+static const char cli_builtin_help_dialog[] =
+	"\nusage:\n"
+	"\tcli run [-cq] <command> [; <command> ...]\n"
+	"\t\t\t\t- Execute commands back to back\n"
+	"\t\t\t\t  -c: keep going after a command failed\n"
+	"\t\t\t\t  -q: suppress the messages of the commands\n"
+	"\tcli jobs\t\t- List the asynchronous commands\n"
+	"\tcli stats [-r]\t\t- Show the command statistics\n"
+	"\t\t\t\t  -r: clear them once shown\n"
+	"\tcli complete [-u] [<namespace> [<command>]]\n"
+	"\t\t\t\t- List the names starting with a prefix\n"
+	"\t\t\t\t  -u: show the memory used by the names\n"
+	"\tcli stream [-a]\t\t- Show the status of the data stream\n"
+	"\t\t\t\t  -a: abort it\n"
+	"\tcli limit [-r <rate>] [-b <burst>]\n"
+	"\t\t\t\t- Show the shell input limit and counters\n"
+	"\t\t\t\t  -r: limit the shell to <rate> lines/s, 0 for none\n"
+	"\t\t\t\t  -b: allow bursts of <burst> lines\n"
+	"\n";
+
+static cli_option_s cli_builtin_run_opts[NUM_OPTS_RUN] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'c', 		false, 		false, 		NULL },
+	{ 	'q', 		false, 		false, 		NULL },
+};
+
+static cli_option_s cli_builtin_stats_opts[NUM_OPTS_STATS] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'r', 		false, 		false, 		NULL },
+};
+
+static cli_option_s cli_builtin_complete_opts[NUM_OPTS_COMPLETE] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'u', 		false, 		false, 		NULL },
+};
+
+static cli_option_s cli_builtin_stream_opts[NUM_OPTS_STREAM] = {
+// 		name 		value 		has_arg 	arg_value
+	{ 	'a', 		false, 		false, 		NULL },
+};
+
+static const cli_arg_type_s cli_builtin_u16_type = {
+	CLI_ARG_T_UINT, 0, UINT16_MAX, NULL
+};
+
+static cli_option_s cli_builtin_limit_opts[NUM_OPTS_LIMIT] = {
+// 		name 		value 		has_arg 	arg_value 	arg_type
+	{ 	'r', 		false, 		true, 		NULL, 		&cli_builtin_u16_type },
+	{ 	'b', 		false, 		true, 		NULL, 		&cli_builtin_u16_type },
+};
+
+static cli_command_s cli_builtin_commands[] = {
+// 		name 		num_args 		num_options 	opt_list
+// 		cb 			help 			flags
+	{ 	"run", 		NUM_ARGS_RUN, 	NUM_OPTS_RUN, 	cli_builtin_run_opts,
+		on_run, 	NULL, 			CLI_CMD_F_RAW | CLI_CMD_F_NO_ERROR_HELP },
+	{ 	"jobs", 	NUM_ARGS_JOBS, 	NUM_OPTS_JOBS, 	NULL,
+		on_jobs, 	NULL, 			0 },
+	{ 	"stats", 	NUM_ARGS_STATS, NUM_OPTS_STATS, cli_builtin_stats_opts,
+		on_stats, 	NULL, 			0 },
+	{ 	"complete", NUM_ARGS_COMPLETE, NUM_OPTS_COMPLETE,
+		cli_builtin_complete_opts,
+		on_complete, NULL, 			CLI_CMD_F_RAW },
+	{ 	"stream", 	NUM_ARGS_STREAM, NUM_OPTS_STREAM, cli_builtin_stream_opts,
+		on_stream, 	NULL, 			0 },
+	{ 	"limit", 	NUM_ARGS_LIMIT, NUM_OPTS_LIMIT, cli_builtin_limit_opts,
+		on_limit, 	NULL, 			0 },
+	{ 	NULL, 		0, 				0, 				NULL,
+		NULL, 		NULL, 			0 },
+};
+
+/* Namespace Definition */
+static cli_namespace_s cli_builtin_namespace = {
+	.name = "cli",
+	.commands = cli_builtin_commands,
+	.help = cli_builtin_help_dialog,
+};
+
+/* Command callback implementations */
+
+static int on_run(cli_ctx_s * ctx, char ** args)
+{
+	cli_run_summary_s summary;
+	uint8_t flags = 0;
+
+	if(cli_opt_found(ctx, RUN_OPT_CONTINUE))
+	{
+		flags |= CLI_RUN_F_CONTINUE;
+	}
+	if(cli_opt_found(ctx, RUN_OPT_QUIET))
+	{
+		flags |= CLI_RUN_F_QUIET;
+	}
+
+	cli_run_argv(ctx->raw_argc, ctx->raw_argv, flags, ctx->out, &summary);
+
+	cli_printf(ctx, "run: %lu executed, %lu failed",
+		(unsigned long)summary.executed, (unsigned long)summary.failed);
+	if(summary.first_failed != 0)
+	{
+		cli_printf(ctx, ", command %lu returned %d",
+			(unsigned long)summary.first_failed, summary.rc);
+	}
+	cli_puts(ctx, "\n");
+
+	return summary.rc;
+}
+
+static int on_jobs(cli_ctx_s * ctx, char ** args)
+{
+	static const char * const states[] = { "", "queued", "running", "done" };
+	cli_job_info_s infos[MYNEWT_VAL(CLI_MAX_JOBS)];
+	int count, i;
+
+	count = cli_job_list(infos, MYNEWT_VAL(CLI_MAX_JOBS));
+	for(i = 0; i < count; i++)
+	{
+		cli_printf(ctx, "%u\t%s\t%s", infos[i].id, infos[i].name,
+			states[infos[i].state]);
+		if(infos[i].state == CLI_JOB_DONE)
+		{
+			cli_printf(ctx, "\trc=%d", infos[i].rc);
+		}
+		cli_puts(ctx, "\n");
+	}
+
+	return 0;
+}
+
+static int on_stats(cli_ctx_s * ctx, char ** args)
+{
+	cli_stats_print(ctx);
+
+	if(cli_opt_found(ctx, STATS_OPT_RESET))
+	{
+		cli_stats_reset();
+	}
+
+	return 0;
+}
+
+static void on_complete_match(const char * name, void * arg)
+{
+	cli_printf((const cli_ctx_s *)arg, "%s ", name);
+}
+
+static int on_complete(cli_ctx_s * ctx, char ** args)
+{
+	cli_complete_usage_s usage;
+	char line[64];
+	char suffix[32];
+	int count;
+
+	if(cli_opt_found(ctx, COMPLETE_OPT_USAGE))
+	{
+		cli_complete_get_usage(&usage);
+		cli_printf(ctx, "trie: %u/%u nodes of %u bytes\n", usage.nodes_used,
+			usage.nodes_total, usage.node_size);
+		if(ctx->raw_argc == 0)
+		{
+			return 0;
+		}
+	}
+
+	// The prefix of the command name is the second token
+	if(ctx->raw_argc > 2)
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	snprintf(line, sizeof(line), "%s%s%s",
+		(ctx->raw_argc > 0) ? ctx->raw_argv[0] : "",
+		(ctx->raw_argc > 1) ? " " : "",
+		(ctx->raw_argc > 1) ? ctx->raw_argv[1] : "");
+
+	count = cli_complete(line, suffix, sizeof(suffix), on_complete_match, ctx);
+	cli_printf(ctx, "\n%d match%s", count, (count == 1) ? "" : "es");
+	if(suffix[0] != '\0')
+	{
+		cli_printf(ctx, ", completes to %s%s", line, suffix);
+	}
+	cli_puts(ctx, "\n");
+
+	return 0;
+}
+
+static int on_stream(cli_ctx_s * ctx, char ** args)
+{
+	cli_stream_info_s info;
+
+	if(cli_opt_found(ctx, STREAM_OPT_ABORT))
+	{
+		cli_stream_abort();
+	}
+
+	cli_stream_get_info(&info);
+	cli_printf(ctx, "stream %s: %lu/%lu bytes received, %lu consumed, rc=%d\n",
+		info.open ? "open" : "closed", (unsigned long)info.received,
+		(unsigned long)info.size, (unsigned long)info.consumed, info.rc);
+
+	return 0;
+}
+
+static int on_limit(cli_ctx_s * ctx, char ** args)
+{
+	cli_limit_stats_s stats;
+	uint16_t rate, burst;
+
+	// Either option keeps the current value of the other
+	cli_limit_shell_get(&rate, &burst);
+	if(cli_opt_found(ctx, LIMIT_OPT_RATE))
+	{
+		rate = ctx->opt_values[LIMIT_OPT_RATE].u;
+	}
+	if(cli_opt_found(ctx, LIMIT_OPT_BURST))
+	{
+		burst = ctx->opt_values[LIMIT_OPT_BURST].u;
+	}
+
+	if(cli_opt_found(ctx, LIMIT_OPT_RATE) ||
+		cli_opt_found(ctx, LIMIT_OPT_BURST))
+	{
+		cli_limit_shell_set(rate, burst);
+		cli_limit_shell_get(&rate, &burst);
+	}
+
+	cli_limit_shell_get_stats(&stats);
+	if(rate != 0)
+	{
+		cli_printf(ctx, "limit %u lines/s, burst %u\n", rate, burst);
+	}
+	else
+	{
+		cli_puts(ctx, "no limit\n");
+	}
+	cli_printf(ctx, "%lu accepted, %lu deferred, %lu dropped, queue max %u\n",
+		(unsigned long)stats.accepted, (unsigned long)stats.deferred,
+		(unsigned long)stats.dropped, stats.queue_max);
+
+	return 0;
+}
+
+int cli_builtin_register(void)
+{
+	return cli_namespace_register(&cli_builtin_namespace);
+}
@@ -0,0 +1,358 @@
+/*
+ * Prefix matching and completion of namespace and command names
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_complete.h"
+#include "cli_priv.h"
+
+#define CLI_TRIE_NODES 					MYNEWT_VAL(CLI_TRIE_NODES)
+
+/* Node 0 stands for no node; node 1 is the root of the namespace names */
+#define CLI_TRIE_NONE 					0
+#define CLI_TRIE_NAMESPACES 			1
+
+#if CLI_TRIE_NODES < 2 || CLI_TRIE_NODES > UINT16_MAX
+#error "CLI_TRIE_NODES must be between 2 and 65535"
+#endif
+
+/* Trie node. The children of a node are linked through their siblings, in
+ * character order. Nodes are appended by registrations, which are serialized
+ * by the namespace list lock, and published by a release store of the link
+ * to them, so that lookups take no lock */
+typedef struct
+{
+	char 							c;				// Character of the edge from the parent
+	uint16_t 						child;			// First child; CLI_TRIE_NONE if none
+	uint16_t 						sibling;		// Next sibling; CLI_TRIE_NONE if none
+	uint16_t 						count;			// Number of names ending at or below the node
+	uint16_t 						value;			// Index + 1 of the name ending at the node; 0 if none
+} cli_trie_node_s;
+
+static cli_trie_node_s g_cli_trie_nodes[CLI_TRIE_NODES];
+static uint16_t g_cli_trie_num_nodes = CLI_TRIE_NAMESPACES + 1;
+
+/* Walk over the names matching a prefix. The trie of the namespace names has
+ * a NULL namespace */
+typedef struct
+{
+	const cli_namespace_s * 		namespace;		// Namespace of the command trie
+	cli_complete_fn * 				cb;				// Called for each name
+	void * 							arg;			// Passed to cb
+} cli_trie_walk_s;
+
+static uint16_t cli_trie_load(const uint16_t * link)
+{
+	return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static uint16_t cli_trie_alloc(char c)
+{
+	cli_trie_node_s * node;
+
+	// Ensure the pool has room for the new name
+	assert(g_cli_trie_num_nodes < CLI_TRIE_NODES);
+
+	node = &g_cli_trie_nodes[g_cli_trie_num_nodes];
+	memset(node, 0, sizeof(*node));
+	node->c = c;
+
+	return g_cli_trie_num_nodes++;
+}
+
+/* Returns the child of a node for a character, or CLI_TRIE_NONE */
+static uint16_t cli_trie_child(uint16_t node, char c)
+{
+	uint16_t child;
+
+	for(child = cli_trie_load(&g_cli_trie_nodes[node].child);
+		child != CLI_TRIE_NONE;
+		child = cli_trie_load(&g_cli_trie_nodes[child].sibling))
+	{
+		if(g_cli_trie_nodes[child].c >= c)
+		{
+			return (g_cli_trie_nodes[child].c == c) ? child : CLI_TRIE_NONE;
+		}
+	}
+
+	return CLI_TRIE_NONE;
+}
+
+/* Returns the node reached from root by the first len characters of prefix,
+ * or CLI_TRIE_NONE if no name starts with them */
+static uint16_t cli_trie_find(uint16_t root, const char * prefix, size_t len)
+{
+	uint16_t node = root;
+
+	while((len-- > 0) && (node != CLI_TRIE_NONE))
+	{
+		node = cli_trie_child(node, *prefix++);
+	}
+
+	return node;
+}
+
+/* Inserts a name below root. Must be called with the namespace list lock
+ * held */
+static void cli_trie_insert(uint16_t root, const char * name, uint16_t value)
+{
+	uint16_t * link;
+	uint16_t node = root;
+	uint16_t child;
+	const char * p;
+
+	for(p = name; *p != '\0'; p++)
+	{
+		link = &g_cli_trie_nodes[node].child;
+		while(((child = *link) != CLI_TRIE_NONE) &&
+			(g_cli_trie_nodes[child].c < *p))
+		{
+			link = &g_cli_trie_nodes[child].sibling;
+		}
+
+		if((child == CLI_TRIE_NONE) || (g_cli_trie_nodes[child].c != *p))
+		{
+			node = cli_trie_alloc(*p);
+			g_cli_trie_nodes[node].sibling = child;
+			__atomic_store_n(link, node, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			node = child;
+		}
+	}
+
+	__atomic_store_n(&g_cli_trie_nodes[node].value, value, __ATOMIC_RELEASE);
+
+	// Count the name along its path once it is reachable
+	for(node = root, p = name; node != CLI_TRIE_NONE;
+		node = (*p != '\0') ? cli_trie_child(node, *p++) : CLI_TRIE_NONE)
+	{
+		__atomic_fetch_add(&g_cli_trie_nodes[node].count, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/* Returns the value of the only name ending at or below a node, or 0 */
+static uint16_t cli_trie_only_value(uint16_t node)
+{
+	uint16_t value = 0;
+
+	while((node != CLI_TRIE_NONE) &&
+		((value = cli_trie_load(&g_cli_trie_nodes[node].value)) == 0))
+	{
+		node = cli_trie_load(&g_cli_trie_nodes[node].child);
+	}
+
+	return value;
+}
+
+static uint16_t cli_trie_count(uint16_t node)
+{
+	return __atomic_load_n(&g_cli_trie_nodes[node].count, __ATOMIC_RELAXED);
+}
+
+/* Calls the callback of a walk for each name ending at or below a node. The
+ * recursion is as deep as the longest name */
+static void cli_trie_list(const cli_trie_walk_s * walk, uint16_t node)
+{
+	const cli_namespace_s * namespace;
+	uint16_t value;
+	uint16_t child;
+
+	value = cli_trie_load(&g_cli_trie_nodes[node].value);
+	if(value != 0)
+	{
+		if(walk->namespace != NULL)
+		{
+			walk->cb(walk->namespace->commands[value - 1].name, walk->arg);
+		}
+		else if((namespace = cli_namespace_from_id(value - 1)) != NULL)
+		{
+			walk->cb(namespace->name, walk->arg);
+		}
+	}
+
+	for(child = cli_trie_load(&g_cli_trie_nodes[node].child);
+		child != CLI_TRIE_NONE;
+		child = cli_trie_load(&g_cli_trie_nodes[child].sibling))
+	{
+		cli_trie_list(walk, child);
+	}
+}
+
+/* Writes the characters shared by all the names below a node, from the node
+ * down to the first fork or end of name */
+static void cli_trie_common_suffix(uint16_t node, char * suffix, size_t size)
+{
+	uint16_t child;
+	size_t len = 0;
+
+	while((len + 1 < size) &&
+		(cli_trie_load(&g_cli_trie_nodes[node].value) == 0))
+	{
+		child = cli_trie_load(&g_cli_trie_nodes[node].child);
+		if((child == CLI_TRIE_NONE) ||
+			(cli_trie_load(&g_cli_trie_nodes[child].sibling) != CLI_TRIE_NONE))
+		{
+			break;
+		}
+
+		suffix[len++] = g_cli_trie_nodes[child].c;
+		node = child;
+	}
+
+	suffix[len] = '\0';
+}
+
+void cli_trie_add_commands(cli_namespace_s * namespace)
+{
+	int i;
+
+	namespace->trie_root = cli_trie_alloc('\0');
+
+	for(i = 0; i < namespace->num_commands; i++)
+	{
+		cli_trie_insert(namespace->trie_root, namespace->commands[i].name,
+			i + 1);
+	}
+}
+
+void cli_trie_add_namespace(const cli_namespace_s * namespace)
+{
+	cli_trie_insert(CLI_TRIE_NAMESPACES, namespace->name, namespace->id + 1);
+}
+
+int cli_trie_find_command(const cli_namespace_s * namespace,
+	const char * prefix, int * cmd_index)
+{
+	uint16_t node;
+	int count;
+
+	node = cli_trie_find(namespace->trie_root, prefix, strlen(prefix));
+	if(node == CLI_TRIE_NONE)
+	{
+		return 0;
+	}
+
+	count = cli_trie_count(node);
+	if(count == 1)
+	{
+		*cmd_index = cli_trie_only_value(node) - 1;
+	}
+
+	return count;
+}
+
+void cli_trie_list_commands(const cli_namespace_s * namespace,
+	const char * prefix, cli_complete_fn * cb, void * arg)
+{
+	cli_trie_walk_s walk = { namespace, cb, arg };
+	uint16_t node;
+
+	node = cli_trie_find(namespace->trie_root, prefix, strlen(prefix));
+	if(node != CLI_TRIE_NONE)
+	{
+		cli_trie_list(&walk, node);
+	}
+}
+
+static bool cli_complete_is_blank(char c)
+{
+	return (c == ' ') || (c == '\t');
+}
+
+int cli_complete(const char * line, char * suffix, size_t size,
+	cli_complete_fn * cb, void * arg)
+{
+	cli_trie_walk_s walk = { NULL, cb, arg };
+	const char * first = NULL;
+	const char * last = line;
+	size_t first_len = 0;
+	int num_tokens = 0;
+	uint16_t root = CLI_TRIE_NAMESPACES;
+	uint16_t node;
+	uint16_t value;
+	const char * p;
+
+	if((suffix != NULL) && (size > 0))
+	{
+		suffix[0] = '\0';
+	}
+
+	// Find the first token, and the last one, which is empty if the line ends
+	// with a blank
+	for(p = line; *p != '\0'; p++)
+	{
+		if(cli_complete_is_blank(*p))
+		{
+			last = p + 1;
+			continue;
+		}
+
+		if((p == line) || cli_complete_is_blank(p[-1]))
+		{
+			if(++num_tokens == 1)
+			{
+				first = p;
+			}
+		}
+
+		if(num_tokens == 1)
+		{
+			first_len = p + 1 - first;
+		}
+	}
+
+	if(*last == '\0')
+	{
+		num_tokens++;
+	}
+
+	if(num_tokens == 2)
+	{
+		// Complete a command of the namespace named by the first token
+		node = cli_trie_find(CLI_TRIE_NAMESPACES, first, first_len);
+		value = (node != CLI_TRIE_NONE) ?
+			cli_trie_load(&g_cli_trie_nodes[node].value) : 0;
+		walk.namespace = (value != 0) ? cli_namespace_from_id(value - 1) : NULL;
+		if(walk.namespace == NULL)
+		{
+			return 0;
+		}
+
+		root = walk.namespace->trie_root;
+	}
+	else if(num_tokens > 2)
+	{
+		return 0;
+	}
+
+	node = cli_trie_find(root, last, strlen(last));
+	if(node == CLI_TRIE_NONE)
+	{
+		return 0;
+	}
+
+	if((suffix != NULL) && (size > 0))
+	{
+		cli_trie_common_suffix(node, suffix, size);
+	}
+
+	if(cb != NULL)
+	{
+		cli_trie_list(&walk, node);
+	}
+
+	return cli_trie_count(node);
+}
+
+void cli_complete_get_usage(cli_complete_usage_s * usage)
+{
+	usage->nodes_used = __atomic_load_n(&g_cli_trie_num_nodes,
+		__ATOMIC_RELAXED);
+	usage->nodes_total = CLI_TRIE_NODES;
+	usage->node_size = sizeof(cli_trie_node_s);
+}
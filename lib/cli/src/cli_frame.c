@@ -0,0 +1,317 @@
+/*
+ * Execution of binary command frames
+ */
+
+#include <string.h>
+#include "defs/error.h"
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_parse.h"
+#include "cli/cli_frame.h"
+#include "cli_priv.h"
+
+/* Room for a 32-bit integer in decimal, with sign and NUL */
+#define CLI_FRAME_NUM_LEN 		12
+
+/* State of the decoding of a frame */
+typedef struct
+{
+	uint8_t * 						buf;			// Frame
+	uint16_t 						len;			// Length of the frame
+	uint16_t 						off;			// Offset of the next field
+	int 							num_fields;		// Number of fields decoded
+	int 							num_count;		// Number of entries of nums in use
+	char 							nums[CLI_FRAME_MAX_FIELDS][CLI_FRAME_NUM_LEN];	// Numeric fields as text
+	char * 							raw[CLI_FRAME_MAX_FIELDS];	// Fields of a CLI_CMD_F_RAW command
+} cli_frame_s;
+
+static uint32_t cli_frame_get_u32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Writes val in decimal to str, which has room for CLI_FRAME_NUM_LEN
+ * characters */
+static void cli_frame_format_num(char * str, uint32_t val, bool is_signed)
+{
+	char digits[CLI_FRAME_NUM_LEN];
+	int n = 0;
+
+	if(is_signed && ((int32_t)val < 0))
+	{
+		*str++ = '-';
+		val = -val;
+	}
+
+	do
+	{
+		digits[n++] = '0' + (val % 10);
+		val /= 10;
+	} while(val != 0);
+
+	while(n > 0)
+	{
+		*str++ = digits[--n];
+	}
+	*str = '\0';
+}
+
+/* Decodes the next field of a frame. Fields of typed arguments are converted
+ * straight to their type and have no text; fields of untyped arguments are
+ * passed as strings */
+static int cli_frame_get_field(cli_frame_s * frame, const cli_arg_type_s * type,
+	char ** arg, cli_value_u * value)
+{
+	uint8_t field;
+	uint8_t len;
+	uint32_t num;
+	float f;
+
+	if((frame->off >= frame->len) ||
+		(frame->num_fields == CLI_FRAME_MAX_FIELDS))
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	frame->num_fields++;
+	field = frame->buf[frame->off++];
+	switch(field)
+	{
+	case CLI_FRAME_T_STR:
+	case CLI_FRAME_T_BYTES:
+		if(frame->off >= frame->len)
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		len = frame->buf[frame->off++];
+		if(len > frame->len - frame->off)
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		*arg = (char *)&frame->buf[frame->off];
+		frame->off += len;
+
+		if(field == CLI_FRAME_T_BYTES)
+		{
+			if((type == NULL) || (type->type != CLI_ARG_T_BYTES) ||
+				!cli_parse_in_range(type, len))
+			{
+				return CLI_ERROR_BAD_ARG;
+			}
+
+			*arg = NULL;
+			value->bytes.data = &frame->buf[frame->off - len];
+			value->bytes.len = len;
+			return CLI_ERROR_NONE;
+		}
+
+		// Strings carry their terminating NUL so that they are passed in place
+		if((len == 0) || ((*arg)[len - 1] != '\0'))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		if(type == NULL)
+		{
+			value->str = *arg;
+			return CLI_ERROR_NONE;
+		}
+
+		return cli_parse_value(type, *arg, value);
+
+	case CLI_FRAME_T_INT:
+	case CLI_FRAME_T_UINT:
+	case CLI_FRAME_T_FLOAT:
+		if(frame->len - frame->off < 4)
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		num = cli_frame_get_u32(&frame->buf[frame->off]);
+		frame->off += 4;
+
+		if(field == CLI_FRAME_T_FLOAT)
+		{
+			if(type == NULL)
+			{
+				return CLI_ERROR_BAD_ARG;
+			}
+
+			*arg = NULL;
+			memcpy(&f, &num, sizeof(f));
+			return cli_parse_float_value(type, f, value);
+		}
+
+		if(type != NULL)
+		{
+			*arg = NULL;
+			return cli_parse_num_value(type, (field == CLI_FRAME_T_INT) ?
+				(int64_t)(int32_t)num : (int64_t)num, value);
+		}
+
+		*arg = frame->nums[frame->num_count++];
+		cli_frame_format_num(*arg, num, field == CLI_FRAME_T_INT);
+		value->str = *arg;
+		return CLI_ERROR_NONE;
+
+	default:
+		return CLI_ERROR_BAD_ARG;
+	}
+}
+
+/* Decodes the fields following the options of a CLI_CMD_F_RAW command. As
+ * with a text line, they are left untyped, and there may be more of them than
+ * the command has arguments */
+static int cli_frame_decode_raw(cli_ctx_s * ctx, cli_frame_s * frame)
+{
+	const cli_command_s * cmd = ctx->cmd;
+	cli_value_u value;
+	int count = 0;
+	int i, rc;
+
+	while(frame->off < frame->len)
+	{
+		rc = cli_frame_get_field(frame, NULL, &frame->raw[count], &value);
+		if(rc != CLI_ERROR_NONE)
+		{
+			return rc;
+		}
+		count++;
+	}
+
+	if(count < cmd->num_args)
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	for(i = 0; i < cmd->num_args; i++)
+	{
+		ctx->args[i] = frame->raw[i];
+		ctx->values[i].str = frame->raw[i];
+	}
+
+	ctx->raw_argc = count;
+	ctx->raw_argv = frame->raw;
+
+	return CLI_ERROR_NONE;
+}
+
+/* Decodes the options and arguments of a frame into a parse context */
+static int cli_frame_decode(cli_ctx_s * ctx, cli_frame_s * frame)
+{
+	const cli_command_s * cmd = ctx->cmd;
+	uint32_t arg_mask;
+	int i, rc;
+
+	ctx->opt_mask = cli_frame_get_u32(&frame->buf[2]);
+	if((cmd->num_options < 32) &&
+		((ctx->opt_mask >> cmd->num_options) != 0))
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	// Option arguments come first, in opt_list order
+	arg_mask = ctx->opt_mask & ctx->opt_map->has_arg;
+	for(i = 0; i < cmd->num_options; i++)
+	{
+		ctx->opt_args[i] = NULL;
+		if(arg_mask & ((uint32_t)1 << i))
+		{
+			rc = cli_frame_get_field(frame, cmd->opt_list[i].arg_type,
+				&ctx->opt_args[i], &ctx->opt_values[i]);
+			if(rc != CLI_ERROR_NONE)
+			{
+				return rc;
+			}
+		}
+	}
+
+	if(cmd->flags & CLI_CMD_F_RAW)
+	{
+		return cli_frame_decode_raw(ctx, frame);
+	}
+
+	for(i = 0; i < cmd->num_args; i++)
+	{
+		rc = cli_frame_get_field(frame,
+			(cmd->arg_types != NULL) ? &cmd->arg_types[i] : NULL,
+			&ctx->args[i], &ctx->values[i]);
+		if(rc != CLI_ERROR_NONE)
+		{
+			return rc;
+		}
+	}
+
+	if(frame->off != frame->len)
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	ctx->raw_argc = 0;
+	ctx->raw_argv = NULL;
+
+	return CLI_ERROR_NONE;
+}
+
+int cli_frame_execute(cli_ctx_s * ctx, uint8_t * buf, uint16_t len)
+{
+	const cli_namespace_s * namespace;
+	const cli_command_s * cmd;
+	cli_frame_s frame;
+	uint32_t start = CLI_STATS_NOW();
+	uint32_t now;
+	int rc;
+
+	if(len < CLI_FRAME_HDR_LEN)
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	namespace = cli_namespace_from_id(buf[0]);
+	if(namespace == NULL)
+	{
+		cli_stats_lookup(NULL, -1, 0);
+		return SYS_ENOENT;
+	}
+
+	now = CLI_STATS_NOW();
+	cli_stats_lookup(namespace,
+		(buf[1] < namespace->num_commands) ? buf[1] : -1, now - start);
+	start = now;
+
+	if(buf[1] >= namespace->num_commands)
+	{
+		return SYS_ENOENT;
+	}
+
+	cmd = &namespace->commands[buf[1]];
+	ctx->cmd = cmd;
+	ctx->opt_map = cli_command_get_opt_map(namespace, buf[1]);
+
+	frame.buf = buf;
+	frame.len = len;
+	frame.off = CLI_FRAME_HDR_LEN;
+	frame.num_fields = 0;
+	frame.num_count = 0;
+
+	rc = cli_frame_decode(ctx, &frame);
+
+	now = CLI_STATS_NOW();
+	cli_stats_parse(namespace, buf[1], rc, now - start);
+	start = now;
+
+	if((rc == CLI_ERROR_NONE) && (cmd->cb != NULL))
+	{
+		rc = cmd->cb(ctx, ctx->args);
+		cli_stats_callback(namespace, buf[1], rc, CLI_STATS_NOW() - start);
+		cli_flush(ctx);
+	}
+
+	// The raw fields are gone with the frame state
+	ctx->raw_argc = 0;
+	ctx->raw_argv = NULL;
+
+	return rc;
+}
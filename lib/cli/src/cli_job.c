@@ -0,0 +1,237 @@
+/*
+ * Asynchronous execution of CLI commands on a worker event queue
+ */
+
+#include <string.h>
+#include <stdarg.h>
+#include "defs/error.h"
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_out.h"
+#include "cli/cli_job.h"
+#include "cli_priv.h"
+
+static struct os_eventq * g_cli_job_evq;
+static cli_job_s g_cli_jobs[MYNEWT_VAL(CLI_MAX_JOBS)];
+static uint16_t g_cli_job_last_id;
+
+/* Runs a job on the worker event queue */
+static void cli_job_run(struct os_event * ev)
+{
+	cli_job_s * job = (cli_job_s *)ev->ev_arg;
+	const cli_command_s * cmd = job->ctx.cmd;
+	uint32_t start;
+	os_sr_t sr;
+	int rc = 0;
+
+	job->state = CLI_JOB_RUNNING;
+
+	if(cmd->cb != NULL)
+	{
+		start = CLI_STATS_NOW();
+		rc = cmd->cb(&job->ctx, job->ctx.args);
+		cli_stats_callback(job->namespace, job->cmd_index, rc,
+			CLI_STATS_NOW() - start);
+	}
+
+	cli_printf(&job->ctx, "[job %u] %s done, rc=%d\n", job->id, cmd->name,
+		rc);
+	cli_flush(&job->ctx);
+
+	OS_ENTER_CRITICAL(sr);
+	job->rc = rc;
+	job->state = CLI_JOB_DONE;
+	OS_EXIT_CRITICAL(sr);
+}
+
+static void cli_job_get_info_locked(const cli_job_s * job,
+	cli_job_info_s * info)
+{
+	info->id = job->id;
+	info->state = job->state;
+	info->rc = job->rc;
+	info->name = job->ctx.cmd->name;
+}
+
+bool cli_job_enabled(void)
+{
+	return g_cli_job_evq != NULL;
+}
+
+cli_job_s * cli_job_alloc(const cli_ctx_s * ctx, int argc, char ** argv)
+{
+	cli_job_s * job = NULL;
+	os_sr_t sr;
+	int i;
+
+	if(argc > CLI_MAX_TOKENS)
+	{
+		return NULL;
+	}
+
+	// Take a free slot, or else the slot of the oldest completed job
+	OS_ENTER_CRITICAL(sr);
+	for(i = 0; i < MYNEWT_VAL(CLI_MAX_JOBS); i++)
+	{
+		if(g_cli_jobs[i].state == 0)
+		{
+			job = &g_cli_jobs[i];
+			break;
+		}
+
+		if((g_cli_jobs[i].state == CLI_JOB_DONE) && ((job == NULL) ||
+			((int16_t)(g_cli_jobs[i].id - job->id) < 0)))
+		{
+			job = &g_cli_jobs[i];
+		}
+	}
+
+	if(job != NULL)
+	{
+		job->state = CLI_JOB_QUEUED;
+		job->id = 0;
+	}
+	OS_EXIT_CRITICAL(sr);
+
+	if(job == NULL)
+	{
+		return NULL;
+	}
+
+	if(cli_copy_tokens(job->line, sizeof(job->line), job->argv, argc,
+		argv) != 0)
+	{
+		cli_job_free(job);
+		return NULL;
+	}
+
+	job->argc = argc;
+	job->out.buf = job->out_buf;
+	job->out.size = sizeof(job->out_buf);
+	job->out.len = 0;
+	cli_ctx_init(&job->ctx, ctx->flags, &job->out);
+
+	return job;
+}
+
+void cli_job_free(cli_job_s * job)
+{
+	job->state = 0;
+}
+
+void cli_job_start(cli_ctx_s * ctx, cli_job_s * job)
+{
+	os_sr_t sr;
+
+	OS_ENTER_CRITICAL(sr);
+	if(++g_cli_job_last_id == 0)
+	{
+		g_cli_job_last_id++;
+	}
+	job->id = g_cli_job_last_id;
+	OS_EXIT_CRITICAL(sr);
+
+	job->ctx.job_id = job->id;
+	job->rc = 0;
+	ctx->job_id = job->id;
+
+	cli_printf(ctx, "[job %u] %s started\n", job->id, job->ctx.cmd->name);
+
+	memset(&job->ev, 0, sizeof(job->ev));
+	job->ev.ev_cb = cli_job_run;
+	job->ev.ev_arg = job;
+	os_eventq_put(g_cli_job_evq, &job->ev);
+}
+
+int cli_copy_tokens(char * line, size_t size, char ** dst, int argc,
+	char ** argv)
+{
+	size_t len, off = 0;
+	int i;
+
+	if(argc > CLI_MAX_TOKENS)
+	{
+		return SYS_ENOMEM;
+	}
+
+	for(i = 0; i < argc; i++)
+	{
+		len = strlen(argv[i]) + 1;
+		if(off + len > size)
+		{
+			return SYS_ENOMEM;
+		}
+
+		memcpy(&line[off], argv[i], len);
+		dst[i] = &line[off];
+		off += len;
+	}
+
+	return 0;
+}
+
+void cli_job_post(struct os_event * ev)
+{
+	os_eventq_put(g_cli_job_evq, ev);
+}
+
+void cli_job_init(struct os_eventq * evq)
+{
+	g_cli_job_evq = evq;
+}
+
+int cli_job_get_info(uint16_t id, cli_job_info_s * info)
+{
+	int rc = SYS_ENOENT;
+	os_sr_t sr;
+	int i;
+
+	OS_ENTER_CRITICAL(sr);
+	for(i = 0; i < MYNEWT_VAL(CLI_MAX_JOBS); i++)
+	{
+		if((g_cli_jobs[i].state != 0) && (g_cli_jobs[i].id == id) &&
+			(id != 0))
+		{
+			cli_job_get_info_locked(&g_cli_jobs[i], info);
+			rc = 0;
+			break;
+		}
+	}
+	OS_EXIT_CRITICAL(sr);
+
+	return rc;
+}
+
+int cli_job_list(cli_job_info_s * infos, int max)
+{
+	os_sr_t sr;
+	int count = 0;
+	int i;
+
+	OS_ENTER_CRITICAL(sr);
+	for(i = 0; (i < MYNEWT_VAL(CLI_MAX_JOBS)) && (count < max); i++)
+	{
+		// Jobs still being parsed have no id yet
+		if((g_cli_jobs[i].state != 0) && (g_cli_jobs[i].id != 0))
+		{
+			cli_job_get_info_locked(&g_cli_jobs[i], &infos[count++]);
+		}
+	}
+	OS_EXIT_CRITICAL(sr);
+
+	return count;
+}
+
+void cli_job_printf(const cli_ctx_s * ctx, const char * fmt, ...)
+{
+	va_list ap;
+
+	if(ctx->job_id != 0)
+	{
+		cli_printf(ctx, "[job %u] ", ctx->job_id);
+	}
+
+	va_start(ap, fmt);
+	cli_vprintf(ctx, fmt, ap);
+	va_end(ap);
+}
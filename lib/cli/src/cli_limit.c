@@ -0,0 +1,250 @@
+/*
+ * Input rate limiting of the CLI sessions
+ */
+
+#include <string.h>
+#include "defs/error.h"
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_out.h"
+#include "cli/cli_limit.h"
+#include "cli_priv.h"
+
+#define CLI_INPUT_QUEUE_LEN 			MYNEWT_VAL(CLI_INPUT_QUEUE_LEN)
+
+/* Line waiting in the input queue of the shell session */
+typedef struct
+{
+	int 							argc;			// Number of tokens in argv
+	char * 							argv[CLI_MAX_TOKENS];	// Tokens, in line
+	char 							line[MYNEWT_VAL(CLI_JOB_LINE_SIZE)];
+} cli_input_s;
+
+/* Rate limit and input queue of the shell session. The shell task appends
+ * lines at head + count and the callout runs them from head; they hand lines
+ * over by updating head and count with interrupts disabled. The callout has
+ * its own output buffer, as it may run while the shell task writes to the
+ * shell's */
+typedef struct
+{
+	bool 							started;		// The callout and the bucket are set up
+	cli_limit_s 					limit;			// Token bucket
+	cli_limit_stats_s 				stats;			// Counters
+	struct os_callout 				callout;		// Runs the queued lines once tokens come back
+	cli_out_s 						out;			// Output buffer of the queued lines
+	char 							out_buf[MYNEWT_VAL(CLI_OUTPUT_BUF_SIZE)];
+	uint8_t 						head;			// Oldest queued line
+	uint8_t 						count;			// Number of queued lines
+	cli_input_s 					queue[CLI_INPUT_QUEUE_LEN];
+} cli_limit_shell_s;
+
+static cli_limit_shell_s g_cli_limit_shell;
+
+/* Adds the tokens earned since the last refill */
+static void cli_limit_refill(cli_limit_s * limit)
+{
+	os_time_t now = os_time_get();
+	uint32_t full = (uint32_t)limit->burst * OS_TICKS_PER_SEC;
+	uint64_t tokens;
+
+	tokens = limit->tokens + (uint64_t)(uint32_t)(now - limit->last) *
+		limit->rate;
+	limit->tokens = (tokens < full) ? tokens : full;
+	limit->last = now;
+}
+
+void cli_limit_init(cli_limit_s * limit, uint16_t rate, uint16_t burst)
+{
+	limit->rate = rate;
+	limit->burst = (burst != 0) ? burst : 1;
+	limit->tokens = (uint32_t)limit->burst * OS_TICKS_PER_SEC;
+	limit->last = os_time_get();
+}
+
+bool cli_limit_take(cli_limit_s * limit)
+{
+	if(limit->rate == 0)
+	{
+		return true;
+	}
+
+	cli_limit_refill(limit);
+	if(limit->tokens < OS_TICKS_PER_SEC)
+	{
+		return false;
+	}
+
+	limit->tokens -= OS_TICKS_PER_SEC;
+
+	return true;
+}
+
+os_time_t cli_limit_delay(cli_limit_s * limit)
+{
+	if(limit->rate == 0)
+	{
+		return 0;
+	}
+
+	cli_limit_refill(limit);
+	if(limit->tokens >= OS_TICKS_PER_SEC)
+	{
+		return 0;
+	}
+
+	return (OS_TICKS_PER_SEC - limit->tokens + limit->rate - 1) / limit->rate;
+}
+
+/* Runs the queued lines of the shell session while it has tokens */
+static void cli_limit_shell_drain(struct os_event * ev)
+{
+	cli_limit_shell_s * shell = (cli_limit_shell_s *)ev->ev_arg;
+	cli_input_s * input;
+	cli_ctx_s ctx;
+	os_time_t delay = 0;
+	os_sr_t sr;
+	bool run;
+
+	for(;;)
+	{
+		OS_ENTER_CRITICAL(sr);
+		run = (shell->count != 0) && cli_limit_take(&shell->limit);
+		if(!run && (shell->count != 0))
+		{
+			delay = cli_limit_delay(&shell->limit);
+		}
+		OS_EXIT_CRITICAL(sr);
+
+		if(!run)
+		{
+			break;
+		}
+
+		input = &shell->queue[shell->head];
+		cli_ctx_init(&ctx, 0, &shell->out);
+		cli_namespace_execute(&ctx, input->argc, input->argv);
+
+		OS_ENTER_CRITICAL(sr);
+		shell->head = (shell->head + 1) % CLI_INPUT_QUEUE_LEN;
+		shell->count--;
+		OS_EXIT_CRITICAL(sr);
+	}
+
+	if(shell->count != 0)
+	{
+		os_callout_reset(&shell->callout, delay);
+	}
+}
+
+static void cli_limit_shell_start(cli_limit_shell_s * shell, uint16_t rate,
+	uint16_t burst)
+{
+	os_sr_t sr;
+
+	if(!shell->started)
+	{
+		os_callout_init(&shell->callout, os_eventq_dflt_get(),
+			cli_limit_shell_drain, shell);
+		shell->out.buf = shell->out_buf;
+		shell->out.size = sizeof(shell->out_buf);
+		shell->out.len = 0;
+		shell->started = true;
+	}
+
+	OS_ENTER_CRITICAL(sr);
+	cli_limit_init(&shell->limit, rate, burst);
+	OS_EXIT_CRITICAL(sr);
+}
+
+int cli_limit_shell_rx(cli_ctx_s * ctx, int argc, char ** argv)
+{
+	cli_limit_shell_s * shell = &g_cli_limit_shell;
+	cli_input_s * input;
+	os_sr_t sr;
+	bool run;
+
+	if(!shell->started)
+	{
+		cli_limit_shell_start(shell, MYNEWT_VAL(CLI_RATE_LIMIT),
+			MYNEWT_VAL(CLI_RATE_BURST));
+	}
+
+	// Lines queued earlier run first
+	OS_ENTER_CRITICAL(sr);
+	run = (shell->count == 0) && cli_limit_take(&shell->limit);
+	OS_EXIT_CRITICAL(sr);
+
+	if(run)
+	{
+		shell->stats.accepted++;
+		return cli_namespace_execute(ctx, argc, argv);
+	}
+
+	// Only the shell task appends lines, so the free slot stays free
+	input = &shell->queue[(shell->head + shell->count) % CLI_INPUT_QUEUE_LEN];
+	if((shell->count == CLI_INPUT_QUEUE_LEN) ||
+		(cli_copy_tokens(input->line, sizeof(input->line), input->argv, argc,
+			argv) != 0))
+	{
+		shell->stats.dropped++;
+		cli_printf(ctx, "overflow: %s%s%s dropped\n", argv[0],
+			(argc > 1) ? " " : "", (argc > 1) ? argv[1] : "");
+		cli_flush(ctx);
+		return SYS_ENOMEM;
+	}
+
+	input->argc = argc;
+
+	OS_ENTER_CRITICAL(sr);
+	shell->count++;
+	if(shell->count > shell->stats.queue_max)
+	{
+		shell->stats.queue_max = shell->count;
+	}
+	OS_EXIT_CRITICAL(sr);
+
+	shell->stats.deferred++;
+	cli_printf(ctx, "busy: %s%s%s queued\n", argv[0], (argc > 1) ? " " : "",
+		(argc > 1) ? argv[1] : "");
+	cli_flush(ctx);
+
+	if(!os_callout_queued(&shell->callout))
+	{
+		os_callout_reset(&shell->callout, cli_limit_delay(&shell->limit));
+	}
+
+	return 0;
+}
+
+void cli_limit_shell_set(uint16_t rate, uint16_t burst)
+{
+	cli_limit_shell_start(&g_cli_limit_shell, rate, burst);
+}
+
+void cli_limit_shell_get(uint16_t * rate, uint16_t * burst)
+{
+	cli_limit_shell_s * shell = &g_cli_limit_shell;
+	os_sr_t sr;
+
+	if(!shell->started)
+	{
+		*rate = MYNEWT_VAL(CLI_RATE_LIMIT);
+		*burst = (MYNEWT_VAL(CLI_RATE_BURST) != 0) ?
+			MYNEWT_VAL(CLI_RATE_BURST) : 1;
+		return;
+	}
+
+	OS_ENTER_CRITICAL(sr);
+	*rate = shell->limit.rate;
+	*burst = shell->limit.burst;
+	OS_EXIT_CRITICAL(sr);
+}
+
+void cli_limit_shell_get_stats(cli_limit_stats_s * stats)
+{
+	os_sr_t sr;
+
+	OS_ENTER_CRITICAL(sr);
+	*stats = g_cli_limit_shell.stats;
+	OS_EXIT_CRITICAL(sr);
+}
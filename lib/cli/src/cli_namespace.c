@@ -75,13 +75,55 @@ static cli_namespace_s test_namespace = {
 
 #include "cli/cli_namespace.h"
 #include "cli/cli_parse.h"
+#include "cli/cli_limit.h"
+#include "cli_priv.h"
+
+#define CLI_NAMESPACE_INDEX_SIZE    MYNEWT_VAL(CLI_NAMESPACE_INDEX_SIZE)
+#define CLI_COMMAND_INDEX_SIZE      MYNEWT_VAL(CLI_COMMAND_INDEX_SIZE)
+
+#if (CLI_NAMESPACE_INDEX_SIZE & (CLI_NAMESPACE_INDEX_SIZE - 1)) != 0
+#error "CLI_NAMESPACE_INDEX_SIZE must be a power of two"
+#endif
+
+#if CLI_NAMESPACE_INDEX_SIZE > 256
+#error "CLI_NAMESPACE_INDEX_SIZE cannot exceed 256, namespace ids are 8 bits"
+#endif
 
 static struct os_mutex g_cli_namespace_list_lock;
 
-SLIST_HEAD(, cli_namespace_s) g_cli_namespace_list;
+/* Open-addressing hash table of the registered namespaces.
+ *
+ * The namespace index and the id table are append-only: registrations are
+ * serialized by the namespace list lock, and fully build a namespace and its
+ * command index before publishing it with a single release store, of its
+ * index slot and then of the namespace count. Lookups take no lock; their
+ * acquire loads see either an empty slot or a complete namespace. A lookup
+ * racing a registration may miss the namespace being registered, as if it
+ * had run just before. */
+static cli_namespace_s * g_cli_namespace_index[CLI_NAMESPACE_INDEX_SIZE];
+static int g_cli_num_namespaces;
+
+/* Registered namespaces, by id. Entries below g_cli_num_namespaces are
+ * published */
+static cli_namespace_s * g_cli_namespace_by_id[CLI_NAMESPACE_INDEX_SIZE - 1];
+
+/* Index entry of a registered command */
+typedef struct
+{
+    uint32_t            hash;       // Hash of the command name
+    cli_option_map_s    opt_map;    // Compiled option list
+} cli_command_index_s;
+
+/* Index entries of every registered command, in command list order, one block
+ * per namespace starting at cli_namespace_s.cmd_base */
+static cli_command_index_s g_cli_command_index[MYNEWT_VAL(CLI_MAX_COMMANDS)];
+static int g_cli_num_commands;
 
-static cli_option_s g_cmd_options[MYNEWT_VAL(CLI_MAX_NUM_OPTIONS)];
-static char * g_cmd_args[MYNEWT_VAL(CLI_MAX_NUM_ARGS)];
+/* Open-addressing hash tables of the commands, one block per namespace
+ * starting at cli_namespace_s.slot_base. Each slot holds the command list
+ * index + 1, or 0 if it is empty */
+static uint16_t g_cli_command_slots[CLI_COMMAND_INDEX_SIZE];
+static int g_cli_num_slots;
 
 // #if MYNEWT_VAL(CLI_DEBUG_ENABLE)
 // static void print_command_struct(cli_command_s * cmd);
@@ -123,37 +165,42 @@ static int cli_namespace_list_unlock(void)
     return 0;
 }
 
-/** Finds the namespace invoked at the shell */
-static int cli_namespace_find(const char * nmspc_name, cli_namespace_s ** output)
+/** FNV-1a hash of a namespace or command name */
+static uint32_t cli_hash(const char * name)
 {
-    cli_namespace_s * namespace = NULL;
-    int rc;
+    uint32_t hash = 2166136261UL;
 
-    rc = cli_namespace_list_lock();
-    if(rc != 0)
+    while(*name != '\0')
     {
-        return rc;
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619UL;
     }
 
-    // Cycle through the list of registered namespaces to determine which
-    // namespace was invoked at the command line
-    SLIST_FOREACH(namespace, &g_cli_namespace_list, next)
+    return hash;
+}
+
+/** Finds the namespace invoked at the shell. Takes no lock */
+static int cli_namespace_find(const char * nmspc_name, cli_namespace_s ** output)
+{
+    cli_namespace_s * namespace = NULL;
+    cli_namespace_s * entry;
+    uint32_t hash = cli_hash(nmspc_name);
+    uint32_t slot;
+
+    // Probe the namespace index from the slot selected by the hash. The name
+    // is only compared once the hashes match
+    for(slot = hash & (CLI_NAMESPACE_INDEX_SIZE - 1);
+        (entry = __atomic_load_n(&g_cli_namespace_index[slot],
+            __ATOMIC_ACQUIRE)) != NULL;
+        slot = (slot + 1) & (CLI_NAMESPACE_INDEX_SIZE - 1))
     {
-        if (namespace->name != NULL)
+        if((entry->hash == hash) && !strcmp(entry->name, nmspc_name))
         {
-            if (!strcmp(namespace->name, nmspc_name))
-            {
-                break;
-            }
+            namespace = entry;
+            break;
         }
     }
 
-    rc = cli_namespace_list_unlock();
-    if(rc != 0)
-    {
-        return rc;
-    }
-
     if(output != NULL)
     {
         *output = namespace;
@@ -168,13 +215,22 @@ static int cli_namespace_find(const char * nmspc_name, cli_namespace_s ** output
 }
 
 /** Determines which command was invoked at the command line */
-static int cli_command_find(const cli_command_s * cmds, char * arg, int * cmd_index)
+static int cli_command_find(const cli_namespace_s * namespace, const char * arg,
+    int * cmd_index)
 {
+    uint32_t hash = cli_hash(arg);
+    uint32_t slot;
     int i;
 
-    for(i = 0; cmds[i].name != NULL; i++)
+    // The command index of a namespace is immutable once registered
+    for(slot = hash & namespace->slot_mask;
+        g_cli_command_slots[namespace->slot_base + slot] != 0;
+        slot = (slot + 1) & namespace->slot_mask)
     {
-        if(!strcmp(arg, cmds[i].name))
+        i = g_cli_command_slots[namespace->slot_base + slot] - 1;
+
+        if((g_cli_command_index[namespace->cmd_base + i].hash == hash) &&
+           !strcmp(arg, namespace->commands[i].name))
         {
             *cmd_index = i;
             return 0;
@@ -184,56 +240,167 @@ static int cli_command_find(const cli_command_s * cmds, char * arg, int * cmd_in
     return 1;
 }
 
+/** Builds the command index of a namespace. Must be called with the namespace
+ *  list lock held */
+static void cli_command_index_build(cli_namespace_s * namespace)
+{
+    cli_command_index_s * entry;
+    uint32_t num_slots = 1;
+    uint32_t slot;
+    int i, rc;
+
+    // Keep the load factor of the command table at or below one half
+    while(num_slots < 2 * (uint32_t)namespace->num_commands)
+    {
+        num_slots <<= 1;
+    }
+
+    // Ensure the index has room for the new namespace commands
+    assert(g_cli_num_commands + namespace->num_commands <=
+        MYNEWT_VAL(CLI_MAX_COMMANDS));
+    assert(g_cli_num_slots + num_slots <= CLI_COMMAND_INDEX_SIZE);
+
+    namespace->cmd_base = g_cli_num_commands;
+    namespace->slot_base = g_cli_num_slots;
+    namespace->slot_mask = num_slots - 1;
+    g_cli_num_commands += namespace->num_commands;
+    g_cli_num_slots += num_slots;
+
+    for(i = 0; i < namespace->num_commands; i++)
+    {
+        entry = &g_cli_command_index[namespace->cmd_base + i];
+        entry->hash = cli_hash(namespace->commands[i].name);
+
+        // Ensure the option names are unique ASCII characters
+        rc = cli_parse_compile_options(&namespace->commands[i],
+            &entry->opt_map);
+        assert(rc == CLI_ERROR_NONE);
+
+        slot = entry->hash & namespace->slot_mask;
+        while(g_cli_command_slots[namespace->slot_base + slot] != 0)
+        {
+            slot = (slot + 1) & namespace->slot_mask;
+        }
+
+        g_cli_command_slots[namespace->slot_base + slot] = i + 1;
+    }
+}
+
+/** Returns the namespace registered with the given id, or NULL. Takes no
+ *  lock */
+const cli_namespace_s * cli_namespace_from_id(uint8_t id)
+{
+    if(id >= __atomic_load_n(&g_cli_num_namespaces, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    return g_cli_namespace_by_id[id];
+}
+
+/** Returns the compiled option list of a registered command */
+const cli_option_map_s * cli_command_get_opt_map(
+    const cli_namespace_s * namespace, int cmd_index)
+{
+    return &g_cli_command_index[namespace->cmd_base + cmd_index].opt_map;
+}
+
+int cli_namespace_get_ids(const char * nmspc_name, const char * cmd_name,
+    uint8_t * nmspc_id, uint8_t * cmd_id)
+{
+    cli_namespace_s * namespace;
+    int cmd_index;
+    int rc;
+
+    rc = cli_namespace_find(nmspc_name, &namespace);
+    if(rc != 0)
+    {
+        return rc;
+    }
+
+    // Binary frames reach the first 256 commands of a namespace
+    if((cli_command_find(namespace, cmd_name, &cmd_index) != 0) ||
+       (cmd_index > UINT8_MAX))
+    {
+        return SYS_ENOENT;
+    }
+
+    *nmspc_id = namespace->id;
+    *cmd_id = cmd_index;
+
+    return 0;
+}
+
 /**
  * Prints help for an individual command, if enabled.
  */
-static void cli_command_print_help(const cli_command_s *cmd)
+static void cli_command_print_help(const cli_ctx_s *ctx,
+    const cli_command_s *cmd)
 {
-#if MYNEWT_VAL(CLI_HELP_ENABLE)
     if (cmd->help != NULL)
     {
-        console_printf(cmd->help);
+        CLI_HELP_PUTS(ctx, cmd->help);
     }
     else
     {
-        console_printf("%s - help not available\n", cmd->name);
+        CLI_HELP_PRINTF(ctx, "%s - help not available\n", cmd->name);
     }
-#endif
 }
 
 /**
  * Prints help for a command namespace, if enabled.
  */
-static void cli_namespace_print_help(const cli_namespace_s *namespace)
+static void cli_namespace_print_help(const cli_ctx_s *ctx,
+    const cli_namespace_s *namespace)
 {
-#if MYNEWT_VAL(CLI_HELP_ENABLE)
     if (namespace->help != NULL)
     {
-        console_printf(namespace->help);
+        CLI_HELP_PUTS(ctx, namespace->help);
     }
     else
     {
-        console_printf("%s - help not available\n", namespace->name);
+        CLI_HELP_PRINTF(ctx, "%s - help not available\n", namespace->name);
     }
-#endif
 }
 
-/** Callback called when the Shell encounters any namespace registered through
- *  the cmd_namespace module. Parses the command line with respect to the given
- *  namespace command. If the command was entered properly, execution is
- *  directed to the command's specific callback.
+/** Prints a command matching an ambiguous prefix */
+static void cli_command_print_candidate(const char * name, void * arg)
+{
+    cli_printf((const cli_ctx_s *)arg, " %s", name);
+}
+
+/** Output buffer of the shell session */
+static char g_cli_shell_out_buf[MYNEWT_VAL(CLI_OUTPUT_BUF_SIZE)];
+static cli_out_s g_cli_shell_out = {
+    .buf = g_cli_shell_out_buf,
+    .size = sizeof(g_cli_shell_out_buf),
+};
+
+/** Executes a command line on behalf of a session. Parses the command line
+ *  with respect to the given namespace command into the caller's context. If
+ *  the command was entered properly, execution is directed to the command's
+ *  specific callback.
  */
-static int cli_namespace_on_shell_rx(int argc, char ** argv)
+static int cli_namespace_dispatch(cli_ctx_s * ctx, int argc, char ** argv)
 {
     cli_namespace_s * namespace;
-    cli_command_s command;
-    int rc, i;
+    const cli_command_s * command;
+    cli_ctx_s * parse_ctx = ctx;
+    cli_job_s * job = NULL;
+    char ** parse_argv = &argv[2];
+    int parse_argc = argc - 2;
+    uint32_t start = CLI_STATS_NOW();
+    uint32_t now;
+    int rc, matches;
     int cmd_index = 0xFFFF;
 
+    ctx->job_id = 0;
+
     // Find the namespace being invoked
     rc = cli_namespace_find(argv[0], &namespace);
     if(rc != 0)
     {
+        cli_stats_lookup(NULL, -1, 0);
         return rc;
     }
 
@@ -241,79 +408,118 @@ static int cli_namespace_on_shell_rx(int argc, char ** argv)
     // command line
     if(argc == 1)
     {
-        #if MYNEWT_VAL(CLI_HELP_ENABLE)
-        console_printf("No command given\n");
-        #endif
+        CLI_HELP_PRINTF(ctx, "No command given\n");
 
-        cli_namespace_print_help(namespace);
+        cli_namespace_print_help(ctx, namespace);
         return 1;
     }
 
     // Print help text if requested by user.
     if (cli_parse_arg_is_help(argv[1]))
     {
-        cli_namespace_print_help(namespace);
+        cli_namespace_print_help(ctx, namespace);
         return 0;
     }
 
-    // Find the command being invoked
-    rc = cli_command_find(namespace->commands, argv[1], &cmd_index);
+    // Find the command being invoked, by its name or else by a prefix of its
+    // name that no other command shares
+    rc = cli_command_find(namespace, argv[1], &cmd_index);
+    matches = 1;
     if(rc != 0)
     {
-        #if MYNEWT_VAL(CLI_HELP_ENABLE)
-        console_printf("Command %s not found\n", argv[1]);
-        #endif
+        matches = cli_trie_find_command(namespace, argv[1], &cmd_index);
+        rc = (matches == 1) ? 0 : 1;
+    }
+
+    now = CLI_STATS_NOW();
+    cli_stats_lookup(namespace, (rc == 0) ? cmd_index : -1, now - start);
+    start = now;
 
-        cli_namespace_print_help(namespace);
+    // The candidates are the answer to the line, so they are printed even
+    // without help text
+    if(matches > 1)
+    {
+        cli_printf(ctx, "Command %s is ambiguous:", argv[1]);
+        cli_trie_list_commands(namespace, argv[1],
+            cli_command_print_candidate, ctx);
+        cli_puts(ctx, "\n");
         return rc;
     }
+    else if(rc != 0)
+    {
+        CLI_HELP_PRINTF(ctx, "Command %s not found\n", argv[1]);
 
-    // Copy the statically-defined command to a temporary command
-    memcpy(&command, &namespace->commands[cmd_index], sizeof(cli_command_s));
+        cli_namespace_print_help(ctx, namespace);
+        return rc;
+    }
 
-    // Copy the contents of the statically-defined options to the temp command
-    if(namespace->commands[cmd_index].opt_list != NULL)
+    command = &namespace->commands[cmd_index];
+
+    // An asynchronous command outlives the caller's command line, so it is
+    // parsed from a copy into the context of its job
+    if((command->flags & CLI_CMD_F_ASYNC) && cli_job_enabled())
     {
-        for(i = 0; i < namespace->commands[cmd_index].num_options; i++)
+        job = cli_job_alloc(ctx, argc - 2, &argv[2]);
+        if(job == NULL)
         {
-            memcpy(&g_cmd_options[i], 
-                &namespace->commands[cmd_index].opt_list[i], 
-                sizeof(cli_option_s));
+            CLI_HELP_PRINTF(ctx, "No job available for %s command\n",
+                command->name);
+            return OS_ENOMEM;
         }
-        
-        command.opt_list = g_cmd_options;
-        // #if MYNEWT_VAL(CLI_DEBUG_ENABLE)
-        // print_command_struct(&command);
-        // #endif
+
+        job->namespace = namespace;
+        job->cmd_index = cmd_index;
+        parse_ctx = &job->ctx;
+        parse_argc = job->argc;
+        parse_argv = job->argv;
+    }
+
+    // The registered command is used in place; the parse results only go to
+    // the parse context
+    parse_ctx->cmd = command;
+    parse_ctx->opt_map = cli_command_get_opt_map(namespace, cmd_index);
+
+    // Parse all arguments and populate the context
+    rc = cli_parse_command_args(parse_ctx, parse_argc, parse_argv);
+
+    now = CLI_STATS_NOW();
+    cli_stats_parse(namespace, cmd_index, rc, now - start);
+    start = now;
+
+    if((rc != 0) && (job != NULL))
+    {
+        cli_job_free(job);
     }
 
-    // Parse all arguments and populate the command structure
-    rc = cli_parse_command_args(&command, argc - 2, &argv[2], g_cmd_args);
     if (rc == CLI_ERROR_HELP_REQUESTED)
     {
-        cli_command_print_help(&command);
+        cli_command_print_help(ctx, command);
         return 0;
     }
     else if (rc != 0)
     {
-        #if MYNEWT_VAL(CLI_HELP_ENABLE)
-        console_printf("Bad command or argument structure\n");
-        #endif
-        cli_command_print_help(&command);
+        CLI_HELP_PRINTF(ctx, "Bad command or argument structure\n");
+        cli_command_print_help(ctx, command);
         return rc;
     }
 
+    if(job != NULL)
+    {
+        cli_job_start(ctx, job);
+        return 0;
+    }
+
     // Call the namespace with populated arguments for processing
-    if(command.cb != NULL)
+    if(command->cb != NULL)
     {
-        rc = command.cb(&command, g_cmd_args);
-        if(rc != 0)
+        rc = command->cb(ctx, ctx->args);
+        cli_stats_callback(namespace, cmd_index, rc, CLI_STATS_NOW() - start);
+        if((rc != 0) && !(command->flags & CLI_CMD_F_NO_ERROR_HELP))
         {
-            #if MYNEWT_VAL(CLI_HELP_ENABLE)
-            console_printf("Bad argument or option struture in %s command\n",
-                command.name);
-            #endif
-            cli_command_print_help(&command);
+            CLI_HELP_PRINTF(ctx,
+                "Bad argument or option struture in %s command\n",
+                command->name);
+            cli_command_print_help(ctx, command);
             return rc;
         }
     }
@@ -321,6 +527,30 @@ static int cli_namespace_on_shell_rx(int argc, char ** argv)
     return rc != 0 ? rc : 0;
 }
 
+int cli_namespace_execute(cli_ctx_s * ctx, int argc, char ** argv)
+{
+    int rc;
+
+    rc = cli_namespace_dispatch(ctx, argc, argv);
+    cli_flush(ctx);
+
+    return rc;
+}
+
+/** Callback called when the Shell encounters any namespace registered through
+ *  the cmd_namespace module. The command line is executed with a parse
+ *  context on the stack of the shell task, and the output buffer of the shell
+ *  session, subject to the rate limit of the session.
+ */
+static int cli_namespace_on_shell_rx(int argc, char ** argv)
+{
+    cli_ctx_s ctx;
+
+    cli_ctx_init(&ctx, 0, &g_cli_shell_out);
+
+    return cli_limit_shell_rx(&ctx, argc, argv);
+}
+
 /** Register a new namespace with the Mynewt shell. The shell will call back to
  *  the cmd_namespace module as an interim to direct execution to the
  *  appropriate place within the namespace
@@ -328,6 +558,7 @@ static int cli_namespace_on_shell_rx(int argc, char ** argv)
 int cli_namespace_register(cli_namespace_s * new_namespace)
 {
     int rc, i;
+    uint32_t slot;
     struct shell_cmd new_cmd;
 
     // Ensure the new namespace does not require more args/options than the
@@ -353,21 +584,45 @@ int cli_namespace_register(cli_namespace_s * new_namespace)
     // Ensure the new namespace command can be registered with the shell
     assert(shell_cmd_register(&new_cmd) == 0);
 
-    // Ensure new namespace command is not already registered
-    assert(cli_namespace_find(new_namespace->name, NULL) == SYS_ENOENT);
-
     // Ensure the new namespace has an associated command list
     assert(new_namespace->commands != NULL);
 
+    new_namespace->hash = cli_hash(new_namespace->name);
+    new_namespace->num_commands = i;
+
     rc = cli_namespace_list_lock();
     if(rc != 0)
     {
         return rc;
     }
 
-    // Add the new namespace to a list to be referenced upon callback from the
-    // shell
-    SLIST_INSERT_HEAD(&g_cli_namespace_list, new_namespace, next);
+    // Ensure new namespace command is not already registered. Registrations
+    // are serialized, so no other one can add it meanwhile
+    rc = cli_namespace_find(new_namespace->name, NULL);
+    assert(rc == SYS_ENOENT);
+
+    // Ensure the namespace index keeps at least one empty slot, which ends
+    // the probing of names that are not registered
+    assert(g_cli_num_namespaces < CLI_NAMESPACE_INDEX_SIZE - 1);
+
+    cli_command_index_build(new_namespace);
+    cli_trie_add_commands(new_namespace);
+
+    slot = new_namespace->hash & (CLI_NAMESPACE_INDEX_SIZE - 1);
+    while(g_cli_namespace_index[slot] != NULL)
+    {
+        slot = (slot + 1) & (CLI_NAMESPACE_INDEX_SIZE - 1);
+    }
+
+    new_namespace->id = g_cli_num_namespaces;
+    g_cli_namespace_by_id[new_namespace->id] = new_namespace;
+
+    // Publish the namespace once it and its command index are complete
+    __atomic_store_n(&g_cli_namespace_index[slot], new_namespace,
+        __ATOMIC_RELEASE);
+    __atomic_store_n(&g_cli_num_namespaces, g_cli_num_namespaces + 1,
+        __ATOMIC_RELEASE);
+    cli_trie_add_namespace(new_namespace);
 
     rc = cli_namespace_list_unlock();
     if(rc != 0)
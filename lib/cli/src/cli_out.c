@@ -0,0 +1,112 @@
+/*
+ * Buffered output of the CLI sessions
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_out.h"
+
+/* Appends len characters to the buffer of a session, flushing it first if they
+ * do not fit. Output larger than the buffer is written through */
+static void cli_out_write(const cli_ctx_s * ctx, const char * str, size_t len)
+{
+	cli_out_s * out = ctx->out;
+
+	if(out->len + len > out->size)
+	{
+		cli_flush(ctx);
+
+		if(len > out->size)
+		{
+			console_write(str, len);
+			return;
+		}
+	}
+
+	memcpy(&out->buf[out->len], str, len);
+	out->len += len;
+}
+
+void cli_vprintf(const cli_ctx_s * ctx, const char * fmt, va_list ap)
+{
+	cli_out_s * out = ctx->out;
+	va_list ap_retry;
+	int len;
+
+	if(ctx->flags & CLI_CTX_F_QUIET)
+	{
+		return;
+	}
+
+	if(out == NULL)
+	{
+		console_vprintf(fmt, ap);
+		return;
+	}
+
+	// Format straight into the free space of the buffer. If the output does
+	// not fit, flush the buffer and format again into it, unless the output
+	// is larger than the whole buffer
+	va_copy(ap_retry, ap);
+	len = vsnprintf(&out->buf[out->len], out->size - out->len, fmt, ap);
+	if((len >= 0) && (out->len + len < out->size))
+	{
+		out->len += len;
+	}
+	else if(len >= 0)
+	{
+		cli_flush(ctx);
+
+		if(len < out->size)
+		{
+			vsnprintf(out->buf, out->size, fmt, ap_retry);
+			out->len = len;
+		}
+		else
+		{
+			console_vprintf(fmt, ap_retry);
+		}
+	}
+	va_end(ap_retry);
+}
+
+void cli_printf(const cli_ctx_s * ctx, const char * fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	cli_vprintf(ctx, fmt, ap);
+	va_end(ap);
+}
+
+void cli_puts(const cli_ctx_s * ctx, const char * str)
+{
+	if(ctx->flags & CLI_CTX_F_QUIET)
+	{
+		return;
+	}
+
+	if(ctx->out == NULL)
+	{
+		console_write(str, strlen(str));
+		return;
+	}
+
+	cli_out_write(ctx, str, strlen(str));
+}
+
+void cli_flush(const cli_ctx_s * ctx)
+{
+	cli_out_s * out = ctx->out;
+
+	if((out == NULL) || (out->len == 0))
+	{
+		return;
+	}
+
+	console_write(out->buf, out->len);
+	out->len = 0;
+}
@@ -10,68 +10,499 @@
 #include "console/console.h"
 #include "cli/cli_namespace.h"
 #include "cli/cli_parse.h"
+#include "cli_priv.h"
 
-/* Parses option flags */
-static int cli_parse_option(cli_command_s * cmd, int argc, char ** argv,
-	bool * has_arg)
+/* Number of bits set in a word. Most targets have no population count
+ * instruction, and the generic library call is slower than this */
+static inline int cli_parse_popcount(uint32_t word)
 {
-	bool opt_found = false;
-	int i;
-    cli_option_s *cur_opt;
+	word = word - ((word >> 1) & 0x55555555);
+	word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+	word = (word + (word >> 4)) & 0x0F0F0F0F;
 
-    /* NOTE: cmd->opt_list is a non-constant temporary! */
-    cur_opt = (cli_option_s *)cmd->opt_list;
+	return (word * 0x01010101) >> 24;
+}
 
-	// Check each command option to see if it exists within the option token.
-	// Many options can exist within a single option token
-	for(i = 0; i < cmd->num_options; i++)
+/* Returns the opt_list index of the option named c, or -1 if the command does
+ * not declare it */
+static int cli_parse_option_index(const cli_option_map_s * map, char c)
+{
+	uint8_t ch = (uint8_t)c;
+	uint32_t word, bit;
+
+	if(ch >= 128)
+	{
+		return -1;
+	}
+
+	word = map->chars[ch >> 5];
+	bit = (uint32_t)1 << (ch & 31);
+
+	if((word & bit) == 0)
+	{
+		return -1;
+	}
+
+	return map->index[map->rank_base[ch >> 5] +
+		cli_parse_popcount(word & (bit - 1))];
+}
+
+/* Returns the declared type of argument idx of a command, or NULL */
+static inline const cli_arg_type_s * cli_parse_arg_type(
+	const cli_command_s * cmd, int idx)
+{
+	return (cmd->arg_types != NULL) ? &cmd->arg_types[idx] : NULL;
+}
+
+/* Parses a decimal or hexadecimal (0x prefix) integer with an optional sign.
+ * Magnitudes above 2^32 are rejected */
+static bool cli_parse_int(const char * str, int64_t * num)
+{
+	uint64_t val = 0;
+	unsigned int base = 10;
+	unsigned int digit;
+	bool neg = false;
+	char c;
+
+	if((*str == '-') || (*str == '+'))
+	{
+		neg = (*str == '-');
+		str++;
+	}
+
+	if((str[0] == '0') && ((str[1] == 'x') || (str[1] == 'X')))
 	{
-		if(strchr(argv[0], cur_opt[i].name) != NULL)
+		base = 16;
+		str += 2;
+	}
+
+	if(*str == '\0')
+	{
+		return false;
+	}
+
+	for(; *str != '\0'; str++)
+	{
+		c = *str;
+		if((c >= '0') && (c <= '9'))
+		{
+			digit = c - '0';
+		}
+		else if((base == 16) && ((c | 0x20) >= 'a') && ((c | 0x20) <= 'f'))
 		{
-			// If the option is expecting an argument, ensure that it exists and
-			// that it does not take the form of an option flag
-			if(cur_opt[i].has_arg)
+			digit = (c | 0x20) - 'a' + 10;
+		}
+		else
+		{
+			return false;
+		}
+
+		val = val * base + digit;
+		if(val > ((uint64_t)1 << 32))
+		{
+			return false;
+		}
+	}
+
+	*num = neg ? -(int64_t)val : (int64_t)val;
+
+	return true;
+}
+
+/* Parses a decimal float with an optional sign, fraction and exponent. Not
+ * every libc of the targets provides strtof */
+static bool cli_parse_float(const char * str, float * num)
+{
+	float val = 0.0f;
+	float scale = 0.1f;
+	bool neg = false;
+	bool digits = false;
+	int64_t exp = 0;
+
+	if((*str == '-') || (*str == '+'))
+	{
+		neg = (*str == '-');
+		str++;
+	}
+
+	for(; (*str >= '0') && (*str <= '9'); str++)
+	{
+		val = val * 10.0f + (*str - '0');
+		digits = true;
+	}
+
+	if(*str == '.')
+	{
+		for(str++; (*str >= '0') && (*str <= '9'); str++)
+		{
+			val += (*str - '0') * scale;
+			scale *= 0.1f;
+			digits = true;
+		}
+	}
+
+	if(!digits)
+	{
+		return false;
+	}
+
+	if((*str == 'e') || (*str == 'E'))
+	{
+		if(!cli_parse_int(str + 1, &exp) || (exp < -45) || (exp > 38))
+		{
+			return false;
+		}
+
+		for(; exp > 0; exp--)
+		{
+			val *= 10.0f;
+		}
+		for(; exp < 0; exp++)
+		{
+			val *= 0.1f;
+		}
+	}
+	else if(*str != '\0')
+	{
+		return false;
+	}
+
+	*num = neg ? -val : val;
+
+	return true;
+}
+
+static int cli_parse_hex_digit(char c)
+{
+	if((c >= '0') && (c <= '9'))
+	{
+		return c - '0';
+	}
+	if(((c | 0x20) >= 'a') && ((c | 0x20) <= 'f'))
+	{
+		return (c | 0x20) - 'a' + 10;
+	}
+
+	return -1;
+}
+
+/* Decodes a hex string in place */
+static bool cli_parse_bytes(char * str, cli_value_u * value)
+{
+	uint8_t * data = (uint8_t *)str;
+	size_t len = strlen(str);
+	size_t i;
+	int hi, lo;
+
+	if((len & 1) || (len / 2 > UINT16_MAX))
+	{
+		return false;
+	}
+
+	for(i = 0; i < len / 2; i++)
+	{
+		hi = cli_parse_hex_digit(str[2 * i]);
+		lo = cli_parse_hex_digit(str[2 * i + 1]);
+		if((hi < 0) || (lo < 0))
+		{
+			return false;
+		}
+
+		data[i] = (hi << 4) | lo;
+	}
+
+	value->bytes.data = data;
+	value->bytes.len = len / 2;
+
+	return true;
+}
+
+/* Converts a command line token to the type of an argument */
+static int cli_parse_store(cli_ctx_s * ctx, const cli_arg_type_s * type,
+	char * str, cli_value_u * value)
+{
+	int rc;
+
+	if(type == NULL)
+	{
+		value->str = str;
+		return CLI_ERROR_NONE;
+	}
+
+	rc = cli_parse_value(type, str, value);
+	if(rc != CLI_ERROR_NONE)
+	{
+		CLI_HELP_PRINTF(ctx, "Invalid value: %s\n", str);
+	}
+
+	return rc;
+}
+
+/* Parses option flags. Each character of the option token is looked up once;
+ * the token is only an option token if every character names an option, and
+ * at most one of them may require an argument (taken from the next token) */
+static int cli_parse_option(cli_ctx_s * ctx, const cli_option_map_s * map,
+	int argc, char ** argv, bool * has_arg)
+{
+	uint32_t found = 0;
+	int arg_idx = -1;
+	const char * c;
+	int idx, rc;
+
+	for(c = &argv[0][1]; *c != '\0'; c++)
+	{
+		idx = cli_parse_option_index(map, *c);
+		if(idx < 0)
+		{
+			return CLI_ERROR_OPTION_NOT_FOUND;
+		}
+
+		if((map->has_arg & ((uint32_t)1 << idx)) && (idx != arg_idx))
+		{
+			if(arg_idx >= 0)
 			{
-				if(argc < 2)
-				{
-					#if MYNEWT_VAL(CLI_HELP_ENABLE)
-					console_printf("Option %s expects an argument\n", argv[0]);
-					#endif
-					return CLI_ERROR_BAD_ARG;
-				}
+				CLI_HELP_PRINTF(ctx, "Option %s has more than one argument\n",
+					argv[0]);
+				return CLI_ERROR_BAD_ARG;
+			}
 
-				// BW_2018-0118 (fix/cli_negative_values): Option arguments CAN begin with '-'
-				// if(argv[1][0] == '-')
-				// {
-				// 	#if MYNEWT_VAL(CLI_HELP_ENABLE)
-				// 	console_printf("Option argument cannot begin with \'-\'\n");
-				// 	#endif
-				// 	return 1;
-				// }
-				cur_opt[i].value = true;
-				cur_opt[i].arg_value = argv[1];
-				*has_arg = true;
+			arg_idx = idx;
+		}
 
-				#if MYNEWT_VAL(CLI_DEBUG_ENABLE)
-				console_printf("Found option %s with argument %s\n", argv[0],
-						argv[1]);
-				#endif
+		found |= (uint32_t)1 << idx;
+	}
+
+	if(found == 0)
+	{
+		return CLI_ERROR_OPTION_NOT_FOUND;
+	}
+
+	// If an option is expecting an argument, ensure that it exists. Option
+	// arguments CAN begin with '-' (fix/cli_negative_values)
+	if(arg_idx >= 0)
+	{
+		if(argc < 2)
+		{
+			CLI_HELP_PRINTF(ctx, "Option %s expects an argument\n", argv[0]);
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		ctx->opt_args[arg_idx] = argv[1];
+		*has_arg = true;
+
+		rc = cli_parse_store(ctx, ctx->cmd->opt_list[arg_idx].arg_type,
+			argv[1], &ctx->opt_values[arg_idx]);
+		if(rc != CLI_ERROR_NONE)
+		{
+			return rc;
+		}
 
+		#if MYNEWT_VAL(CLI_DEBUG_ENABLE)
+		console_printf("Found option %s with argument %s\n", argv[0], argv[1]);
+		#endif
+	}
+	#if MYNEWT_VAL(CLI_DEBUG_ENABLE)
+	else
+	{
+		console_printf("Found option %s\n", argv[0]);
+	}
+	#endif
+
+	ctx->opt_mask |= found;
+
+	return CLI_ERROR_NONE;
+}
+
+bool cli_parse_in_range(const cli_arg_type_s * type, int64_t val)
+{
+	return ((type->min == 0) && (type->max == 0)) ||
+		((val >= type->min) && (val <= type->max));
+}
+
+int cli_parse_num_value(const cli_arg_type_s * type, int64_t num,
+	cli_value_u * value)
+{
+	int count;
+
+	switch(type->type)
+	{
+	case CLI_ARG_T_INT:
+		if((num < INT32_MIN) || (num > INT32_MAX) ||
+			!cli_parse_in_range(type, num))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		value->i = num;
+		return CLI_ERROR_NONE;
+
+	case CLI_ARG_T_UINT:
+		if((num < 0) || (num > UINT32_MAX) || !cli_parse_in_range(type, num))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		value->u = num;
+		return CLI_ERROR_NONE;
+
+	case CLI_ARG_T_FLOAT:
+		return cli_parse_float_value(type, (float)num, value);
+
+	case CLI_ARG_T_BOOL:
+		if((num != 0) && (num != 1))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		value->b = (num == 1);
+		return CLI_ERROR_NONE;
+
+	case CLI_ARG_T_ENUM:
+		for(count = 0; type->names[count] != NULL; count++)
+		{
+		}
+		if((num < 0) || (num >= count))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		value->e = num;
+		return CLI_ERROR_NONE;
+
+	default:
+		return CLI_ERROR_BAD_ARG;
+	}
+}
+
+int cli_parse_float_value(const cli_arg_type_s * type, float num,
+	cli_value_u * value)
+{
+	if((type->type != CLI_ARG_T_FLOAT) || (num != num) ||
+		(((type->min != 0) || (type->max != 0)) &&
+		((num < type->min) || (num > type->max))))
+	{
+		return CLI_ERROR_BAD_ARG;
+	}
+
+	value->f = num;
+
+	return CLI_ERROR_NONE;
+}
+
+int cli_parse_value(const cli_arg_type_s * type, char * str,
+	cli_value_u * value)
+{
+	int64_t num;
+	float f;
+	int i;
+
+	switch(type->type)
+	{
+	case CLI_ARG_T_STR:
+		if(!cli_parse_in_range(type, strlen(str)))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		value->str = str;
+		return CLI_ERROR_NONE;
+
+	case CLI_ARG_T_INT:
+	case CLI_ARG_T_UINT:
+		if(!cli_parse_int(str, &num))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		return cli_parse_num_value(type, num, value);
+
+	case CLI_ARG_T_FLOAT:
+		if(!cli_parse_float(str, &f))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		return cli_parse_float_value(type, f, value);
+
+	case CLI_ARG_T_BOOL:
+		if(!strcmp(str, "1") || !strcmp(str, "true") || !strcmp(str, "on"))
+		{
+			value->b = true;
+		}
+		else if(!strcmp(str, "0") || !strcmp(str, "false") ||
+			!strcmp(str, "off"))
+		{
+			value->b = false;
+		}
+		else
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		return CLI_ERROR_NONE;
+
+	case CLI_ARG_T_ENUM:
+		for(i = 0; type->names[i] != NULL; i++)
+		{
+			if(!strcmp(str, type->names[i]))
+			{
+				value->e = i;
 				return CLI_ERROR_NONE;
 			}
-			else
-			{
-				opt_found = true;
-				cur_opt[i].value = true;
+		}
+		return CLI_ERROR_BAD_ARG;
 
-				#if MYNEWT_VAL(CLI_DEBUG_ENABLE)
-				console_printf("Found option %s\n", argv[0]);
-				#endif
+	case CLI_ARG_T_BYTES:
+		if(!cli_parse_bytes(str, value) ||
+			!cli_parse_in_range(type, value->bytes.len))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+		return CLI_ERROR_NONE;
+
+	default:
+		return CLI_ERROR_BAD_ARG;
+	}
+}
+
+int cli_parse_compile_options(const cli_command_s * cmd, cli_option_map_s * map)
+{
+	uint8_t ch;
+	int i, j, rank;
+
+	memset(map, 0, sizeof(*map));
+
+	for(i = 0; i < cmd->num_options; i++)
+	{
+		ch = (uint8_t)cmd->opt_list[i].name;
+
+		if((ch >= 128) || (map->chars[ch >> 5] & ((uint32_t)1 << (ch & 31))))
+		{
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		map->chars[ch >> 5] |= (uint32_t)1 << (ch & 31);
+
+		if(cmd->opt_list[i].has_arg)
+		{
+			map->has_arg |= (uint32_t)1 << i;
+		}
+	}
+
+	for(i = 1; i < 4; i++)
+	{
+		map->rank_base[i] = map->rank_base[i - 1] +
+			cli_parse_popcount(map->chars[i - 1]);
+	}
+
+	// Rank each option by its character among all declared characters
+	for(i = 0; i < cmd->num_options; i++)
+	{
+		rank = 0;
+		for(j = 0; j < cmd->num_options; j++)
+		{
+			if((uint8_t)cmd->opt_list[j].name < (uint8_t)cmd->opt_list[i].name)
+			{
+				rank++;
 			}
 		}
+
+		map->index[rank] = i;
 	}
 
-	return opt_found ? CLI_ERROR_NONE : CLI_ERROR_OPTION_NOT_FOUND;
+	return CLI_ERROR_NONE;
 }
 
 bool cli_parse_arg_is_help(const char *arg)
@@ -81,13 +512,36 @@ bool cli_parse_arg_is_help(const char *arg)
             strcmp(arg, "-h") == 0;
 }
 
-/* Parses arguments and options with respect to the given command */
-int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
-	char ** arg_list)
+/* Parses arguments and options with respect to ctx->cmd into ctx */
+int cli_parse_command_args(cli_ctx_s * ctx, int argc, char ** argv)
 {
+	const cli_command_s * cmd = ctx->cmd;
+	const cli_option_map_s * opt_map = ctx->opt_map;
+	cli_option_map_s map;
 	int i, rc;
 	int args_found = 0;
 	bool skip_next_arg = false;
+	bool raw = (cmd->flags & CLI_CMD_F_RAW) != 0;
+
+	// Commands registered with a namespace come with their compiled options
+	if((opt_map == NULL) && (cmd->num_options != 0))
+	{
+		rc = cli_parse_compile_options(cmd, &map);
+		if(rc != CLI_ERROR_NONE)
+		{
+			return rc;
+		}
+
+		opt_map = &map;
+	}
+
+	ctx->opt_mask = 0;
+	for(i = 0; i < cmd->num_options; i++)
+	{
+		ctx->opt_args[i] = NULL;
+	}
+	ctx->raw_argc = 0;
+	ctx->raw_argv = NULL;
 
 	// Examine each token in the command line. If it begins with '-', try to
 	// parse it as an option first. Otherwise, parse it as an argument
@@ -97,6 +551,13 @@ int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
 		console_printf("Parsing argument %s\n", argv[i]);
 		#endif
 
+		// The tokens of a raw command are not checked for help once its first
+		// argument has been reached
+		if(raw && (i > 0) && (argv[i][0] != '-'))
+		{
+			break;
+		}
+
         if (cli_parse_arg_is_help(argv[i]))
 		{
             return CLI_ERROR_HELP_REQUESTED;
@@ -106,42 +567,50 @@ int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
 		{
 			if(cmd->num_options == 0)
 			{
-				#if MYNEWT_VAL(CLI_HELP_ENABLE)
-				console_printf("Command %s does not accept any options\n",
+				CLI_HELP_PRINTF(ctx, "Command %s does not accept any options\n",
 					cmd->name);
-				#endif
 				return CLI_ERROR_BAD_ARG;
 			}
 
 			// Try to parse the argument as an option.
-			rc = cli_parse_option(cmd, argc - i, &argv[i], &skip_next_arg);
+			rc = cli_parse_option(ctx, opt_map, argc - i, &argv[i],
+				&skip_next_arg);
 			if(rc == CLI_ERROR_BAD_ARG)
 			{
-				#if MYNEWT_VAL(CLI_HELP_ENABLE)
-				console_printf("Bad option or option structure: %s\n", argv[0]);
-				#endif
+				CLI_HELP_PRINTF(ctx, "Bad option or option structure: %s\n",
+					argv[0]);
 				return rc;
 			}
 			// If the argument is not found in the option list, try to add it
 			// to the command argument list.
 			else if(rc == CLI_ERROR_OPTION_NOT_FOUND)
 			{
-				if((cmd->num_args != 0) && (args_found < cmd->num_args))
+				if(raw)
+				{
+					break;
+				}
+				else if((cmd->num_args != 0) && (args_found < cmd->num_args))
 				{
 					#if MYNEWT_VAL(CLI_DEBUG_ENABLE)
 					console_printf("Found argument %d of %s: %s\n", args_found,
 						cmd->name, argv[i]);
 					#endif
-					arg_list[args_found] = argv[i];
+					ctx->args[args_found] = argv[i];
+					rc = cli_parse_store(ctx,
+						cli_parse_arg_type(cmd, args_found), argv[i],
+						&ctx->values[args_found]);
+					if(rc != CLI_ERROR_NONE)
+					{
+						return rc;
+					}
 					args_found++;
 				}
 				else
 				{
 					// Command was not expecting an argument or received too many
 					// arguments
-					#if MYNEWT_VAL(CLI_HELP_ENABLE)
-					console_printf("Argument not expected or too many arguments\n");
-					#endif
+					CLI_HELP_PRINTF(ctx,
+						"Argument not expected or too many arguments\n");
 					return CLI_ERROR_BAD_ARG;
 				}
 			}
@@ -157,6 +626,11 @@ int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
 				skip_next_arg = false;
 			}
 		}
+		else if(raw)
+		{
+			// The first argument of a raw command ends the parse
+			break;
+		}
 		else
 		{
 			// Add the encountered argument to the argument list if the command
@@ -168,29 +642,48 @@ int cli_parse_command_args(cli_command_s * cmd, int argc, char ** argv,
 				console_printf("Found argument %d of %s: %s\n", args_found,
 					cmd->name, argv[i]);
 				#endif
-				arg_list[args_found] = argv[i];
+				ctx->args[args_found] = argv[i];
+				rc = cli_parse_store(ctx, cli_parse_arg_type(cmd, args_found),
+					argv[i], &ctx->values[args_found]);
+				if(rc != CLI_ERROR_NONE)
+				{
+					return rc;
+				}
 				args_found++;
 			}
 			else
 			{
 				// Command was not expecting an argument or received too many
 				// arguments
-				#if MYNEWT_VAL(CLI_HELP_ENABLE)
-				console_printf("Argument not expected or too many arguments\n");
-				#endif
+				CLI_HELP_PRINTF(ctx,
+					"Argument not expected or too many arguments\n");
 				return CLI_ERROR_BAD_ARG;
 			}
 		}
 	}
 
+	// Leave the remaining tokens of a raw command to its callback
+	if(raw)
+	{
+		ctx->raw_argc = argc - i;
+		ctx->raw_argv = &argv[i];
+		if(ctx->raw_argc < cmd->num_args)
+		{
+			CLI_HELP_PRINTF(ctx,
+				"Expected at least %d arguments but found %d\n",
+				cmd->num_args, ctx->raw_argc);
+			return CLI_ERROR_BAD_ARG;
+		}
+
+		return CLI_ERROR_NONE;
+	}
+
 	// Ensure that the number of arguments found is equal to the number of
 	// arguments expected by the command
 	if(args_found != cmd->num_args)
 	{
-		#if MYNEWT_VAL(CLI_HELP_ENABLE)
-		console_printf("Expected %d arguments but found %d\n",
+		CLI_HELP_PRINTF(ctx, "Expected %d arguments but found %d\n",
 			cmd->num_args, args_found);
-		#endif
 		return CLI_ERROR_BAD_ARG;
 	}
 
@@ -0,0 +1,135 @@
+/*
+ * Definitions shared between the CLI module source files
+ */
+
+#ifndef __CLI_PRIV_H__
+#define __CLI_PRIV_H__
+
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "console/console.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_out.h"
+#include "cli/cli_complete.h"
+
+/* Prints a help or error message of the CLI module to the output of the
+ * session */
+#if MYNEWT_VAL(CLI_HELP_ENABLE)
+#define CLI_HELP_PRINTF(ctx_, ...)      cli_printf((ctx_), __VA_ARGS__)
+#define CLI_HELP_PUTS(ctx_, str_)       cli_puts((ctx_), (str_))
+#else
+#define CLI_HELP_PRINTF(ctx_, ...)
+#define CLI_HELP_PUTS(ctx_, str_)
+#endif
+
+/* Returns the namespace registered with the given id, or NULL */
+const cli_namespace_s * cli_namespace_from_id(uint8_t id);
+
+/* Returns the compiled option list of a registered command */
+const cli_option_map_s * cli_command_get_opt_map(
+    const cli_namespace_s * namespace, int cmd_index);
+
+/* Indexes the command names of a namespace in a trie of their own. Must be
+ * called with the namespace list lock held, before the namespace is
+ * published */
+void cli_trie_add_commands(cli_namespace_s * namespace);
+
+/* Indexes the name of a published namespace. Must be called with the
+ * namespace list lock held */
+void cli_trie_add_namespace(const cli_namespace_s * namespace);
+
+/* Returns the number of commands of a namespace whose name starts with a
+ * prefix. If there is only one, sets its index */
+int cli_trie_find_command(const cli_namespace_s * namespace,
+    const char * prefix, int * cmd_index);
+
+/* Calls cb for each command of a namespace whose name starts with a prefix,
+ * in alphabetical order */
+void cli_trie_list_commands(const cli_namespace_s * namespace,
+    const char * prefix, cli_complete_fn * cb, void * arg);
+
+/* Indicates whether a value or length is within the range of a type */
+bool cli_parse_in_range(const cli_arg_type_s * type, int64_t val);
+
+/* Converts an integer to a declared argument type and checks its range */
+int cli_parse_num_value(const cli_arg_type_s * type, int64_t num,
+    cli_value_u * value);
+
+/* Checks a float against a declared argument type and its range */
+int cli_parse_float_value(const cli_arg_type_s * type, float num,
+    cli_value_u * value);
+
+/* Largest number of tokens of a command: namespace, command, arguments and
+ * options with their arguments */
+#define CLI_MAX_TOKENS                                                      \
+    (2 + MYNEWT_VAL(CLI_MAX_NUM_ARGS) + 2 * MYNEWT_VAL(CLI_MAX_NUM_OPTIONS))
+
+/* Job running an asynchronous command, with its own copy of the command
+ * line */
+typedef struct
+{
+    uint8_t             state;      // CLI_JOB_*; 0 if the slot is free
+    uint16_t            id;         // Job id
+    int                 rc;         // Return code of the command once done
+    struct os_event     ev;         // Event running the job on the worker
+    cli_ctx_s           ctx;        // Parse context of the command
+    int                 argc;       // Number of tokens in argv
+    char *              argv[CLI_MAX_TOKENS];   // Tokens, in line
+    char                line[MYNEWT_VAL(CLI_JOB_LINE_SIZE)];
+    const cli_namespace_s * namespace;  // Namespace of the command
+    int                 cmd_index;  // Index of the command in its namespace
+    cli_out_s           out;        // Output buffer of the job
+    char                out_buf[MYNEWT_VAL(CLI_OUTPUT_BUF_SIZE)];
+} cli_job_s;
+
+/* Indicates whether a worker event queue runs the asynchronous commands */
+bool cli_job_enabled(void);
+
+/* Copies argc tokens, NUL-terminated, into a line of the given size, and
+ * points dst to them. Returns 0, or SYS_ENOMEM if they do not fit or are more
+ * than CLI_MAX_TOKENS */
+int cli_copy_tokens(char * line, size_t size, char ** dst, int argc,
+    char ** argv);
+
+/* Queues an event on the worker event queue */
+void cli_job_post(struct os_event * ev);
+
+/* Reserves a job and copies a command line (arguments and options only) into
+ * it. Returns NULL if all jobs are busy or the line does not fit */
+cli_job_s * cli_job_alloc(const cli_ctx_s * ctx, int argc, char ** argv);
+
+/* Releases a job whose command line was rejected */
+void cli_job_free(cli_job_s * job);
+
+/* Queues a parsed job on the worker event queue, and reports its id in the
+ * caller's context */
+void cli_job_start(cli_ctx_s * ctx, cli_job_s * job);
+
+/* Records the statistics of a step of the dispatch of a command line. The
+ * lookup of an unknown namespace is recorded with a NULL namespace, and of an
+ * unknown command with a negative cmd_index */
+#if MYNEWT_VAL(CLI_STATS)
+#define CLI_STATS_NOW()                 os_cputime_get32()
+void cli_stats_lookup(const cli_namespace_s * namespace, int cmd_index,
+    uint32_t ticks);
+void cli_stats_parse(const cli_namespace_s * namespace, int cmd_index, int rc,
+    uint32_t ticks);
+void cli_stats_callback(const cli_namespace_s * namespace, int cmd_index,
+    int rc, uint32_t ticks);
+#else
+#define CLI_STATS_NOW()                 0
+static inline void cli_stats_lookup(const cli_namespace_s * namespace,
+    int cmd_index, uint32_t ticks)
+{
+}
+static inline void cli_stats_parse(const cli_namespace_s * namespace,
+    int cmd_index, int rc, uint32_t ticks)
+{
+}
+static inline void cli_stats_callback(const cli_namespace_s * namespace,
+    int cmd_index, int rc, uint32_t ticks)
+{
+}
+#endif
+
+#endif // __CLI_PRIV_H__
@@ -0,0 +1,192 @@
+/*
+ * Batch execution of CLI commands
+ */
+
+#include <string.h>
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_parse.h"
+#include "cli/cli_run.h"
+#include "cli_priv.h"
+
+/* State of the execution of a script */
+typedef struct
+{
+	cli_ctx_s 						ctx;			// Parse context shared by all commands
+	uint8_t 						flags;			// CLI_RUN_F_* flags
+	bool 							overflow;		// The command has more than CLI_MAX_TOKENS tokens
+	int 							argc;			// Number of tokens of the command
+	char * 							argv[CLI_MAX_TOKENS];	// Tokens of the command
+	cli_run_summary_s * 			summary;		// Outcome of the execution
+} cli_run_s;
+
+static void cli_run_start(cli_run_s * run, uint8_t flags, cli_out_s * out,
+	cli_run_summary_s * summary)
+{
+	memset(summary, 0, sizeof(*summary));
+
+	cli_ctx_init(&run->ctx, (flags & CLI_RUN_F_QUIET) ? CLI_CTX_F_QUIET : 0,
+		out);
+	run->flags = flags;
+	run->overflow = false;
+	run->argc = 0;
+	run->summary = summary;
+}
+
+static void cli_run_add_token(cli_run_s * run, char * token)
+{
+	if(run->argc < CLI_MAX_TOKENS)
+	{
+		run->argv[run->argc++] = token;
+	}
+	else
+	{
+		run->overflow = true;
+	}
+}
+
+/* Executes the command whose tokens were collected, if any. Returns false if
+ * the script must stop */
+static bool cli_run_end_command(cli_run_s * run)
+{
+	cli_run_summary_s * summary = run->summary;
+	int rc;
+
+	if(run->argc == 0)
+	{
+		return true;
+	}
+
+	if(run->overflow)
+	{
+		CLI_HELP_PRINTF(&run->ctx, "Too many tokens in %s command\n",
+			run->argv[0]);
+		rc = CLI_ERROR_BAD_ARG;
+	}
+	else
+	{
+		rc = cli_namespace_execute(&run->ctx, run->argc, run->argv);
+	}
+
+	run->argc = 0;
+	run->overflow = false;
+	summary->executed++;
+
+	if(rc == 0)
+	{
+		return true;
+	}
+
+	summary->failed++;
+	if(summary->first_failed == 0)
+	{
+		summary->first_failed = summary->executed;
+		summary->rc = rc;
+	}
+
+	return (run->flags & CLI_RUN_F_CONTINUE) != 0;
+}
+
+static bool cli_run_is_blank(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static bool cli_run_is_separator(char c)
+{
+	return (c == ';') || (c == '\n');
+}
+
+int cli_run_buf(char * buf, uint8_t flags, cli_out_s * out,
+	cli_run_summary_s * summary)
+{
+	cli_run_s run;
+	bool keep_going = true;
+	char * p = buf;
+
+	cli_run_start(&run, flags, out, summary);
+
+	while((*p != '\0') && keep_going)
+	{
+		if(cli_run_is_blank(*p))
+		{
+			*p++ = '\0';
+		}
+		else if(cli_run_is_separator(*p))
+		{
+			*p++ = '\0';
+			keep_going = cli_run_end_command(&run);
+		}
+		else if((*p == '#') && (run.argc == 0))
+		{
+			// Comments run to the end of the line
+			while((*p != '\0') && (*p != '\n'))
+			{
+				p++;
+			}
+		}
+		else
+		{
+			cli_run_add_token(&run, p);
+			while((*p != '\0') && !cli_run_is_blank(*p) &&
+				!cli_run_is_separator(*p))
+			{
+				p++;
+			}
+		}
+	}
+
+	if(keep_going)
+	{
+		cli_run_end_command(&run);
+	}
+
+	return summary->rc;
+}
+
+int cli_run_argv(int argc, char ** argv, uint8_t flags, cli_out_s * out,
+	cli_run_summary_s * summary)
+{
+	cli_run_s run;
+	bool keep_going = true;
+	char * token;
+	char * sep;
+	int i;
+
+	cli_run_start(&run, flags, out, summary);
+
+	for(i = 0; (i < argc) && keep_going; i++)
+	{
+		// A token may hold the end of a command, the start of the next one,
+		// or both
+		token = argv[i];
+		while(keep_going)
+		{
+			sep = strchr(token, ';');
+			if(sep != NULL)
+			{
+				*sep = '\0';
+			}
+
+			if(*token != '\0')
+			{
+				cli_run_add_token(&run, token);
+			}
+
+			if(sep == NULL)
+			{
+				break;
+			}
+
+			keep_going = cli_run_end_command(&run);
+			token = sep + 1;
+		}
+	}
+
+	if(keep_going)
+	{
+		cli_run_end_command(&run);
+	}
+
+	return summary->rc;
+}
@@ -0,0 +1,227 @@
+/*
+ * Invocation statistics of the CLI commands
+ */
+
+#include <string.h>
+#include "defs/error.h"
+#include "os/os.h"
+#include "cli/cli_namespace.h"
+#include "cli/cli_parse.h"
+#include "cli/cli_out.h"
+#include "cli/cli_stats.h"
+#include "cli_priv.h"
+
+#if MYNEWT_VAL(CLI_STATS)
+
+/* Statistics of the registered namespaces, by id, and of their commands, by
+ * cli_namespace_s.cmd_base + command index */
+static cli_namespace_stats_s g_cli_namespace_stats[
+	MYNEWT_VAL(CLI_NAMESPACE_INDEX_SIZE) - 1];
+static cli_command_stats_s g_cli_command_stats[MYNEWT_VAL(CLI_MAX_COMMANDS)];
+static uint32_t g_cli_stats_unknown_namespaces;
+
+/* Returns the histogram bucket of a duration: the index of its highest bit
+ * set, capped to the last bucket */
+static inline int cli_stats_bucket(uint32_t ticks)
+{
+	int bucket = 31 - __builtin_clz(ticks | 1);
+
+	return (bucket < CLI_STATS_BUCKETS) ? bucket : CLI_STATS_BUCKETS - 1;
+}
+
+static cli_command_stats_s * cli_stats_command(
+	const cli_namespace_s * namespace, int cmd_index)
+{
+	return &g_cli_command_stats[namespace->cmd_base + cmd_index];
+}
+
+static const cli_namespace_s * cli_stats_find_namespace(
+	const char * nmspc_name)
+{
+	const cli_namespace_s * namespace;
+	int id;
+
+	for(id = 0; (namespace = cli_namespace_from_id(id)) != NULL; id++)
+	{
+		if(!strcmp(namespace->name, nmspc_name))
+		{
+			return namespace;
+		}
+	}
+
+	return NULL;
+}
+
+static void cli_stats_print_hist(const cli_ctx_s * ctx, const char * name,
+	const uint32_t * hist)
+{
+	int i;
+
+	cli_printf(ctx, " %s=[", name);
+	for(i = 0; i < CLI_STATS_BUCKETS; i++)
+	{
+		if(hist[i] != 0)
+		{
+			cli_printf(ctx, " %d:%lu", i, (unsigned long)hist[i]);
+		}
+	}
+	cli_puts(ctx, " ]");
+}
+
+void cli_stats_lookup(const cli_namespace_s * namespace, int cmd_index,
+	uint32_t ticks)
+{
+	cli_namespace_stats_s * stats;
+
+	if(namespace == NULL)
+	{
+		g_cli_stats_unknown_namespaces++;
+		return;
+	}
+
+	stats = &g_cli_namespace_stats[namespace->id];
+	stats->lookups++;
+	stats->lookup_hist[cli_stats_bucket(ticks)]++;
+
+	if(cmd_index < 0)
+	{
+		stats->unknown++;
+	}
+	else
+	{
+		cli_stats_command(namespace, cmd_index)->invocations++;
+	}
+}
+
+void cli_stats_parse(const cli_namespace_s * namespace, int cmd_index, int rc,
+	uint32_t ticks)
+{
+	cli_command_stats_s * stats = cli_stats_command(namespace, cmd_index);
+
+	stats->parse_hist[cli_stats_bucket(ticks)]++;
+
+	// A request for help is not a failure
+	if((rc != CLI_ERROR_NONE) && (rc != CLI_ERROR_HELP_REQUESTED))
+	{
+		stats->parse_errors++;
+	}
+}
+
+void cli_stats_callback(const cli_namespace_s * namespace, int cmd_index,
+	int rc, uint32_t ticks)
+{
+	cli_command_stats_s * stats = cli_stats_command(namespace, cmd_index);
+
+	stats->cb_hist[cli_stats_bucket(ticks)]++;
+
+	if(rc != 0)
+	{
+		stats->cb_errors++;
+	}
+}
+
+int cli_stats_get_namespace(const char * nmspc_name,
+	cli_namespace_stats_s * stats)
+{
+	const cli_namespace_s * namespace;
+
+	namespace = cli_stats_find_namespace(nmspc_name);
+	if(namespace == NULL)
+	{
+		return SYS_ENOENT;
+	}
+
+	*stats = g_cli_namespace_stats[namespace->id];
+
+	return 0;
+}
+
+int cli_stats_get_command(const char * nmspc_name, const char * cmd_name,
+	cli_command_stats_s * stats)
+{
+	const cli_namespace_s * namespace;
+	uint8_t nmspc_id, cmd_id;
+	int rc;
+
+	rc = cli_namespace_get_ids(nmspc_name, cmd_name, &nmspc_id, &cmd_id);
+	if(rc != 0)
+	{
+		return rc;
+	}
+
+	namespace = cli_namespace_from_id(nmspc_id);
+	*stats = *cli_stats_command(namespace, cmd_id);
+
+	return 0;
+}
+
+void cli_stats_print(const cli_ctx_s * ctx)
+{
+	const cli_namespace_stats_s * ns_stats;
+	const cli_command_stats_s * stats;
+	const cli_namespace_s * namespace;
+	int id, i;
+
+	cli_printf(ctx, "unknown namespaces=%lu; bucket i: 2^i ticks of %lu Hz\n",
+		(unsigned long)g_cli_stats_unknown_namespaces,
+		(unsigned long)MYNEWT_VAL(OS_CPUTIME_FREQ));
+
+	for(id = 0; (namespace = cli_namespace_from_id(id)) != NULL; id++)
+	{
+		ns_stats = &g_cli_namespace_stats[id];
+		cli_printf(ctx, "%s lookups=%lu unknown=%lu", namespace->name,
+			(unsigned long)ns_stats->lookups, (unsigned long)ns_stats->unknown);
+		cli_stats_print_hist(ctx, "lookup", ns_stats->lookup_hist);
+		cli_puts(ctx, "\n");
+
+		for(i = 0; i < namespace->num_commands; i++)
+		{
+			stats = cli_stats_command(namespace, i);
+			if(stats->invocations == 0)
+			{
+				continue;
+			}
+
+			cli_printf(ctx, "\t%s n=%lu parse_errors=%lu cb_errors=%lu",
+				namespace->commands[i].name,
+				(unsigned long)stats->invocations,
+				(unsigned long)stats->parse_errors,
+				(unsigned long)stats->cb_errors);
+			cli_stats_print_hist(ctx, "parse", stats->parse_hist);
+			cli_stats_print_hist(ctx, "cb", stats->cb_hist);
+			cli_puts(ctx, "\n");
+		}
+	}
+}
+
+void cli_stats_reset(void)
+{
+	memset(g_cli_namespace_stats, 0, sizeof(g_cli_namespace_stats));
+	memset(g_cli_command_stats, 0, sizeof(g_cli_command_stats));
+	g_cli_stats_unknown_namespaces = 0;
+}
+
+#else
+
+int cli_stats_get_namespace(const char * nmspc_name,
+	cli_namespace_stats_s * stats)
+{
+	return SYS_ENOENT;
+}
+
+int cli_stats_get_command(const char * nmspc_name, const char * cmd_name,
+	cli_command_stats_s * stats)
+{
+	return SYS_ENOENT;
+}
+
+void cli_stats_print(const cli_ctx_s * ctx)
+{
+	cli_puts(ctx, "Statistics are disabled (CLI_STATS)\n");
+}
+
+void cli_stats_reset(void)
+{
+}
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * Streaming of bulk data to CLI commands
+ */
+
+#include <string.h>
+#include "defs/error.h"
+#include "os/os.h"
+#include "cli/cli_stream.h"
+#include "cli_priv.h"
+
+#define CLI_STREAM_CHUNK_SIZE 			MYNEWT_VAL(CLI_STREAM_CHUNK_SIZE)
+#define CLI_STREAM_CHUNKS 				MYNEWT_VAL(CLI_STREAM_CHUNKS)
+
+#if CLI_STREAM_CHUNK_SIZE > UINT16_MAX
+#error "CLI_STREAM_CHUNK_SIZE cannot exceed 65535"
+#endif
+
+/* State of the stream. The chunk buffers form a ring: count full chunks wait
+ * for the sink from tail on, and the chunk at head is being filled. The task
+ * feeding the stream owns the chunk at head and the sink owns the full
+ * chunks; they hand chunks over by updating head, tail and count with
+ * interrupts disabled */
+typedef struct
+{
+	bool 							open;			// The stream is receiving or consuming data
+	uint32_t 						size;			// Number of bytes of the stream
+	uint32_t 						received;		// Number of bytes fed
+	uint32_t 						consumed;		// Number of bytes passed to the sink
+	int 							rc;				// Error which ended the stream
+	cli_stream_sink_fn * 			sink;			// Consumer of the chunks
+	cli_stream_done_fn * 			done;			// Called once the stream ends
+	void * 							arg;			// Passed to sink and done
+	struct os_event 				ev;				// Event draining the chunks on the worker
+	uint8_t 						head;			// Chunk being filled
+	uint8_t 						tail;			// Oldest full chunk
+	uint8_t 						count;			// Number of full chunks
+	uint16_t 						len[CLI_STREAM_CHUNKS];	// Number of bytes in each chunk
+	uint8_t 						buf[CLI_STREAM_CHUNKS][CLI_STREAM_CHUNK_SIZE];
+} cli_stream_s;
+
+static cli_stream_s g_cli_stream;
+
+/* Passes the full chunks to the sink, then ends the stream if it is complete
+ * or failed. Runs on the worker event queue, or else on the feeding task */
+static void cli_stream_drain(cli_stream_s * stream)
+{
+	bool finish;
+	uint8_t chunk;
+	int count;
+	os_sr_t sr;
+	int rc;
+
+	for(;;)
+	{
+		OS_ENTER_CRITICAL(sr);
+		count = stream->count;
+		chunk = stream->tail;
+		rc = stream->rc;
+		OS_EXIT_CRITICAL(sr);
+
+		if(count == 0)
+		{
+			break;
+		}
+
+		// The chunks left once the stream failed are dropped
+		if(rc == 0)
+		{
+			rc = stream->sink(stream->arg, stream->buf[chunk],
+				stream->len[chunk]);
+			stream->consumed += stream->len[chunk];
+		}
+
+		stream->len[chunk] = 0;
+
+		OS_ENTER_CRITICAL(sr);
+		if((rc != 0) && (stream->rc == 0))
+		{
+			stream->rc = rc;
+		}
+		stream->tail = (chunk + 1) % CLI_STREAM_CHUNKS;
+		stream->count--;
+		OS_EXIT_CRITICAL(sr);
+	}
+
+	OS_ENTER_CRITICAL(sr);
+	finish = stream->open &&
+		((stream->rc != 0) || (stream->consumed == stream->size));
+	if(finish)
+	{
+		stream->open = false;
+	}
+	rc = stream->rc;
+	OS_EXIT_CRITICAL(sr);
+
+	if(finish && (stream->done != NULL))
+	{
+		stream->done(stream->arg, rc);
+	}
+}
+
+static void cli_stream_on_drain(struct os_event * ev)
+{
+	cli_stream_drain((cli_stream_s *)ev->ev_arg);
+}
+
+/* Has the sink drain the chunks */
+static void cli_stream_kick(cli_stream_s * stream)
+{
+	if(cli_job_enabled())
+	{
+		cli_job_post(&stream->ev);
+	}
+	else
+	{
+		cli_stream_drain(stream);
+	}
+}
+
+int cli_stream_open(uint32_t size, cli_stream_sink_fn * sink,
+	cli_stream_done_fn * done, void * arg)
+{
+	cli_stream_s * stream = &g_cli_stream;
+	os_sr_t sr;
+
+	if(size == 0)
+	{
+		return SYS_EINVAL;
+	}
+
+	// Chunks of a failed stream may still be waiting to be dropped
+	OS_ENTER_CRITICAL(sr);
+	if(stream->open || (stream->count != 0))
+	{
+		OS_EXIT_CRITICAL(sr);
+		return SYS_EBUSY;
+	}
+	stream->open = true;
+	OS_EXIT_CRITICAL(sr);
+
+	stream->size = size;
+	stream->received = 0;
+	stream->consumed = 0;
+	stream->rc = 0;
+	stream->sink = sink;
+	stream->done = done;
+	stream->arg = arg;
+	stream->head = 0;
+	stream->tail = 0;
+	memset(stream->len, 0, sizeof(stream->len));
+
+	// The event may still be on the worker queue after an abort
+	if(stream->ev.ev_cb == NULL)
+	{
+		stream->ev.ev_cb = cli_stream_on_drain;
+		stream->ev.ev_arg = stream;
+	}
+
+	return 0;
+}
+
+int cli_stream_feed(const uint8_t * data, uint16_t len)
+{
+	cli_stream_s * stream = &g_cli_stream;
+	uint32_t n;
+	uint16_t off = 0;
+	uint8_t chunk;
+	bool full;
+	os_sr_t sr;
+
+	if(stream->rc != 0)
+	{
+		return stream->rc;
+	}
+
+	if(!stream->open)
+	{
+		return SYS_EINVAL;
+	}
+
+	while((off < len) && (stream->received < stream->size) &&
+		(stream->rc == 0))
+	{
+		OS_ENTER_CRITICAL(sr);
+		full = (stream->count == CLI_STREAM_CHUNKS);
+		OS_EXIT_CRITICAL(sr);
+
+		if(full)
+		{
+			break;
+		}
+
+		chunk = stream->head;
+		n = CLI_STREAM_CHUNK_SIZE - stream->len[chunk];
+		if(n > (uint32_t)(len - off))
+		{
+			n = len - off;
+		}
+		if(n > stream->size - stream->received)
+		{
+			n = stream->size - stream->received;
+		}
+
+		memcpy(&stream->buf[chunk][stream->len[chunk]], &data[off], n);
+		stream->len[chunk] += n;
+		stream->received += n;
+		off += n;
+
+		// Hand the chunk over once full, or once it ends the stream
+		if((stream->len[chunk] == CLI_STREAM_CHUNK_SIZE) ||
+			(stream->received == stream->size))
+		{
+			OS_ENTER_CRITICAL(sr);
+			stream->head = (chunk + 1) % CLI_STREAM_CHUNKS;
+			stream->count++;
+			OS_EXIT_CRITICAL(sr);
+
+			cli_stream_kick(stream);
+		}
+	}
+
+	return off;
+}
+
+void cli_stream_abort(void)
+{
+	cli_stream_s * stream = &g_cli_stream;
+	os_sr_t sr;
+	bool open;
+
+	OS_ENTER_CRITICAL(sr);
+	open = stream->open;
+	if(open && (stream->rc == 0))
+	{
+		stream->rc = SYS_EIO;
+	}
+	OS_EXIT_CRITICAL(sr);
+
+	if(open)
+	{
+		cli_stream_kick(stream);
+	}
+}
+
+void cli_stream_get_info(cli_stream_info_s * info)
+{
+	cli_stream_s * stream = &g_cli_stream;
+	os_sr_t sr;
+
+	OS_ENTER_CRITICAL(sr);
+	info->open = stream->open;
+	info->size = stream->size;
+	info->received = stream->received;
+	info->consumed = stream->consumed;
+	info->rc = stream->rc;
+	OS_EXIT_CRITICAL(sr);
+}
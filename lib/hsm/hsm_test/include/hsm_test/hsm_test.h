@@ -11,6 +11,7 @@
 #include <inttypes.h>
 
 #include "hsm/hsm.h"
+#include "cli/cli_namespace.h"
 
 /** Test state machine */
 extern hsm_s hsm_test_sm;
@@ -23,7 +24,24 @@ typedef enum
     HSM_TEST_SIGNAL_FLOOP
 } hsm_test_signal_e;
 
-/** Register the CLI for the test state machine */
+/** Deepest hierarchy measured by hsm_test_bench */
+#define HSM_TEST_BENCH_MAX_DEPTH        16
+
+/** Initialize the test state machine. Called by hsm_test_cli_init */
+void hsm_test_sm_init(void);
+
+/** Set the CLI session the test state machine prints through, or NULL to
+ *  print to the console. Set by the CLI commands around each call, so that
+ *  the output follows the session and is silenced with it */
+void hsm_test_sm_set_ctx(const cli_ctx_s * ctx);
+
+/** Initialize the test state machine and register its CLI */
 void hsm_test_cli_init(void);
 
+/** Measure dispatch and transition costs of the hsm library with silent
+ *  states, and the throughput of producer tasks posting to a shared queue,
+ *  for each locking mode, and print one CSV line per result through the
+ *  session ctx */
+void hsm_test_bench(const cli_ctx_s * ctx, uint32_t iterations, int depth);
+
 #endif // __HSM_TEST_H__
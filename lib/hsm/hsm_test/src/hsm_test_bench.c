@@ -0,0 +1,855 @@
+
+#include <string.h>
+
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_queue.h"
+#include "hsm/hsm_snapshot.h"
+#include "hsm_test/hsm_test.h"
+#include "cli/cli_out.h"
+
+// =================================================================
+// ====================== BENCHMARK STATE MACHINE ==================
+// =================================================================
+
+/* The benchmark states do not print anything so that only the cost of the
+ * hsm library is measured. They form a single chain: bench_states[0] is the
+ * root and bench_states[depth - 1] is the leaf which is entered. Only the
+ * root handles HSM_TEST_BENCH_SIGNAL_BUBBLE, so every dispatch walks the
+ * whole hierarchy. The ping and pong states are used to measure transitions
+ * and the fault state to measure the return into the chain through history.
+ * The restore benchmark descends the chain one level per signal instead, and
+ * the stack benchmark leaves the chain for the away state from its root and
+ * returns to the leaf on every other signal.
+ * The tick and tock states toggle on each queued routine signal and record
+ * how long each urgent signal waited in the queue */
+
+enum hsm_test_bench_signals
+{
+    HSM_TEST_BENCH_SIGNAL_BUBBLE,
+    HSM_TEST_BENCH_SIGNAL_TOGGLE,
+    HSM_TEST_BENCH_SIGNAL_URGENT,
+    HSM_TEST_BENCH_SIGNAL_DESCEND,
+    HSM_TEST_BENCH_SIGNAL_COUNT
+};
+
+static int on_bench_root_signal(hsm_s * hsm, int signal);
+static int on_bench_child_signal(hsm_s * hsm, int signal);
+static int on_bench_descend_signal(hsm_s * hsm, int signal);
+static int on_bench_leave_signal(hsm_s * hsm, int signal);
+static int on_bench_away_signal(hsm_s * hsm, int signal);
+static int on_bench_ping_signal(hsm_s * hsm, int signal);
+static int on_bench_pong_signal(hsm_s * hsm, int signal);
+static int on_bench_tick_signal(hsm_s * hsm, int signal);
+static int on_bench_tock_signal(hsm_s * hsm, int signal);
+
+/** Session the results are printed through */
+static const cli_ctx_s * bench_ctx;
+
+/** Number of events raised at once by the batch benchmark */
+#define HSM_TEST_BENCH_BATCH_SIZE       16
+
+static hsm_state_s bench_states[HSM_TEST_BENCH_MAX_DEPTH];
+static hsm_event_s bench_batch[HSM_TEST_BENCH_BATCH_SIZE];
+/** Benchmark states indexed by hst_state_num, for hsm_restore */
+static const hsm_state_s * bench_state_table[HSM_TEST_BENCH_MAX_DEPTH];
+static uint8_t bench_snapshot[HSM_SNAPSHOT_MAX_LEN];
+static hsm_history_s bench_history[1];
+
+static hsm_state_s bench_state_history =
+{
+    .hst_parent = &bench_states[0],
+    .hst_history = HSM_HISTORY_DEEP,
+};
+
+static hsm_state_s bench_state_fault =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_child_signal,
+};
+
+static hsm_state_s bench_state_away =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_away_signal,
+};
+
+/** Leaf of the chain, to which the away state returns */
+static const hsm_state_s * bench_state_leaf;
+
+static hsm_state_s bench_state_ping =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_ping_signal,
+};
+
+static hsm_state_s bench_state_pong =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_pong_signal,
+};
+
+static hsm_state_s bench_state_tick =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_tick_signal,
+};
+
+static hsm_state_s bench_state_tock =
+{
+    .hst_parent = NULL,
+    .hst_on_signal = on_bench_tock_signal,
+};
+
+/** Number of urgent signals whose latency is recorded per result */
+#define HSM_TEST_BENCH_LATENCY_SAMPLES  256
+
+/** Queueing latency of the urgent signals, in os_cputime ticks */
+static uint32_t bench_latency[HSM_TEST_BENCH_LATENCY_SAMPLES];
+static uint32_t bench_latency_count;
+
+static int on_bench_root_signal(hsm_s * hsm, int signal)
+{
+    return signal == HSM_TEST_BENCH_SIGNAL_BUBBLE ? 0 : 1;
+}
+
+static int on_bench_child_signal(hsm_s * hsm, int signal)
+{
+    return 1;
+}
+
+/** Moves one level down the chain. Only raised while above the leaf */
+static int on_bench_descend_signal(hsm_s * hsm, int signal)
+{
+    hsm_transition(hsm, &bench_states[hsm_get_current_state(hsm) + 1]);
+    return 0;
+}
+
+static int on_bench_leave_signal(hsm_s * hsm, int signal)
+{
+    hsm_transition(hsm, &bench_state_away);
+    return 0;
+}
+
+static int on_bench_away_signal(hsm_s * hsm, int signal)
+{
+    hsm_transition(hsm, bench_state_leaf);
+    return 0;
+}
+
+static int on_bench_ping_signal(hsm_s * hsm, int signal)
+{
+    hsm_transition(hsm, &bench_state_pong);
+    return 0;
+}
+
+static int on_bench_pong_signal(hsm_s * hsm, int signal)
+{
+    hsm_transition(hsm, &bench_state_ping);
+    return 0;
+}
+
+/** Records the time spent in the queue by an urgent signal, posted with its
+ *  os_cputime as payload */
+static void hsm_test_bench_record_latency(hsm_s * hsm)
+{
+    uint32_t posted = (uint32_t)(uintptr_t)hsm_get_event(hsm)->he_data;
+
+    if (bench_latency_count < HSM_TEST_BENCH_LATENCY_SAMPLES)
+    {
+        bench_latency[bench_latency_count++] = os_cputime_get32() - posted;
+    }
+}
+
+static int on_bench_tick_signal(hsm_s * hsm, int signal)
+{
+    if (signal == HSM_TEST_BENCH_SIGNAL_URGENT)
+    {
+        hsm_test_bench_record_latency(hsm);
+    }
+    else
+    {
+        hsm_transition(hsm, &bench_state_tock);
+    }
+
+    return 0;
+}
+
+static int on_bench_tock_signal(hsm_s * hsm, int signal)
+{
+    if (signal == HSM_TEST_BENCH_SIGNAL_URGENT)
+    {
+        hsm_test_bench_record_latency(hsm);
+    }
+    else
+    {
+        hsm_transition(hsm, &bench_state_tick);
+    }
+
+    return 0;
+}
+
+// =================================================================
+// ====================== PRODUCER TASKS ===========================
+// =================================================================
+
+/* The producer tasks post signals to the queue of a shared state machine to
+ * measure the contention between tasks. They run below the priority of the
+ * benchmark task, so that it starts all of them before any of them runs. A
+ * producer which finds the queue full drains it itself */
+
+#define HSM_TEST_BENCH_PRODUCERS        MYNEWT_VAL(HSM_TEST_BENCH_PRODUCERS)
+#define HSM_TEST_BENCH_PRODUCER_STACK   OS_STACK_ALIGN(256)
+#define HSM_TEST_BENCH_QUEUE_SIZE       32
+
+typedef struct
+{
+    /** State machine to post to */
+    hsm_s *                 hbp_hsm;
+    /** Number of signals to post */
+    uint32_t                hbp_count;
+    /** Released by the benchmark task to start posting */
+    struct os_sem           hbp_start;
+    struct os_task          hbp_task;
+    os_stack_t              hbp_stack[HSM_TEST_BENCH_PRODUCER_STACK];
+} hsm_test_bench_producer_s;
+
+static hsm_test_bench_producer_s bench_producers[HSM_TEST_BENCH_PRODUCERS];
+/** Released by each producer once it has posted all of its signals */
+static struct os_sem bench_producers_done;
+static bool bench_producers_started;
+
+static hsm_event_s bench_queue_buf[HSM_TEST_BENCH_QUEUE_SIZE + 1];
+static hsm_queue_s bench_queue;
+
+/* Prioritized queue of the latency benchmark: routine signals fill the low
+ * level, urgent signals go to the high level */
+static hsm_event_s bench_queue_urgent[1];
+static hsm_event_s * bench_queue_pending[HSM_TEST_BENCH_SIGNAL_COUNT];
+static hsm_queue_level_s bench_queue_levels[2];
+
+static const hsm_signal_cfg_s bench_signal_cfg[HSM_TEST_BENCH_SIGNAL_COUNT] =
+{
+    [HSM_TEST_BENCH_SIGNAL_URGENT] =    { .hsc_prio = 1 },
+};
+
+static void hsm_test_bench_producer(void * arg)
+{
+    hsm_test_bench_producer_s * producer = arg;
+    uint32_t i;
+
+    for (;;)
+    {
+        os_sem_pend(&producer->hbp_start, OS_TIMEOUT_NEVER);
+
+        for (i = 0; i < producer->hbp_count; i++)
+        {
+            while (hsm_post(producer->hbp_hsm, HSM_TEST_BENCH_SIGNAL_BUBBLE,
+                    NULL) == OS_ENOMEM)
+            {
+                hsm_process(producer->hbp_hsm);
+            }
+        }
+
+        os_sem_release(&bench_producers_done);
+    }
+}
+
+/** Creates the producer tasks the first time they are needed */
+static void hsm_test_bench_start_producers(void)
+{
+    hsm_test_bench_producer_s * producer;
+    int p;
+
+    if (bench_producers_started)
+    {
+        return;
+    }
+
+    os_sem_init(&bench_producers_done, 0);
+
+    for (p = 0; p < HSM_TEST_BENCH_PRODUCERS; p++)
+    {
+        producer = &bench_producers[p];
+        os_sem_init(&producer->hbp_start, 0);
+        os_task_init(&producer->hbp_task, "hsm_bench", hsm_test_bench_producer,
+            producer, MYNEWT_VAL(HSM_TEST_BENCH_PRODUCER_PRIO) + p,
+            OS_WAIT_FOREVER, producer->hbp_stack,
+            HSM_TEST_BENCH_PRODUCER_STACK);
+    }
+
+    bench_producers_started = true;
+}
+
+// =================================================================
+// ====================== STACK TASK ===============================
+// =================================================================
+
+/* The stack task drives a state machine through transitions across the whole
+ * chain and measures the stack they use and the lock operations they cost.
+ * The unused part of its stack is filled with the OS stack pattern before
+ * each measurement, so that os_task_info_get reports the high-water mark of
+ * the measurement alone. It runs below the priority of the producers */
+
+#define HSM_TEST_BENCH_STACK_TASK_STACK OS_STACK_ALIGN(512)
+/** Words of the stack left unfilled below the current frame */
+#define HSM_TEST_BENCH_STACK_MARGIN     32
+
+#if MYNEWT_VAL(HSM_LOCK_COUNT)
+#define HSM_TEST_BENCH_LOCK_COUNT()     hsm_lock_count
+#else
+#define HSM_TEST_BENCH_LOCK_COUNT()     0
+#endif
+
+typedef struct
+{
+    /** Parameters of the measurement */
+    uint8_t                 hbs_flags;
+    int                     hbs_depth;
+    uint32_t                hbs_signals;
+    /** Lock operations of the measurement */
+    uint32_t                hbs_locks;
+    /** Stack used by the measurement, in bytes */
+    uint32_t                hbs_stack;
+    /** Released by the benchmark task to start a measurement */
+    struct os_sem           hbs_start;
+    /** Released by the stack task once the measurement is complete */
+    struct os_sem           hbs_done;
+    struct os_task          hbs_task;
+    os_stack_t              hbs_stack_buf[HSM_TEST_BENCH_STACK_TASK_STACK];
+} hsm_test_bench_stack_task_s;
+
+static void hsm_test_bench_build_chain(int depth);
+
+static hsm_test_bench_stack_task_s bench_stack_task;
+static bool bench_stack_task_started;
+static hsm_s bench_stack_hsm;
+
+/** Fills the stack of the current task with the OS stack pattern, from its
+ *  bottom to a margin below the current frame */
+static void hsm_test_bench_fill_stack(struct os_task * task)
+{
+    os_stack_t marker;
+    os_stack_t * top = &marker - HSM_TEST_BENCH_STACK_MARGIN;
+    os_stack_t * sp;
+
+    for (sp = task->t_stackbottom; sp < top; sp++)
+    {
+        *sp = OS_STACK_PATTERN;
+    }
+}
+
+static void hsm_test_bench_stack_measure(hsm_test_bench_stack_task_s * bst)
+{
+    struct os_task_info before;
+    struct os_task_info after;
+    uint32_t locks;
+    uint32_t i;
+
+    hsm_test_bench_build_chain(bst->hbs_depth);
+    bench_states[0].hst_on_signal = on_bench_leave_signal;
+    bench_state_leaf = &bench_states[bst->hbs_depth - 1];
+
+    // Initialized here so that this task owns the state machine
+    hsm_init_ext(&bench_stack_hsm, bench_state_leaf, NULL, NULL,
+        bst->hbs_flags);
+    hsm_enter(&bench_stack_hsm);
+
+    hsm_test_bench_fill_stack(&bst->hbs_task);
+    os_task_info_get(&bst->hbs_task, &before);
+    locks = HSM_TEST_BENCH_LOCK_COUNT();
+
+    for (i = 0; i < bst->hbs_signals; i++)
+    {
+        hsm_raise(&bench_stack_hsm, HSM_TEST_BENCH_SIGNAL_TOGGLE);
+    }
+
+    bst->hbs_locks = HSM_TEST_BENCH_LOCK_COUNT() - locks;
+    os_task_info_get(&bst->hbs_task, &after);
+    bst->hbs_stack = (after.oti_stkusage - before.oti_stkusage) *
+        sizeof(os_stack_t);
+
+    hsm_exit(&bench_stack_hsm);
+}
+
+static void hsm_test_bench_stack_task(void * arg)
+{
+    hsm_test_bench_stack_task_s * bst = arg;
+
+    for (;;)
+    {
+        os_sem_pend(&bst->hbs_start, OS_TIMEOUT_NEVER);
+        hsm_test_bench_stack_measure(bst);
+        os_sem_release(&bst->hbs_done);
+    }
+}
+
+/** Creates the stack task the first time it is needed */
+static void hsm_test_bench_start_stack_task(void)
+{
+    hsm_test_bench_stack_task_s * bst = &bench_stack_task;
+
+    if (bench_stack_task_started)
+    {
+        return;
+    }
+
+    os_sem_init(&bst->hbs_start, 0);
+    os_sem_init(&bst->hbs_done, 0);
+    os_task_init(&bst->hbs_task, "hsm_stack", hsm_test_bench_stack_task,
+        bst, MYNEWT_VAL(HSM_TEST_BENCH_PRODUCER_PRIO) +
+        HSM_TEST_BENCH_PRODUCERS, OS_WAIT_FOREVER, bst->hbs_stack_buf,
+        HSM_TEST_BENCH_STACK_TASK_STACK);
+
+    bench_stack_task_started = true;
+}
+
+// =================================================================
+// ====================== BENCHMARKS ===============================
+// =================================================================
+
+/** Prints one machine-readable result line:
+ *  bench,<name>,<flags>,<depth>,<iterations>,<usecs>,<signals per second> */
+static void hsm_test_bench_report(const char * name, uint8_t flags, int depth,
+        uint32_t iterations, uint32_t ticks)
+{
+    uint32_t usecs = os_cputime_ticks_to_usecs(ticks);
+    uint32_t rate = 0;
+
+    if (usecs != 0)
+    {
+        rate = (uint32_t)(((uint64_t)iterations * 1000000) / usecs);
+    }
+
+    cli_printf(bench_ctx, "bench,%s,0x%02x,%d,%lu,%lu,%lu\n", name, flags,
+        depth, (unsigned long)iterations, (unsigned long)usecs,
+        (unsigned long)rate);
+}
+
+/** Prints one machine-readable line comparing two ways of doing the same
+ *  work: bench,<name>,<flags>,<param>,<iterations>,<usecs>,<baseline usecs> */
+static void hsm_test_bench_report_pair(const char * name, uint8_t flags,
+        int param, uint32_t iterations, uint32_t ticks, uint32_t baseline)
+{
+    cli_printf(bench_ctx, "bench,%s,0x%02x,%d,%lu,%lu,%lu\n", name, flags,
+        param, (unsigned long)iterations,
+        (unsigned long)os_cputime_ticks_to_usecs(ticks),
+        (unsigned long)os_cputime_ticks_to_usecs(baseline));
+}
+
+static int hsm_test_bench_compare(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/** Prints one machine-readable latency line:
+ *  bench,<name>,<flags>,<backlog>,<samples>,<p99 usecs>,<max usecs> */
+static void hsm_test_bench_report_latency(const char * name, uint8_t flags,
+        int backlog)
+{
+    uint32_t p99;
+    uint32_t max;
+
+    if (bench_latency_count == 0)
+    {
+        return;
+    }
+
+    qsort(bench_latency, bench_latency_count, sizeof(bench_latency[0]),
+        hsm_test_bench_compare);
+    p99 = bench_latency[(bench_latency_count * 99) / 100];
+    max = bench_latency[bench_latency_count - 1];
+
+    cli_printf(bench_ctx, "bench,%s,0x%02x,%d,%lu,%lu,%lu\n", name, flags,
+        backlog, (unsigned long)bench_latency_count,
+        (unsigned long)os_cputime_ticks_to_usecs(p99),
+        (unsigned long)os_cputime_ticks_to_usecs(max));
+}
+
+/** Links the first depth benchmark states into a chain */
+static void hsm_test_bench_build_chain(int depth)
+{
+    int d;
+
+    for (d = 0; d < depth; d++)
+    {
+        memset(&bench_states[d], 0, sizeof(bench_states[d]));
+        bench_states[d].hst_parent = (d == 0) ? NULL : &bench_states[d - 1];
+        bench_states[d].hst_on_signal = (d == 0) ?
+            on_bench_root_signal : on_bench_child_signal;
+        bench_states[d].hst_state_num = d;
+    }
+}
+
+/** Raises iterations signals through the chain and returns the time taken,
+ *  in os_cputime ticks */
+static uint32_t hsm_test_bench_raise(uint8_t flags, int depth,
+        uint32_t iterations)
+{
+    hsm_s hsm;
+    uint32_t start;
+    uint32_t ticks;
+    uint32_t i;
+
+    hsm_test_bench_build_chain(depth);
+
+    hsm_init_ext(&hsm, &bench_states[depth - 1], NULL, NULL, flags);
+    hsm_enter(&hsm);
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_raise(&hsm, HSM_TEST_BENCH_SIGNAL_BUBBLE);
+    }
+    ticks = os_cputime_get32() - start;
+
+    hsm_exit(&hsm);
+
+    return ticks;
+}
+
+static void hsm_test_bench_dispatch(uint8_t flags, int depth,
+        uint32_t iterations)
+{
+    hsm_test_bench_report("dispatch", flags, depth, iterations,
+        hsm_test_bench_raise(flags, depth, iterations));
+}
+
+/** Raises iterations signals through the chain in owner-task mode, then with
+ *  the OS mutex, both with run-to-completion. The param column of the result
+ *  holds the depth */
+static void hsm_test_bench_owned(int depth, uint32_t iterations)
+{
+    uint32_t owned;
+
+    owned = hsm_test_bench_raise(HSM_F_OWNED | HSM_F_RTC, depth, iterations);
+    hsm_test_bench_report_pair("owned", HSM_F_OWNED | HSM_F_RTC, depth,
+        iterations, owned, hsm_test_bench_raise(HSM_F_RTC, depth, iterations));
+}
+
+/** Raises iterations signals through the chain in batches with
+ *  hsm_raise_batch, then one at a time with hsm_raise. The param column of
+ *  the result holds the batch size */
+static void hsm_test_bench_batch(uint8_t flags, int depth, uint32_t iterations)
+{
+    hsm_s hsm;
+    uint32_t start;
+    uint32_t batched;
+    uint32_t i;
+    int n;
+
+    hsm_test_bench_build_chain(depth);
+
+    for (n = 0; n < HSM_TEST_BENCH_BATCH_SIZE; n++)
+    {
+        bench_batch[n].he_signal = HSM_TEST_BENCH_SIGNAL_BUBBLE;
+        bench_batch[n].he_count = 1;
+        bench_batch[n].he_data = NULL;
+    }
+
+    hsm_init_ext(&hsm, &bench_states[depth - 1], NULL, NULL, flags);
+    hsm_enter(&hsm);
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i += n)
+    {
+        n = (iterations - i < HSM_TEST_BENCH_BATCH_SIZE) ?
+            (int)(iterations - i) : HSM_TEST_BENCH_BATCH_SIZE;
+        hsm_raise_batch(&hsm, bench_batch, n, NULL);
+    }
+    batched = os_cputime_get32() - start;
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_raise(&hsm, HSM_TEST_BENCH_SIGNAL_BUBBLE);
+    }
+    hsm_test_bench_report_pair("batch", flags, HSM_TEST_BENCH_BATCH_SIZE,
+        iterations, batched, os_cputime_get32() - start);
+
+    hsm_exit(&hsm);
+}
+
+static void hsm_test_bench_transition(uint8_t flags, uint32_t iterations)
+{
+    hsm_s hsm;
+    uint32_t start;
+    uint32_t i;
+
+    hsm_init_ext(&hsm, &bench_state_ping, NULL, NULL, flags);
+    hsm_enter(&hsm);
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_raise(&hsm, HSM_TEST_BENCH_SIGNAL_TOGGLE);
+    }
+    hsm_test_bench_report("transition", flags, 1, iterations,
+        os_cputime_get32() - start);
+
+    hsm_exit(&hsm);
+}
+
+/** Splits iterations posts of a signal between num_producers tasks. The
+ *  depth column of the result holds the number of producers */
+static void hsm_test_bench_contention(uint8_t flags, uint32_t iterations,
+        int num_producers)
+{
+    hsm_s hsm;
+    uint32_t start;
+    int p;
+
+    hsm_test_bench_start_producers();
+    hsm_test_bench_build_chain(1);
+
+    hsm_init_ext(&hsm, &bench_states[0], NULL, NULL, flags);
+    memset(&bench_queue, 0, sizeof(bench_queue));
+    bench_queue.hq_buf = bench_queue_buf;
+    bench_queue.hq_size = HSM_TEST_BENCH_QUEUE_SIZE;
+    hsm_queue_init(&hsm, &bench_queue, NULL);
+    hsm_enter(&hsm);
+
+    start = os_cputime_get32();
+    for (p = 0; p < num_producers; p++)
+    {
+        bench_producers[p].hbp_hsm = &hsm;
+        bench_producers[p].hbp_count = iterations / num_producers +
+            (p < iterations % num_producers ? 1 : 0);
+        os_sem_release(&bench_producers[p].hbp_start);
+    }
+
+    for (p = 0; p < num_producers; p++)
+    {
+        os_sem_pend(&bench_producers_done, OS_TIMEOUT_NEVER);
+    }
+    hsm_process(&hsm);
+
+    hsm_test_bench_report("post", flags, num_producers, iterations,
+        os_cputime_get32() - start);
+
+    hsm_exit(&hsm);
+}
+
+/** Measures how long an urgent signal waits in the queue behind a full
+ *  backlog of routine signals, each of which causes a transition. With
+ *  prioritized set, urgent signals use their own priority level; otherwise
+ *  they are queued after the backlog */
+static void hsm_test_bench_latency(uint8_t flags, uint32_t iterations,
+        bool prioritized)
+{
+    hsm_s hsm;
+    uint32_t i;
+    int n;
+
+    if (iterations > HSM_TEST_BENCH_LATENCY_SAMPLES)
+    {
+        iterations = HSM_TEST_BENCH_LATENCY_SAMPLES;
+    }
+
+    hsm_init_ext(&hsm, &bench_state_tick, NULL, NULL, flags);
+
+    memset(&bench_queue, 0, sizeof(bench_queue));
+    if (prioritized)
+    {
+        memset(bench_queue_levels, 0, sizeof(bench_queue_levels));
+        bench_queue_levels[0].hql_buf = bench_queue_buf;
+        bench_queue_levels[0].hql_size = HSM_TEST_BENCH_QUEUE_SIZE;
+        bench_queue_levels[0].hql_drop = HSM_QUEUE_DROP_OLDEST;
+        bench_queue_levels[1].hql_buf = bench_queue_urgent;
+        bench_queue_levels[1].hql_size = 1;
+        bench_queue.hq_levels = bench_queue_levels;
+        bench_queue.hq_num_levels = 2;
+        bench_queue.hq_sig_cfg = bench_signal_cfg;
+        bench_queue.hq_pending = bench_queue_pending;
+        bench_queue.hq_num_signals = HSM_TEST_BENCH_SIGNAL_COUNT;
+    }
+    else
+    {
+        bench_queue.hq_buf = bench_queue_buf;
+        bench_queue.hq_size = HSM_TEST_BENCH_QUEUE_SIZE + 1;
+    }
+    hsm_queue_init(&hsm, &bench_queue, NULL);
+    hsm_enter(&hsm);
+
+    bench_latency_count = 0;
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < HSM_TEST_BENCH_QUEUE_SIZE; n++)
+        {
+            hsm_post(&hsm, HSM_TEST_BENCH_SIGNAL_TOGGLE, NULL);
+        }
+
+        hsm_post(&hsm, HSM_TEST_BENCH_SIGNAL_URGENT,
+            (void *)(uintptr_t)os_cputime_get32());
+        hsm_process(&hsm);
+    }
+    hsm_test_bench_report_latency(prioritized ? "latency_prio" :
+        "latency_fifo", flags, HSM_TEST_BENCH_QUEUE_SIZE);
+
+    hsm_exit(&hsm);
+}
+
+/** Leaves the leaf of the chain for the fault state and returns to it, either
+ *  through the history of the root (one transition back) or by replaying
+ *  the transitions from the root down to the leaf, as done without history */
+static void hsm_test_bench_history(uint8_t flags, int depth,
+        uint32_t iterations, bool use_history)
+{
+    hsm_s hsm;
+    uint32_t start;
+    uint32_t i;
+    int d;
+
+    hsm_test_bench_build_chain(depth);
+    bench_states[0].hst_history_idx = 1;
+
+    hsm_init_ext(&hsm, &bench_states[depth - 1], NULL, NULL, flags);
+    hsm_set_history(&hsm, bench_history, 1);
+    hsm_enter(&hsm);
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_transition(&hsm, &bench_state_fault);
+
+        if (use_history)
+        {
+            hsm_transition(&hsm, &bench_state_history);
+        }
+        else
+        {
+            for (d = 0; d < depth; d++)
+            {
+                hsm_transition(&hsm, &bench_states[d]);
+            }
+        }
+    }
+    hsm_test_bench_report(use_history ? "history" : "replay", flags, depth,
+        iterations, os_cputime_get32() - start);
+
+    hsm_exit(&hsm);
+}
+
+/** Brings the state machine back into the leaf of the chain after a reset,
+ *  either from a snapshot (hsm_snapshot then hsm_restore with its entry
+ *  functions) or by entering it again and replaying the signals which led
+ *  down to the leaf. The param column of the result holds the depth */
+static void hsm_test_bench_restore(uint8_t flags, int depth,
+        uint32_t iterations)
+{
+    hsm_s hsm;
+    size_t len;
+    uint32_t start;
+    uint32_t restored;
+    uint32_t i;
+    int d;
+
+    hsm_test_bench_build_chain(depth);
+    for (d = 0; d < depth; d++)
+    {
+        bench_states[d].hst_on_signal = on_bench_descend_signal;
+        bench_state_table[d] = &bench_states[d];
+    }
+
+    hsm_init_ext(&hsm, &bench_states[0], NULL, NULL, flags);
+    hsm_enter(&hsm);
+    for (d = 1; d < depth; d++)
+    {
+        hsm_raise(&hsm, HSM_TEST_BENCH_SIGNAL_DESCEND);
+    }
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_snapshot(&hsm, bench_snapshot, sizeof(bench_snapshot), &len, 0);
+        hsm_exit(&hsm);
+        hsm_restore(&hsm, bench_state_table, depth, bench_snapshot, len,
+            HSM_RESTORE_F_ENTRY);
+    }
+    restored = os_cputime_get32() - start;
+
+    start = os_cputime_get32();
+    for (i = 0; i < iterations; i++)
+    {
+        hsm_exit(&hsm);
+        hsm_enter(&hsm);
+        for (d = 1; d < depth; d++)
+        {
+            hsm_raise(&hsm, HSM_TEST_BENCH_SIGNAL_DESCEND);
+        }
+    }
+    hsm_test_bench_report_pair("restore", flags, depth, iterations, restored,
+        os_cputime_get32() - start);
+
+    hsm_exit(&hsm);
+}
+
+/** Raises iterations signals, each of which exits or enters the whole chain,
+ *  from the stack task. The result holds the number of lock operations and
+ *  the stack used, in bytes, instead of timings:
+ *  bench,stack,<flags>,<depth>,<signals>,<lock operations>,<stack bytes> */
+static void hsm_test_bench_stack(uint8_t flags, int depth, uint32_t iterations)
+{
+    hsm_test_bench_stack_task_s * bst = &bench_stack_task;
+
+    hsm_test_bench_start_stack_task();
+
+    bst->hbs_flags = flags;
+    bst->hbs_depth = depth;
+    bst->hbs_signals = iterations;
+    os_sem_release(&bst->hbs_start);
+    os_sem_pend(&bst->hbs_done, OS_TIMEOUT_NEVER);
+
+    cli_printf(bench_ctx, "bench,stack,0x%02x,%d,%lu,%lu,%lu\n", flags, depth,
+        (unsigned long)iterations, (unsigned long)bst->hbs_locks,
+        (unsigned long)bst->hbs_stack);
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+void hsm_test_bench(const cli_ctx_s * ctx, uint32_t iterations, int depth)
+{
+    static const uint8_t modes[] = { 0, HSM_F_RTC, HSM_F_OWNED | HSM_F_RTC };
+    unsigned int m;
+    int p;
+
+    if ((depth < 1) || (depth > HSM_TEST_BENCH_MAX_DEPTH))
+    {
+        depth = HSM_TEST_BENCH_MAX_DEPTH;
+    }
+
+    bench_ctx = ctx;
+    cli_printf(bench_ctx, "bench,sizeof,hsm_s,%u\n",
+        (unsigned int)sizeof(hsm_s));
+    cli_printf(bench_ctx, "bench,sizeof,hsm_state_s,%u\n",
+        (unsigned int)sizeof(hsm_state_s));
+
+    for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        hsm_test_bench_dispatch(modes[m], 1, iterations);
+        hsm_test_bench_dispatch(modes[m], depth, iterations);
+        hsm_test_bench_batch(modes[m], depth, iterations);
+        hsm_test_bench_transition(modes[m], iterations);
+        hsm_test_bench_history(modes[m], depth, iterations, false);
+        hsm_test_bench_history(modes[m], depth, iterations, true);
+        hsm_test_bench_restore(modes[m], depth, iterations);
+        hsm_test_bench_stack(modes[m], depth, iterations);
+        hsm_test_bench_latency(modes[m], iterations, false);
+        hsm_test_bench_latency(modes[m], iterations, true);
+
+        // Producers share the state machine, which excludes owner-task mode
+        for (p = 1; (p <= HSM_TEST_BENCH_PRODUCERS) &&
+            !(modes[m] & HSM_F_OWNED); p++)
+        {
+            hsm_test_bench_contention(modes[m], iterations, p);
+        }
+    }
+
+    hsm_test_bench_owned(depth, iterations);
+}
@@ -2,7 +2,6 @@
 #include "hsm/hsm.h"
 #include "hsm_test/hsm_test.h"
 #include "console/console.h"
-#include "parse/parse.h"
 #include "cli/cli_namespace.h"
 
 /** hsm_test commands usage
@@ -12,6 +11,7 @@
  *      hsm flip
  *      hsm flop
  *      hsm floop
+ *      hsm bench [-d <depth>] <iterations>
  */
 
 #define NUM_ARGS_ENTER                  0
@@ -19,19 +19,22 @@
 #define NUM_ARGS_FLIP                   0
 #define NUM_ARGS_FLOP                   0
 #define NUM_ARGS_FLOOP                  0
+#define NUM_ARGS_BENCH                  1
 
 #define NUM_OPTS_ENTER                  0
 #define NUM_OPTS_EXIT                   0
 #define NUM_OPTS_FLIP                   0
 #define NUM_OPTS_FLOP                   0
 #define NUM_OPTS_FLOOP                  0
+#define NUM_OPTS_BENCH                  1
 
 /* Command Callbacks */
-static int on_enter(cli_command_s * cmd, char ** args);
-static int on_exit(cli_command_s * cmd, char ** args);
-static int on_flip(cli_command_s * cmd, char ** args);
-static int on_flop(cli_command_s * cmd, char ** args);
-static int on_floop(cli_command_s * cmd, char ** args);
+static int on_enter(cli_ctx_s * ctx, char ** args);
+static int on_exit(cli_ctx_s * ctx, char ** args);
+static int on_flip(cli_ctx_s * ctx, char ** args);
+static int on_flop(cli_ctx_s * ctx, char ** args);
+static int on_floop(cli_ctx_s * ctx, char ** args);
+static int on_bench(cli_ctx_s * ctx, char ** args);
 
 /* Help */
 const char hsm_test_help_dialog[] =
@@ -41,11 +44,28 @@ const char hsm_test_help_dialog[] =
     "\thsm flip\t\t- Raise the flip signal\n"
     "\thsm flop\t\t- Raise the flop signal\n"
     "\thsm floop\t\t- Raise the floop signal\n"
+    "\thsm bench [-d <depth>] <iterations>\n"
+    "\t\t\t\t- Measure dispatch and transition costs\n"
     "\n";
 
+static const cli_arg_type_s hsm_test_bench_depth_type = {
+    .type = CLI_ARG_T_UINT, .min = 1, .max = HSM_TEST_BENCH_MAX_DEPTH,
+};
+
+static const cli_arg_type_s hsm_test_bench_arg_types[NUM_ARGS_BENCH] = {
+    // iterations
+    { .type = CLI_ARG_T_UINT, .min = 1, .max = UINT32_MAX },
+};
+
+static cli_option_s hsm_test_bench_opts[NUM_OPTS_BENCH] = {
+    // name     value       has_arg     arg_value   arg_type
+    { 'd',      false,      true,       NULL,       &hsm_test_bench_depth_type },
+};
+
 static cli_command_s hsm_test_commands[] = {
     // name                 num_args                    num_options                 
-    // opt_list             cb
+    // opt_list             cb                          help
+    // flags                arg_types
     { "enter",              NUM_ARGS_ENTER,             NUM_OPTS_ENTER,
       NULL,                 on_enter,                   NULL },
     { "exit",               NUM_ARGS_EXIT,              NUM_OPTS_EXIT,
@@ -56,6 +76,9 @@ static cli_command_s hsm_test_commands[] = {
       NULL,                 on_flop,                    NULL },  
     { "floop",              NUM_ARGS_FLOOP,             NUM_OPTS_FLOOP,
       NULL,                 on_floop,                   NULL },
+    { "bench",              NUM_ARGS_BENCH,             NUM_OPTS_BENCH,
+      hsm_test_bench_opts,  on_bench,                   NULL,
+      CLI_CMD_F_ASYNC,      hsm_test_bench_arg_types },
     { NULL,                 0,                          0, 
       NULL,                 NULL,                       NULL },
 };
@@ -69,37 +92,62 @@ static cli_namespace_s hsm_test_namespace = {
 
 /* Command callback implementations */
 
-static int on_enter(cli_command_s * cmd, char ** args)
+static int on_enter(cli_ctx_s * ctx, char ** args)
 {
+    hsm_test_sm_set_ctx(ctx);
     hsm_enter(&hsm_test_sm);
+    hsm_test_sm_set_ctx(NULL);
     return 0;
 }
 
-static int on_exit(cli_command_s * cmd, char ** args)
+static int on_exit(cli_ctx_s * ctx, char ** args)
 {
+    hsm_test_sm_set_ctx(ctx);
     hsm_exit(&hsm_test_sm);
+    hsm_test_sm_set_ctx(NULL);
     return 0;
 }
 
-static int on_flip(cli_command_s * cmd, char ** args)
+static int on_flip(cli_ctx_s * ctx, char ** args)
 {
+    hsm_test_sm_set_ctx(ctx);
     hsm_raise(&hsm_test_sm, HSM_TEST_SIGNAL_FLIP);
+    hsm_test_sm_set_ctx(NULL);
     return 0;
 }
 
-static int on_flop(cli_command_s * cmd, char ** args)
+static int on_flop(cli_ctx_s * ctx, char ** args)
 {
+    hsm_test_sm_set_ctx(ctx);
     hsm_raise(&hsm_test_sm, HSM_TEST_SIGNAL_FLOP);
+    hsm_test_sm_set_ctx(NULL);
     return 0;
 }
 
-static int on_floop(cli_command_s * cmd, char ** args)
+static int on_floop(cli_ctx_s * ctx, char ** args)
 {
+    hsm_test_sm_set_ctx(ctx);
     hsm_raise(&hsm_test_sm, HSM_TEST_SIGNAL_FLOOP);
+    hsm_test_sm_set_ctx(NULL);
+    return 0;
+}
+
+static int on_bench(cli_ctx_s * ctx, char ** args)
+{
+    int depth = HSM_TEST_BENCH_MAX_DEPTH;
+
+    // The arguments were converted and range-checked by the CLI
+    if (cli_opt_found(ctx, 0))
+    {
+        depth = ctx->opt_values[0].u;
+    }
+
+    hsm_test_bench(ctx, ctx->values[0].u, depth);
     return 0;
 }
 
 void hsm_test_cli_init(void)
 {
+    hsm_test_sm_init();
     cli_namespace_register(&hsm_test_namespace);
 }
@@ -1,7 +1,10 @@
 
+#include <assert.h>
+
 #include "hsm_test/hsm_test.h"
 #include "hsm/hsm.h"
 #include "console/console.h"
+#include "cli/cli_out.h"
 
 // =================================================================
 // ====================== STATE DECLARATIONS =======================
@@ -69,12 +72,25 @@ hsm_state_s hsm_test_state_floop =
 static void on_hsm_test_enter(hsm_s * hsm);
 static void on_hsm_test_exit(hsm_s * hsm);
 
-hsm_s hsm_test_sm = 
+/** Initialized by hsm_test_sm_init */
+hsm_s hsm_test_sm;
+
+/** Session of the command driving the state machine, if any */
+static const cli_ctx_s * hsm_test_sm_ctx;
+
+/** Prints through the session driving the state machine, or to the console
+ *  when the state machine is driven from outside the CLI */
+static void hsm_test_sm_puts(const char * str)
 {
-    .h_top = &hsm_test_state_flip,
-    .h_on_entry = on_hsm_test_enter,
-    .h_on_exit = on_hsm_test_exit,
-};
+    if (hsm_test_sm_ctx != NULL)
+    {
+        cli_puts(hsm_test_sm_ctx, str);
+    }
+    else
+    {
+        console_printf("%s", str);
+    }
+}
 
 // =================================================================
 // ====================== STATE DEFINITIONS ========================
@@ -86,12 +102,12 @@ hsm_s hsm_test_sm =
 
 static void on_flip_enter(hsm_s * hsm)
 {
-    console_printf("You flipped\n");
+    hsm_test_sm_puts("You flipped\n");
 }
 
 static void on_flip_exit(hsm_s * hsm)
 {
-    console_printf("After flipping...\n");
+    hsm_test_sm_puts("After flipping...\n");
 }
 
 static int on_flip_signal(hsm_s * hsm, int signal)
@@ -99,7 +115,7 @@ static int on_flip_signal(hsm_s * hsm, int signal)
     switch (signal)
     {
         case HSM_TEST_SIGNAL_FLIP:
-            console_printf("Already flipped\n");
+            hsm_test_sm_puts("Already flipped\n");
         break;
 
         case HSM_TEST_SIGNAL_FLOP:
@@ -107,7 +123,7 @@ static int on_flip_signal(hsm_s * hsm, int signal)
         break;
 
         case HSM_TEST_SIGNAL_FLOOP:
-            console_printf("Can\'t floop until you flop\n");
+            hsm_test_sm_puts("Can\'t floop until you flop\n");
         break;
 
         default:
@@ -123,12 +139,12 @@ static int on_flip_signal(hsm_s * hsm, int signal)
 
 static void on_flop_enter(hsm_s * hsm)
 {
-    console_printf("You flopped\n");
+    hsm_test_sm_puts("You flopped\n");
 }
 
 static void on_flop_exit(hsm_s * hsm)
 {
-    console_printf("After flopping...\n");
+    hsm_test_sm_puts("After flopping...\n");
 }
 
 static int on_flop_signal(hsm_s * hsm, int signal)
@@ -140,7 +156,7 @@ static int on_flop_signal(hsm_s * hsm, int signal)
         break;
 
         case HSM_TEST_SIGNAL_FLOP:
-            console_printf("Already flopped\n");
+            hsm_test_sm_puts("Already flopped\n");
         break;
 
         case HSM_TEST_SIGNAL_FLOOP:
@@ -160,12 +176,12 @@ static int on_flop_signal(hsm_s * hsm, int signal)
 
 static void on_floop_enter(hsm_s * hsm)
 {
-    console_printf("You flooped\n");
+    hsm_test_sm_puts("You flooped\n");
 }
 
 static void on_floop_exit(hsm_s * hsm)
 {
-    console_printf("After flooping...\n");
+    hsm_test_sm_puts("After flooping...\n");
 }
 
 static int on_floop_signal(hsm_s * hsm, int signal)
@@ -177,7 +193,7 @@ static int on_floop_signal(hsm_s * hsm, int signal)
         break;
 
         case HSM_TEST_SIGNAL_FLOOP:
-            console_printf("Already flooped\n");
+            hsm_test_sm_puts("Already flooped\n");
         break;
 
         default:
@@ -193,12 +209,24 @@ static int on_floop_signal(hsm_s * hsm, int signal)
 
 static void on_hsm_test_enter(hsm_s * hsm)
 {
-    console_printf("Flip and flop, but don\'t floop until you flop\n");
+    hsm_test_sm_puts("Flip and flop, but don\'t floop until you flop\n");
 }
 
 static void on_hsm_test_exit(hsm_s * hsm)
 {
-    console_printf("Done with the flip, flop, floop\n");
+    hsm_test_sm_puts("Done with the flip, flop, floop\n");
 }
 
+void hsm_test_sm_set_ctx(const cli_ctx_s * ctx)
+{
+    hsm_test_sm_ctx = ctx;
+}
 
+void hsm_test_sm_init(void)
+{
+    int rc;
+
+    rc = hsm_init_ext(&hsm_test_sm, &hsm_test_state_flip, on_hsm_test_enter,
+        on_hsm_test_exit, HSM_F_RTC);
+    assert(rc == 0);
+}
@@ -8,6 +8,28 @@
  *  would, it should simply ignore the signal, allowing one of its parent states
  *  to handle the signal instead. A nested state may still choose to process a
  *  signal in a different way.
+ *
+ *  A composite state may record its history: the substate which was active
+ *  when it was last exited. Transitioning to one of its history pseudo-states
+ *  re-enters that substate directly. Sample definition:
+
+    static hsm_history_s motor_history[1];
+
+    static hsm_state_s motor_state_running = {
+        .hst_on_signal = on_running_signal,
+        .hst_history_idx = 1,
+    };
+
+    static hsm_state_s motor_state_running_history = {
+        .hst_parent = &motor_state_running,
+        .hst_history = HSM_HISTORY_DEEP,
+    };
+
+    hsm_set_history(&motor_sm, motor_history, 1);
+
+    // From the fault handler, once the fault is cleared
+    hsm_transition(hsm, &motor_state_running_history);
+
  *
  */
 
@@ -27,6 +49,14 @@
 typedef struct hsm_s hsm_s;
 /* Forward declaration of the hsm_state_s structure */
 typedef struct hsm_state_s hsm_state_s;
+/* Forward declaration of the hsm_event_s structure */
+typedef struct hsm_event_s hsm_event_s;
+/* Forward declaration of the hsm_queue_s structure (see hsm/hsm_queue.h) */
+typedef struct hsm_queue_s hsm_queue_s;
+/* Forward declaration of the hsm_shared_s structure (see hsm/hsm_pubsub.h) */
+typedef struct hsm_shared_s hsm_shared_s;
+/* Forward declaration of the hsm_region_s structure */
+typedef struct hsm_region_s hsm_region_s;
 
 typedef enum 
 {
@@ -34,6 +64,30 @@ typedef enum
     HSM_SIG_STATUS_NOT_HANDLED
 } hsm_sig_status_e;
 
+typedef enum
+{
+    /** Regular state */
+    HSM_HISTORY_NONE        =   0,
+    /** Pseudo-state re-entering the direct substate of its parent which was
+     *  active when the parent was last exited */
+    HSM_HISTORY_SHALLOW,
+    /** Pseudo-state re-entering the innermost state which was active when its
+     *  parent was last exited */
+    HSM_HISTORY_DEEP
+} hsm_history_e;
+
+/** Run-to-completion mode. A call to hsm_transition from within a signal
+ *  handler only records the destination state; the transition is performed
+ *  once the dispatch of the signal is complete. If a handler requests several
+ *  transitions, only the last one is performed */
+#define HSM_F_RTC                       0x01
+
+/** Owner-task mode. The state machine is only ever driven (entered, exited,
+ *  raised, processed, transitioned) from its owner task, so no OS lock is
+ *  taken. The owner is the task calling hsm_init_ext, unless changed with
+ *  hsm_set_owner. Enable HSM_OWNER_CHECK to assert the calling task */
+#define HSM_F_OWNED                     0x02
+
 /** @brief Function executed upon entry into a state or a state machine 
  *
  *  If defined by the state machine, the entry function is executed when the
@@ -73,6 +127,19 @@ typedef void (*hsm_exit_fn)(hsm_s * hsm);
  */
 typedef int (*hsm_signal_fn)(hsm_s * hsm, int signal);
 
+/** @brief Function called before a signal is dispatched to the state machine
+ *
+ *  Only signals raised, posted or published to the state machine from outside
+ *  of its handlers are reported; signals raised from within a handler are not.
+ *  The hook is called with the state machine lock held.
+ *
+ *  @param hsm          State machine about to process the event
+ *  @param event        Event about to be dispatched
+ *  @param arg          Argument given to hsm_set_dispatch_hook
+ */
+typedef void (*hsm_dispatch_hook_fn)(hsm_s * hsm, const hsm_event_s * event,
+        void * arg);
+
 /** Representation of a state in the hsm library */
 struct hsm_state_s
 {
@@ -86,6 +153,62 @@ struct hsm_state_s
     hsm_signal_fn           hst_on_signal;
     /** Enumeration attached to the state to be queried by external modules */
     int                     hst_state_num;
+    /** One of hsm_history_e. A history pseudo-state only needs hst_parent,
+     *  the composite state whose history it restores, which it must have */
+    uint8_t                 hst_history;
+    /** 1-based index of the entry of the history table of the state machine
+     *  recording the history of this state; 0 if it records no history */
+    uint8_t                 hst_history_idx;
+};
+
+/** History of a composite state, recorded when it is exited */
+typedef struct
+{
+    /** Direct substate which was active; NULL if never exited */
+    const hsm_state_s *     hh_shallow;
+    /** Innermost state which was active; NULL if never exited */
+    const hsm_state_s *     hh_deep;
+} hsm_history_s;
+
+/** A single signal occurrence as seen by the state handlers */
+struct hsm_event_s
+{
+    /** State-machine-specific signal value */
+    int                     he_signal;
+    /** Number of raised occurrences this event stands for. Always 1 unless
+     *  the signal was merged in the event queue (HSM_SIG_POLICY_MERGE) */
+    uint16_t                he_count;
+    /** Optional signal-specific payload */
+    void *                  he_data;
+    /** Reference held on he_data if it was published with a release
+     *  function; NULL otherwise. Managed by the hsm library */
+    hsm_shared_s *          he_shared;
+};
+
+/** Orthogonal region of a state machine
+ *
+ *  A region is an independent set of states which is active for as long as
+ *  its state machine is active. A signal is dispatched to the current state of
+ *  every region which declares it, then to the current state of the state
+ *  machine if no region handled it. A call to hsm_transition from a handler
+ *  of a region transitions that region only.
+ */
+struct hsm_region_s
+{
+    /** State entered by the region when the state machine is entered */
+    const hsm_state_s *     hr_top;
+    /** Signals processed by the region; other signals skip the region */
+    const int *             hr_signals;
+    /** Number of entries in hr_signals */
+    uint8_t                 hr_num_signals;
+
+    /** Current state of the region */
+    hsm_state_s *           hr_cur_state;
+    /** Destination recorded by hsm_transition during a run-to-completion
+     *  dispatch; valid if hr_transition_pending is set */
+    const hsm_state_s *     hr_next_state;
+    /** Indicates that hr_next_state is to be entered once the dispatch ends */
+    bool                    hr_transition_pending;
 };
 
 /** Representation of a hierarchical state machine */
@@ -99,10 +222,43 @@ struct hsm_s
     /** Optional function which is executed upon exit from the state machine */
     hsm_exit_fn             h_on_exit;
 
+    /** HSM_F_* flags selecting the behavior of the state machine */
+    uint8_t                 h_flags;
+
     /** Current state of the state machine */
     hsm_state_s *           h_cur_state;
-    /** Mutex to ensure thread safety of state machine operations */
+    /** Destination recorded by hsm_transition during a run-to-completion
+     *  dispatch; valid if h_transition_pending is set */
+    const hsm_state_s *     h_next_state;
+    /** Indicates that h_next_state is to be entered once the dispatch ends */
+    bool                    h_transition_pending;
+    /** Mutex to ensure thread safety of state machine operations. Unused in
+     *  owner-task mode (HSM_F_OWNED) */
     struct os_mutex         h_lock;
+    /** Only task allowed to drive the state machine in owner-task mode */
+    struct os_task *        h_owner;
+    /** Event currently being dispatched; NULL outside of a dispatch */
+    const hsm_event_s *     h_cur_event;
+    /** Optional event queue; NULL if signals are only raised synchronously */
+    hsm_queue_s *           h_queue;
+    /** Optional orthogonal regions */
+    hsm_region_s *          h_regions;
+    /** Number of entries in h_regions */
+    uint8_t                 h_num_regions;
+    /** Bitmap of the regions processing each signal, indexed by signal */
+    uint32_t *              h_region_map;
+    /** Number of entries in h_region_map */
+    uint16_t                h_region_map_len;
+    /** Optional history table, indexed by hst_history_idx - 1 */
+    hsm_history_s *         h_history;
+    /** Number of entries in h_history */
+    uint8_t                 h_num_history;
+    /** Region whose handlers are being run; NULL for the main states */
+    hsm_region_s *          h_cur_region;
+    /** Optional function called before each signal is dispatched */
+    hsm_dispatch_hook_fn    h_dispatch_hook;
+    /** Argument passed to h_dispatch_hook */
+    void *                  h_hook_arg;
 };
 
 // =================================================================
@@ -119,11 +275,68 @@ struct hsm_s
  *  @param exit         Optional implementation-specific exit function to call
  *                      when the state machine is exited
  *
+ *  Any queue, region, history table or hook attached to the state machine is
+ *  detached; they must be attached after the state machine is initialized.
+ *
  *  @return 0 on success, non-zero on failure
  */
 int hsm_init(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry, 
         hsm_exit_fn exit);
 
+/** @brief Initialize the state machine structure with non-default behavior.
+ *  Identical to hsm_init otherwise
+ *
+ *  @param hsm          State machine to initialize
+ *  @param top          State to enter when hsm_enter is called
+ *  @param entry        Optional implementation-specific entry function to call 
+ *                      when the state machine is entered
+ *  @param exit         Optional implementation-specific exit function to call
+ *                      when the state machine is exited
+ *  @param flags        HSM_F_* flags
+ *
+ *  @return 0 on success, non-zero on failure
+ */
+int hsm_init_ext(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry, 
+        hsm_exit_fn exit, uint8_t flags);
+
+/** @brief Change the task driving a state machine in owner-task mode
+ *  (HSM_F_OWNED). Must be called before the new owner starts using it
+ *
+ *  @param hsm          State machine to hand over
+ *  @param owner        New owner task
+ */
+void hsm_set_owner(hsm_s * hsm, struct os_task * owner);
+
+/** @brief Attach orthogonal regions to an inactive state machine
+ *
+ *  The membership of every signal is computed once here, so that dispatching
+ *  a signal only visits the regions which process it.
+ *
+ *  @param hsm          State machine owning the regions
+ *  @param regions      Regions, with hr_top and hr_signals populated
+ *  @param num_regions  Number of entries in regions; at most 32
+ *  @param region_map   Storage for the per-signal region bitmap
+ *  @param num_signals  Number of entries in region_map. Every signal declared
+ *                      by a region must be lower than num_signals
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine is active or the
+ *      regions are invalid
+ */
+int hsm_set_regions(hsm_s * hsm, hsm_region_s * regions, uint8_t num_regions,
+        uint32_t * region_map, uint16_t num_signals);
+
+/** @brief Attach a history table to an inactive state machine. All entries
+ *  are cleared
+ *
+ *  @param hsm          State machine recording the history
+ *  @param history      Table with one entry per state recording its history
+ *  @param num_history  Number of entries in history. Every hst_history_idx
+ *                      of the states must be at most num_history
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine is active
+ */
+int hsm_set_history(hsm_s * hsm, hsm_history_s * history, uint8_t num_history);
+
 /** @brief Allow the state machine to begin processing signals and (optionally)
  *  execute a state-machine-specific entry function
  *
@@ -146,15 +359,72 @@ void hsm_exit(hsm_s * hsm);
  */
 void hsm_raise(hsm_s * hsm, int signal);
 
+/** @brief Dispatch an event to the current state and, if it is not handled,
+ *  to each of its parents in turn
+ *
+ *  @param hsm          State machine to process the event
+ *  @param event        Event to dispatch. Remains accessible to the handlers
+ *                      through hsm_get_event for the duration of the dispatch
+ *
+ *  @return HSM_SIG_STATUS_HANDLED if a state handled the event,
+ *      HSM_SIG_STATUS_NOT_HANDLED otherwise (including if the state machine
+ *      is inactive)
+ */
+int hsm_dispatch(hsm_s * hsm, const hsm_event_s * event);
+
+/** @brief Dispatch several events in order under a single acquisition of the
+ *  state machine lock. Each event is processed to completion before the next
+ *  one is dispatched
+ *
+ *  @param hsm          State machine to process the events
+ *  @param events       Events to dispatch. he_count should be set to 1 and
+ *                      he_data may carry a payload for the handlers
+ *  @param num_events   Number of entries in events
+ *  @param results      Optional array of num_events entries which receives the
+ *                      HSM_SIG_STATUS_HANDLED / HSM_SIG_STATUS_NOT_HANDLED
+ *                      status of each event
+ *
+ *  @return Number of events dispatched. Less than num_events if the state
+ *      machine is (or becomes) inactive; the remaining events are reported
+ *      as not handled
+ */
+int hsm_raise_batch(hsm_s * hsm, const hsm_event_s * events, int num_events,
+        int * results);
+
+/** @brief Returns the event being dispatched. Intended to be called from
+ *  within a signal handler to access the payload or merge count of the signal
+ *
+ *  @param hsm          State machine to query
+ *
+ *  @return Event being dispatched or NULL outside of a dispatch
+ */
+const hsm_event_s * hsm_get_event(hsm_s * hsm);
+
 /** @brief Transition to a new state. The state being transitioned out of will
  *  execute its exit function and the state being transitioned into will
  *  execute its entry function (if applicable)
  *
+ *  If the state machine runs to completion (HSM_F_RTC) and this is called
+ *  from within one of its signal handlers, the transition is deferred until
+ *  the handler returns.
+ *
+ *  If dst is a history pseudo-state, the recorded substate of its parent is
+ *  entered instead, or the parent itself if it was never exited.
+ *
  *  @param hsm          State machine to perform the transition
- *  @param dst          Destination state
+ *  @param dst          Destination state or history pseudo-state
  */
 void hsm_transition(hsm_s * hsm, const hsm_state_s * dst);
 
+/** @brief Install or remove the dispatch hook of a state machine
+ *
+ *  @param hsm          State machine to observe
+ *  @param hook         Function called before each signal is dispatched, or
+ *                      NULL to remove the current hook
+ *  @param arg          Argument passed to the hook
+ */
+void hsm_set_dispatch_hook(hsm_s * hsm, hsm_dispatch_hook_fn hook, void * arg);
+
 /** @brief Queries the active/inactive status of the state machine
  *
  *  @param hsm          State machine to query
@@ -173,6 +443,23 @@ bool hsm_is_active(hsm_s * hsm);
  */
 int hsm_get_current_state(hsm_s * hsm);
 
+/** @brief Returns the state-machine-specific enumerated value associated with
+ *  the current state of one of its regions
+ *
+ *  @param hsm          State machine to query
+ *  @param region       Index of the region
+ *
+ *  @return Enumerated value associated with the current state of the region
+ *      or -1 if the state machine is inactive or the region does not exist.
+ */
+int hsm_get_region_state(hsm_s * hsm, int region);
+
+#if MYNEWT_VAL(HSM_LOCK_COUNT)
+/** Number of times a state machine lock was pended or released, across all
+ *  state machines. Not updated atomically; intended for benchmarks */
+extern uint32_t hsm_lock_count;
+#endif
+
 // =================================================================
 // ====================== EOF ======================================
 // =================================================================
@@ -0,0 +1,100 @@
+/**
+ *  @file   hsm_pubsub.h
+ *  @brief  Publish/subscribe delivery of signals to many state machines.
+ *
+ *  State machines subscribe to the signals they are interested in. A
+ *  published signal is posted (see hsm_queue.h) only to the queues of its
+ *  subscribers, so machines which ignore the signal pay nothing for it.
+ *
+ *  Subscriptions are kept as a bitmap of subscribers per signal. Published
+ *  signals therefore share a system-wide numbering from 0 to
+ *  HSM_PUBSUB_MAX_SIGNALS - 1.
+ *
+ *  A payload published with a release function is shared by all subscribers
+ *  and released once the last of them has processed (or discarded) it.
+ *
+ *  Subscribers whose queues are processed on the same event queue are
+ *  delivered as a batch: a publish schedules a single os_event per event
+ *  queue, which processes every subscriber with pending events in turn.
+ *
+ */
+
+#ifndef __HSM_PUBSUB_H__
+#define __HSM_PUBSUB_H__
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_queue.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+/** @brief Function called to release a published payload once every
+ *  subscriber has processed it
+ *
+ *  @param data         Payload given to hsm_publish
+ */
+typedef void (*hsm_release_fn)(void * data);
+
+/** Reference-counted payload shared by the subscribers of a published signal */
+struct hsm_shared_s
+{
+    /** Number of queued events referencing the payload; 0 if unused */
+    uint16_t                hs_refcnt;
+    /** Published payload */
+    void *                  hs_data;
+    /** Function called when the last reference is dropped */
+    hsm_release_fn          hs_release;
+};
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+/** @brief Subscribe a state machine to a published signal
+ *
+ *  The state machine must have an event queue (see hsm_queue_init). It will
+ *  be processed on the event queue given to hsm_queue_init, if any.
+ *
+ *  @param hsm          Subscribing state machine
+ *  @param signal       Signal to subscribe to
+ *
+ *  @return 0 on success, OS_EINVAL if the signal is out of range or the state
+ *      machine has no queue, OS_ENOMEM if the maximum number of subscribers
+ *      or event queues has been reached
+ */
+int hsm_subscribe(hsm_s * hsm, int signal);
+
+/** @brief Unsubscribe a state machine from a published signal
+ *
+ *  @param hsm          Subscribed state machine
+ *  @param signal       Signal to unsubscribe from
+ *
+ *  @return 0 on success, OS_EINVAL if the signal is out of range, OS_ENOENT
+ *      if the state machine is not a subscriber
+ */
+int hsm_unsubscribe(hsm_s * hsm, int signal);
+
+/** @brief Post a signal to every active subscriber
+ *
+ *  @param signal       Signal to publish
+ *  @param data         Optional payload, shared by all subscribers
+ *  @param release      Optional function called once every subscriber has
+ *                      processed the payload. Called before returning if
+ *                      there is no subscriber to deliver to
+ *
+ *  @return 0 on success, OS_EINVAL if the signal is out of range, OS_ENOMEM
+ *      if too many released payloads are in flight (the payload is not
+ *      released in that case)
+ */
+int hsm_publish(int signal, void * data, hsm_release_fn release);
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_PUBSUB_H__
@@ -0,0 +1,259 @@
+/**
+ *  @file   hsm_queue.h
+ *  @brief  Event queue for the hierarchical state machine.
+ *
+ *  Signals posted to a state machine are stored in a per-machine queue and
+ *  dispatched later, in order, by hsm_process. Posting only takes a short
+ *  critical section, and all queued events are dispatched under a single
+ *  acquisition of the state machine lock.
+ *
+ *  Each signal may be assigned a queueing policy:
+ *      - QUEUE:    every occurrence is queued and dispatched (default)
+ *      - COALESCE: while an occurrence is pending, newer occurrences replace
+ *                  its payload instead of being queued
+ *      - MERGE:    while an occurrence is pending, newer occurrences increment
+ *                  its he_count instead of being queued
+ *      - DEFER:    an occurrence that no active state handles is held back and
+ *                  dispatched again after the next state change
+ *
+ *  A queue may also be split into priority levels, each with its own
+ *  capacity and drop policy. hsm_process always dispatches the oldest event of
+ *  the highest non-empty level next, so an urgent signal never waits behind a
+ *  backlog of less urgent ones. Each signal is assigned a level by its
+ *  hsc_prio; level 0 is the least urgent.
+ *
+ *  All storage is provided by the application. Sample queue definition:
+
+    static hsm_event_s sensor_queue_buf[16];
+    static hsm_event_s sensor_queue_deferred[4];
+    static hsm_event_s * sensor_queue_pending[SENSOR_SIGNAL_COUNT];
+
+    static const hsm_signal_cfg_s sensor_signal_cfg[SENSOR_SIGNAL_COUNT] = {
+        [SENSOR_SIGNAL_UPDATED] =   { .hsc_policy = HSM_SIG_POLICY_COALESCE },
+        [SENSOR_SIGNAL_TICK] =      { .hsc_policy = HSM_SIG_POLICY_MERGE },
+        [SENSOR_SIGNAL_CALIBRATE] = { .hsc_policy = HSM_SIG_POLICY_DEFER },
+    };
+
+    static hsm_queue_s sensor_queue = {
+        .hq_buf = sensor_queue_buf,
+        .hq_size = 16,
+        .hq_deferred = sensor_queue_deferred,
+        .hq_deferred_size = 4,
+        .hq_sig_cfg = sensor_signal_cfg,
+        .hq_pending = sensor_queue_pending,
+        .hq_num_signals = SENSOR_SIGNAL_COUNT,
+    };
+
+    hsm_queue_init(&sensor_sm, &sensor_queue, os_eventq_dflt_get());
+
+ *  Sample prioritized queue definition (used in place of hq_buf / hq_size):
+
+    static hsm_event_s motor_queue_telemetry[32];
+    static hsm_event_s motor_queue_urgent[4];
+    static hsm_event_s * motor_queue_pending[MOTOR_SIGNAL_COUNT];
+
+    static hsm_queue_level_s motor_queue_levels[] = {
+        { .hql_buf = motor_queue_telemetry, .hql_size = 32,
+          .hql_drop = HSM_QUEUE_DROP_OLDEST },
+        { .hql_buf = motor_queue_urgent, .hql_size = 4,
+          .hql_drop = HSM_QUEUE_DROP_NEWEST },
+    };
+
+    static const hsm_signal_cfg_s motor_signal_cfg[MOTOR_SIGNAL_COUNT] = {
+        [MOTOR_SIGNAL_TELEMETRY] =  { .hsc_policy = HSM_SIG_POLICY_QUEUE },
+        [MOTOR_SIGNAL_ESTOP] =      { .hsc_prio = 1 },
+    };
+
+    static hsm_queue_s motor_queue = {
+        .hq_levels = motor_queue_levels,
+        .hq_num_levels = 2,
+        .hq_sig_cfg = motor_signal_cfg,
+        .hq_pending = motor_queue_pending,
+        .hq_num_signals = MOTOR_SIGNAL_COUNT,
+    };
+
+ *
+ */
+
+#ifndef __HSM_QUEUE_H__
+#define __HSM_QUEUE_H__
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+typedef enum
+{
+    HSM_SIG_POLICY_QUEUE    =   0,
+    HSM_SIG_POLICY_COALESCE,
+    HSM_SIG_POLICY_MERGE,
+    HSM_SIG_POLICY_DEFER
+} hsm_sig_policy_e;
+
+/** Behavior of a full priority level when an event is posted to it */
+typedef enum
+{
+    /** Reject the new event (hsm_post fails with OS_ENOMEM) */
+    HSM_QUEUE_DROP_NEWEST   =   0,
+    /** Discard the oldest event of the level to make room for the new one */
+    HSM_QUEUE_DROP_OLDEST
+} hsm_queue_drop_e;
+
+/** Queueing configuration of a single signal */
+typedef struct
+{
+    /** One of hsm_sig_policy_e */
+    uint8_t                 hsc_policy;
+    /** Priority level of the signal; 0 is the least urgent. Clipped to the
+     *  most urgent level of the queue */
+    uint8_t                 hsc_prio;
+} hsm_signal_cfg_s;
+
+/** Priority level of an event queue */
+typedef struct
+{
+    /** Ring buffer storage for pending events of this level */
+    hsm_event_s *           hql_buf;
+    /** Number of events in hql_buf */
+    uint16_t                hql_size;
+    /** One of hsm_queue_drop_e */
+    uint8_t                 hql_drop;
+
+    /** Index of the oldest pending event in hql_buf */
+    uint16_t                hql_head;
+    /** Number of pending events in hql_buf */
+    uint16_t                hql_count;
+    /** Largest number of events pending at once */
+    uint16_t                hql_high_water;
+    /** Number of events dropped by this level */
+    uint32_t                hql_dropped;
+} hsm_queue_level_s;
+
+/** Queue counters. Dispatches saved = hqs_coalesced + hqs_merged */
+typedef struct
+{
+    /** Number of successful hsm_post calls */
+    uint32_t                hqs_posted;
+    /** Number of events dispatched from the queue (including recalls) */
+    uint32_t                hqs_dispatched;
+    /** Number of posts absorbed by a pending event (HSM_SIG_POLICY_COALESCE) */
+    uint32_t                hqs_coalesced;
+    /** Number of posts absorbed by a pending event (HSM_SIG_POLICY_MERGE) */
+    uint32_t                hqs_merged;
+    /** Number of events held back because no active state handled them */
+    uint32_t                hqs_deferred;
+    /** Number of deferred events handled after a state change */
+    uint32_t                hqs_recalled;
+    /** Number of events lost because the queue or deferral buffer was full */
+    uint32_t                hqs_dropped;
+} hsm_queue_stats_s;
+
+/** Event queue attached to a state machine */
+struct hsm_queue_s
+{
+    /** Ring buffer storage for pending events of a queue with a single
+     *  priority level. Ignored if hq_levels is provided */
+    hsm_event_s *           hq_buf;
+    /** Number of events in hq_buf */
+    uint16_t                hq_size;
+    /** Optional priority levels, from least to most urgent */
+    hsm_queue_level_s *     hq_levels;
+    /** Number of entries in hq_levels; at most 32 */
+    uint8_t                 hq_num_levels;
+    /** Optional storage for deferred events; required by HSM_SIG_POLICY_DEFER */
+    hsm_event_s *           hq_deferred;
+    /** Number of events in hq_deferred */
+    uint16_t                hq_deferred_size;
+    /** Optional per-signal configuration, indexed by signal value. Signals
+     *  without a configuration use HSM_SIG_POLICY_QUEUE */
+    const hsm_signal_cfg_s *hq_sig_cfg;
+    /** Per-signal pointer to the pending event, indexed by signal value.
+     *  Required if hq_sig_cfg is given */
+    hsm_event_s **          hq_pending;
+    /** Number of entries in hq_sig_cfg and hq_pending */
+    uint16_t                hq_num_signals;
+
+    /** Bitmap of the levels holding pending events */
+    uint32_t                hq_ready;
+    /** Level built from hq_buf / hq_size if hq_levels is not provided */
+    hsm_queue_level_s       hq_default_level;
+    /** Number of deferred events in hq_deferred */
+    uint16_t                hq_deferred_count;
+    /** Counters */
+    hsm_queue_stats_s       hq_stats;
+    /** Event used to schedule hsm_process on the owning event queue */
+    struct os_event         hq_ev;
+    /** Optional event queue on which hsm_process is scheduled after a post */
+    struct os_eventq *      hq_evq;
+};
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+/** @brief Initialize an event queue and attach it to a state machine
+ *
+ *  The storage fields of the queue (hq_buf through hq_num_signals, and the
+ *  hql_buf, hql_size and hql_drop fields of the levels) must be populated by
+ *  the caller; the remaining fields are reset.
+ *
+ *  @param hsm          State machine to attach the queue to
+ *  @param queue        Queue to initialize
+ *  @param evq          Optional event queue. If provided, hsm_process is
+ *                      scheduled on it whenever a signal is posted. Otherwise
+ *                      the application is responsible for calling hsm_process
+ *
+ *  @return 0 on success, OS_EINVAL if the queue storage is invalid
+ */
+int hsm_queue_init(hsm_s * hsm, hsm_queue_s * queue, struct os_eventq * evq);
+
+/** @brief Post a signal to the event queue of a state machine. May be called
+ *  from any task or from an interrupt
+ *
+ *  @param hsm          State machine to process the signal
+ *  @param signal       State-machine-specific signal value
+ *  @param data         Optional signal-specific payload
+ *
+ *  @return 0 on success (including when the signal was coalesced or merged,
+ *      or when an older event was dropped to make room), OS_EINVAL if the
+ *      state machine has no queue or is inactive, OS_ENOMEM if the priority
+ *      level of the signal is full and drops the newest events
+ */
+int hsm_post(hsm_s * hsm, int signal, void * data);
+
+/** @brief Dispatch all events pending in the queue of a state machine, most
+ *  urgent level first and in the order they were posted within a level. If
+ *  the state machine is inactive, the pending events are discarded
+ *
+ *  @param hsm          State machine to process the events
+ *
+ *  @return Number of events dispatched
+ */
+int hsm_process(hsm_s * hsm);
+
+/** @brief Discard all pending and deferred events
+ *
+ *  @param hsm          State machine owning the queue
+ */
+void hsm_queue_flush(hsm_s * hsm);
+
+/** @brief Returns the counters of the queue of a state machine
+ *
+ *  @param hsm          State machine to query
+ *  @param stats        Copy of the counters
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine has no queue
+ */
+int hsm_queue_get_stats(hsm_s * hsm, hsm_queue_stats_s * stats);
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_QUEUE_H__
@@ -0,0 +1,138 @@
+/**
+ *  @file   hsm_record.h
+ *  @brief  Recording and replay of the signal stream of a state machine.
+ *
+ *  The recorder captures every signal dispatched to a state machine from
+ *  outside of its handlers, along with its os_cputime timestamp, into a
+ *  compact binary stream. Payloads are not recorded.
+ *
+ *  The player feeds a recording back into a state machine built from the same
+ *  state definitions (typically on the host simulator), either as fast as
+ *  possible or with the original timing, and reports the time spent in the
+ *  handlers and whether the state machine ended in the recorded final state.
+ *
+ *  Stream format (little endian, varint = unsigned LEB128):
+ *      header:     magic u16, version u8, reserved u8, cputime frequency u32,
+ *                  initial state number (zigzag varint)
+ *      event:      varint (delta_ticks << 2 | HSM_RECORD_TAG_EVENT),
+ *                  signal (zigzag varint)
+ *      counted:    varint (delta_ticks << 2 | HSM_RECORD_TAG_COUNTED),
+ *                  signal (zigzag varint), count (varint)
+ *      end:        varint (delta_ticks << 2 | HSM_RECORD_TAG_END),
+ *                  final state number (zigzag varint)
+ *
+ */
+
+#ifndef __HSM_RECORD_H__
+#define __HSM_RECORD_H__
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+#define HSM_RECORD_TAG_EVENT            0
+#define HSM_RECORD_TAG_COUNTED          1
+#define HSM_RECORD_TAG_END              2
+
+/** Dispatch the recorded signals with their original spacing in time */
+#define HSM_REPLAY_F_TIMED              0x01
+
+/** Recorder attached to a state machine */
+typedef struct
+{
+    /** Destination of the recording */
+    uint8_t *               hr_buf;
+    /** Size of hr_buf */
+    uint32_t                hr_size;
+    /** Number of bytes recorded */
+    uint32_t                hr_len;
+    /** Number of signals recorded */
+    uint32_t                hr_events;
+    /** Number of signals which did not fit in hr_buf */
+    uint32_t                hr_dropped;
+    /** os_cputime of the last record */
+    uint32_t                hr_last_ticks;
+    /** Indicates that the recorder is installed on its state machine */
+    bool                    hr_active;
+} hsm_recorder_s;
+
+/** Results of a replay */
+typedef struct
+{
+    /** Number of signals dispatched */
+    uint32_t                hrp_events;
+    /** Number of signals handled by a state */
+    uint32_t                hrp_handled;
+    /** Total os_cputime ticks spent dispatching */
+    uint32_t                hrp_dispatch_ticks;
+    /** Longest single dispatch, in os_cputime ticks */
+    uint32_t                hrp_max_dispatch_ticks;
+    /** Final state number found in the recording */
+    int                     hrp_expected_state;
+    /** State number of the state machine after the replay */
+    int                     hrp_final_state;
+} hsm_replay_stats_s;
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+/** @brief Start recording the signals dispatched to a state machine
+ *
+ *  Installs the dispatch hook of the state machine (see
+ *  hsm_set_dispatch_hook).
+ *
+ *  @param hsm          Active state machine to record
+ *  @param rec          Recorder to use
+ *  @param buf          Destination of the recording
+ *  @param size         Size of buf
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine is inactive,
+ *      OS_ENOMEM if buf cannot hold the header and end records
+ */
+int hsm_record_start(hsm_s * hsm, hsm_recorder_s * rec, uint8_t * buf,
+        uint32_t size);
+
+/** @brief Stop recording and terminate the recording with the current state
+ *  of the state machine
+ *
+ *  @param hsm          Recorded state machine
+ *  @param rec          Recorder given to hsm_record_start
+ *
+ *  Does nothing if hsm_record_start failed or the recording was already
+ *  stopped.
+ *
+ *  @return Length of the recording in bytes, or 0 if nothing was recorded
+ */
+uint32_t hsm_record_stop(hsm_s * hsm, hsm_recorder_s * rec);
+
+/** @brief Replay a recording into a state machine
+ *
+ *  The state machine must be active and in the initial state of the
+ *  recording (see hsm_restore).
+ *
+ *  @param hsm          State machine to replay into
+ *  @param buf          Recording
+ *  @param len          Length of the recording
+ *  @param flags        HSM_REPLAY_F_* flags
+ *  @param stats        Results of the replay
+ *
+ *  @return 0 if the replay completed and the state machine ended in the
+ *      recorded final state, OS_EINVAL if the recording is malformed or the
+ *      state machine is not in the recorded initial state, OS_ERROR if the
+ *      final state differs from the recording
+ */
+int hsm_replay(hsm_s * hsm, const uint8_t * buf, uint32_t len, uint8_t flags,
+        hsm_replay_stats_s * stats);
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_RECORD_H__
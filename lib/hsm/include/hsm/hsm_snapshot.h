@@ -0,0 +1,107 @@
+/**
+ *  @file   hsm_snapshot.h
+ *  @brief  Snapshot and restore of the state of a hierarchical state machine.
+ *
+ *  A snapshot is a compact, self-checking binary record of the active state
+ *  of a state machine and of each of its regions, identified by their
+ *  hst_state_num, and optionally of its history table (see hsm_set_history).
+ *  It is intended to be kept in retained RAM or flash across a reset so that,
+ *  on boot, the state machine can be brought straight back to its previous
+ *  state instead of replaying the signals which led to it.
+ *
+ *  Restoring requires a table of the states of the state machine, indexed by
+ *  hst_state_num:
+
+    static const hsm_state_s * const sensor_states[] = {
+        [SENSOR_STATE_IDLE] =       &sensor_state_idle,
+        [SENSOR_STATE_SAMPLING] =   &sensor_state_sampling,
+    };
+
+    static uint8_t sensor_snapshot[HSM_SNAPSHOT_MAX_LEN]
+        __attribute__((section(".noinit")));
+
+    if (hsm_restore(&sensor_sm, sensor_states, 2, sensor_snapshot,
+            sizeof(sensor_snapshot), HSM_RESTORE_F_ENTRY) != 0)
+    {
+        hsm_enter(&sensor_sm);
+    }
+
+ *
+ */
+
+#ifndef __HSM_SNAPSHOT_H__
+#define __HSM_SNAPSHOT_H__
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+/** Largest size of a snapshot record */
+#define HSM_SNAPSHOT_MAX_LEN            (13 + \
+    8 * MYNEWT_VAL(HSM_SNAPSHOT_MAX_HISTORY) + \
+    4 * MYNEWT_VAL(HSM_SNAPSHOT_MAX_REGIONS))
+
+/** Include the history table of the state machine, if it has one, so that
+ *  history pseudo-states resume as they would have without the reset */
+#define HSM_SNAPSHOT_F_HISTORY          0x01
+
+/** Run the state machine entry function and the entry function of the
+ *  restored state, as hsm_enter would */
+#define HSM_RESTORE_F_ENTRY             0x01
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+/** @brief Serialize the active state of a state machine
+ *
+ *  @param hsm          State machine to snapshot
+ *  @param buf          Destination of the record
+ *  @param len          Size of buf; at least HSM_SNAPSHOT_MAX_LEN
+ *  @param out_len      Length of the record written to buf
+ *  @param flags        HSM_SNAPSHOT_F_* flags
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine is inactive,
+ *      OS_ENOMEM if buf is too small, the history table has more than
+ *      HSM_SNAPSHOT_MAX_HISTORY entries or the state machine has more than
+ *      HSM_SNAPSHOT_MAX_REGIONS regions
+ */
+int hsm_snapshot(hsm_s * hsm, uint8_t * buf, size_t len, size_t * out_len,
+        uint8_t flags);
+
+/** @brief Activate a state machine directly in the state recorded by
+ *  hsm_snapshot, without dispatching any signal
+ *
+ *  @param hsm          Inactive state machine to restore
+ *  @param states       States of the state machine, indexed by hst_state_num
+ *  @param num_states   Number of entries in states
+ *  @param buf          Snapshot record
+ *  @param len          Length of buf
+ *  @param flags        HSM_RESTORE_F_* flags. Without HSM_RESTORE_F_ENTRY, no
+ *                      entry function is executed
+ *
+ *  The regions of the state machine are restored in their recorded states,
+ *  or enter their hr_top state if the record holds no region.
+ *  If the record holds a history table, it replaces the history table of the
+ *  state machine, which must have been attached with the same number of
+ *  entries. Otherwise the history table is left as is.
+ *
+ *  @return 0 on success, OS_EINVAL if the state machine is already active or
+ *      the record is invalid (bad checksum, unknown state, history table or
+ *      regions of a different size than those attached); the state machine
+ *      is left inactive on failure
+ */
+int hsm_restore(hsm_s * hsm, const hsm_state_s * const * states,
+        int num_states, const uint8_t * buf, size_t len, uint8_t flags);
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_SNAPSHOT_H__
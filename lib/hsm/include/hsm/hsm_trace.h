@@ -0,0 +1,53 @@
+/**
+ *  @file   hsm_trace.h
+ *  @brief  Binary trace of the state machines, for the native (simulator) BSP.
+ *
+ *  While a trace file is open, every dispatch, transition, exit and entry of
+ *  every state machine is written as a fixed-size record (see
+ *  hsm/hsm_trace_format.h) into a preallocated, memory-mapped file. Each task
+ *  is given its own segment of the file on its first record, so recording
+ *  takes no lock. The file is decoded offline by tools/hsm_trace_decode.c.
+ *
+ *  Requires HSM_TRACE; the trace points compile to nothing otherwise.
+ *
+ */
+
+#ifndef __HSM_TRACE_H__
+#define __HSM_TRACE_H__
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_trace_format.h"
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+/** @brief Create a trace file and start tracing all state machines
+ *
+ *  @param path         File to create (or truncate)
+ *  @param seg_records  Number of records in the segment of each task; the
+ *                      file holds HSM_TRACE_MAX_SEGMENTS segments
+ *
+ *  @return 0 on success, OS_EINVAL if a trace is already open or seg_records
+ *      is 0, OS_ERROR if the file cannot be created or mapped
+ */
+int hsm_trace_open(const char * path, uint32_t seg_records);
+
+/** @brief Stop tracing and write the trace file to disk
+ *
+ *  No state machine may be running while the trace is closed.
+ *
+ *  @return 0 on success, OS_EINVAL if no trace is open, OS_ERROR if the file
+ *      could not be written
+ */
+int hsm_trace_close(void);
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_TRACE_H__
@@ -0,0 +1,104 @@
+/**
+ *  @file   hsm_trace_format.h
+ *  @brief  Layout of the binary trace file written by hsm_trace.
+ *
+ *  Kept free of any OS dependency so that offline tools can read trace files.
+ *  All fields are in the byte order of the host which wrote the file.
+ *
+ *  File layout:
+ *      hsm_trace_file_hdr_s
+ *      htf_num_segments times:
+ *          hsm_trace_seg_hdr_s
+ *          htf_seg_records times hsm_trace_rec_s
+ *
+ *  Each segment is written by a single task. Once htf_seg_records records
+ *  have been written to a segment, the oldest records are overwritten; the
+ *  oldest record still present is then at index
+ *  hts_written % htf_seg_records.
+ *
+ */
+
+#ifndef __HSM_TRACE_FORMAT_H__
+#define __HSM_TRACE_FORMAT_H__
+
+#include <inttypes.h>
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+#define HSM_TRACE_MAGIC                 0x544D5348
+#define HSM_TRACE_VERSION               1
+
+/** Length of hts_task, including the terminating NUL */
+#define HSM_TRACE_TASK_NAME_LEN         24
+
+typedef enum
+{
+    /** A signal is dispatched. htr_state: current state, htr_arg: signal */
+    HSM_TRACE_DISPATCH      =   0,
+    /** A transition starts. htr_state: source state, htr_arg: destination
+     *  state (after resolving history) */
+    HSM_TRACE_TRANSITION,
+    /** A state is exited. htr_state: exited state */
+    HSM_TRACE_EXIT,
+    /** A state is entered. htr_state: entered state */
+    HSM_TRACE_ENTRY
+} hsm_trace_type_e;
+
+/** Header of a trace file */
+typedef struct
+{
+    /** HSM_TRACE_MAGIC */
+    uint32_t                htf_magic;
+    /** HSM_TRACE_VERSION */
+    uint16_t                htf_version;
+    /** sizeof(hsm_trace_rec_s) */
+    uint16_t                htf_rec_size;
+    /** Frequency of the os_cputime timestamps, in Hz */
+    uint32_t                htf_cputime_freq;
+    /** Number of segments in the file */
+    uint16_t                htf_num_segments;
+    /** Number of segments assigned to a task */
+    uint16_t                htf_used_segments;
+    /** Number of records per segment */
+    uint32_t                htf_seg_records;
+    /** Number of records lost because every segment was assigned */
+    uint32_t                htf_dropped;
+} hsm_trace_file_hdr_s;
+
+/** Header of a segment */
+typedef struct
+{
+    /** Name of the task writing the segment */
+    char                    hts_task[HSM_TRACE_TASK_NAME_LEN];
+    /** Total number of records written to the segment */
+    uint32_t                hts_written;
+    /** Reserved; 0 */
+    uint32_t                hts_reserved;
+} hsm_trace_seg_hdr_s;
+
+/** A single trace record */
+typedef struct
+{
+    /** os_cputime of the record */
+    uint32_t                htr_ticks;
+    /** Identifier of the state machine (low 32 bits of its address) */
+    uint32_t                htr_hsm;
+    /** State number (hst_state_num), -1 if none */
+    int32_t                 htr_state;
+    /** Signal or destination state number, depending on htr_type */
+    int32_t                 htr_arg;
+    /** One of hsm_trace_type_e */
+    uint8_t                 htr_type;
+    /** Index of the region + 1; 0 for the main states */
+    uint8_t                 htr_region;
+    /** Reserved; 0 */
+    uint16_t                htr_reserved;
+} hsm_trace_rec_s;
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
+
+#endif // __HSM_TRACE_FORMAT_H__
@@ -5,6 +5,275 @@
 
 #include "os/os.h"
 #include "hsm/hsm.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+#if MYNEWT_VAL(HSM_LOCK_COUNT)
+uint32_t hsm_lock_count;
+#endif
+
+/** Returns the number of ancestors of a state, or -1 for NULL */
+static int hsm_state_depth(const hsm_state_s * state)
+{
+    int depth = -1;
+
+    for (; state != NULL; state = state->hst_parent)
+    {
+        depth++;
+    }
+
+    return depth;
+}
+
+/** Records the history of every composite state exited by a transition from
+ *  src to dst, that is every ancestor of src (src included) which is not an
+ *  ancestor of dst (dst included) */
+static void hsm_history_record(hsm_s * hsm, const hsm_state_s * src,
+        const hsm_state_s * dst)
+{
+    const hsm_state_s * state;
+    const hsm_state_s * child;
+    hsm_history_s * history;
+    int src_depth = hsm_state_depth(src);
+    int dst_depth = hsm_state_depth(dst);
+
+    while (dst_depth > src_depth)
+    {
+        dst = dst->hst_parent;
+        dst_depth--;
+    }
+
+    child = src;
+
+    for (state = src; state != NULL; state = state->hst_parent)
+    {
+        if (src_depth == dst_depth)
+        {
+            if (state == dst)
+            {
+                break;
+            }
+
+            dst = dst->hst_parent;
+            dst_depth--;
+        }
+
+        if ((state->hst_history_idx != 0) &&
+            (state->hst_history_idx <= hsm->h_num_history))
+        {
+            history = &hsm->h_history[state->hst_history_idx - 1];
+            history->hh_shallow = child;
+            history->hh_deep = src;
+        }
+
+        child = state;
+        src_depth--;
+    }
+}
+
+/** Returns the state to enter for a transition to dst, which may be a history
+ *  pseudo-state */
+static const hsm_state_s * hsm_history_resolve(hsm_s * hsm,
+        const hsm_state_s * dst)
+{
+    const hsm_state_s * composite;
+    const hsm_state_s * target = NULL;
+    hsm_history_s * history;
+
+    if ((dst == NULL) || (dst->hst_history == HSM_HISTORY_NONE))
+    {
+        return dst;
+    }
+
+    // A history pseudo-state stands for the history of its parent
+    composite = dst->hst_parent;
+    assert(composite != NULL);
+
+    if ((composite->hst_history_idx != 0) &&
+        (composite->hst_history_idx <= hsm->h_num_history))
+    {
+        history = &hsm->h_history[composite->hst_history_idx - 1];
+        target = (dst->hst_history == HSM_HISTORY_DEEP) ?
+            history->hh_deep : history->hh_shallow;
+    }
+
+    return (target != NULL) ? target : composite;
+}
+
+void hsm_transition_locked(hsm_s * hsm, hsm_region_s * region,
+        const hsm_state_s * dst)
+{
+    hsm_state_s ** cur_state;
+    hsm_region_s * prev_region;
+    hsm_state_s * src;
+
+    cur_state = (region != NULL) ? &region->hr_cur_state : &hsm->h_cur_state;
+
+    // Transitions requested by the exit and entry functions apply to the
+    // same region
+    prev_region = hsm->h_cur_region;
+    hsm->h_cur_region = region;
+
+    src = *cur_state;
+    dst = hsm_history_resolve(hsm, dst);
+
+    if ((hsm->h_history != NULL) && (src != NULL))
+    {
+        hsm_history_record(hsm, src, dst);
+    }
+
+    HSM_TRACE(hsm, region, HSM_TRACE_TRANSITION, src,
+        (dst != NULL) ? dst->hst_state_num : -1);
+
+    if (src != NULL)
+    {
+        HSM_TRACE(hsm, region, HSM_TRACE_EXIT, src, 0);
+
+        if (src->hst_on_exit != NULL)
+        {
+            src->hst_on_exit(hsm);
+        }
+    }
+
+    *cur_state = (hsm_state_s *)dst;
+
+    if (dst != NULL)
+    {
+        HSM_TRACE(hsm, region, HSM_TRACE_ENTRY, dst, 0);
+
+        if (dst->hst_on_entry != NULL)
+        {
+            dst->hst_on_entry(hsm);
+        }
+    }
+
+    hsm->h_cur_region = prev_region;
+}
+
+/** Performs the transitions recorded during a run-to-completion dispatch */
+static void hsm_complete_transitions(hsm_s * hsm)
+{
+    hsm_region_s * region;
+    uint8_t i;
+
+    for (i = 0; i < hsm->h_num_regions; i++)
+    {
+        region = &hsm->h_regions[i];
+
+        if (region->hr_transition_pending)
+        {
+            region->hr_transition_pending = false;
+            hsm_transition_locked(hsm, region, region->hr_next_state);
+        }
+    }
+
+    if (hsm->h_transition_pending)
+    {
+        hsm->h_transition_pending = false;
+        hsm_transition_locked(hsm, NULL, hsm->h_next_state);
+    }
+}
+
+/** Dispatches a signal to a state and, until it is handled, its parents */
+static int hsm_dispatch_chain(hsm_s * hsm, const hsm_state_s * current,
+        int signal)
+{
+    int rc;
+
+    do
+    {
+        rc = current->hst_on_signal(hsm, signal);
+        current = current->hst_parent;
+    } while((current != NULL) && (rc != 0));
+
+    return rc == HSM_SIG_STATUS_HANDLED ? 
+        HSM_SIG_STATUS_HANDLED : HSM_SIG_STATUS_NOT_HANDLED;
+}
+
+/** Dispatches a signal to the regions which declared it */
+static int hsm_dispatch_regions(hsm_s * hsm, int signal)
+{
+    uint32_t regions;
+    int rc = HSM_SIG_STATUS_NOT_HANDLED;
+    int idx;
+
+    if ((hsm->h_region_map == NULL) || (signal < 0) ||
+        (signal >= hsm->h_region_map_len))
+    {
+        return HSM_SIG_STATUS_NOT_HANDLED;
+    }
+
+    regions = hsm->h_region_map[signal];
+
+    while ((regions != 0) && hsm_is_active(hsm))
+    {
+        idx = __builtin_ctz(regions);
+        regions &= regions - 1;
+
+        // A region is only without a state if the state machine was
+        // activated by a transition rather than entered
+        if (hsm->h_regions[idx].hr_cur_state == NULL)
+        {
+            continue;
+        }
+
+        hsm->h_cur_region = &hsm->h_regions[idx];
+        if (hsm_dispatch_chain(hsm, hsm->h_regions[idx].hr_cur_state,
+                signal) == HSM_SIG_STATUS_HANDLED)
+        {
+            rc = HSM_SIG_STATUS_HANDLED;
+        }
+    }
+
+    return rc;
+}
+
+/** Dispatches an event to the regions and current state of the state machine.
+ *  Must be called with the state machine lock held and the state machine
+ *  active */
+static int hsm_dispatch_locked(hsm_s * hsm, const hsm_event_s * event)
+{
+    const hsm_event_s * prev_event;
+    hsm_region_s * prev_region;
+    int rc;
+
+    // Handlers may raise signals to their own state machine, so the outer
+    // event is restored once this dispatch completes
+    prev_event = hsm->h_cur_event;
+    prev_region = hsm->h_cur_region;
+    hsm->h_cur_event = event;
+
+    if ((hsm->h_dispatch_hook != NULL) && (prev_event == NULL))
+    {
+        hsm->h_dispatch_hook(hsm, event, hsm->h_hook_arg);
+    }
+
+    HSM_TRACE(hsm, NULL, HSM_TRACE_DISPATCH, hsm->h_cur_state,
+        event->he_signal);
+
+    rc = hsm_dispatch_regions(hsm, event->he_signal);
+
+    if ((rc != HSM_SIG_STATUS_HANDLED) && hsm_is_active(hsm))
+    {
+        hsm->h_cur_region = NULL;
+        rc = hsm_dispatch_chain(hsm, hsm->h_cur_state, event->he_signal);
+    }
+
+    hsm->h_cur_event = prev_event;
+    hsm->h_cur_region = prev_region;
+
+    // Run-to-completion: the transitions requested by the handlers are
+    // carried out once the outermost dispatch is complete, under the same lock
+    if (prev_event == NULL)
+    {
+        hsm_complete_transitions(hsm);
+    }
+
+    return rc;
+}
 
 // =================================================================
 // ====================== API ======================================
@@ -12,6 +281,12 @@
 
 int hsm_init(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry, 
         hsm_exit_fn exit)
+{
+    return hsm_init_ext(hsm, top, entry, exit, 0);
+}
+
+int hsm_init_ext(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry, 
+        hsm_exit_fn exit, uint8_t flags)
 {
     int rc;
 
@@ -23,6 +298,8 @@ int hsm_init(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry,
     hsm->h_top = top;
     hsm->h_on_entry = entry;
     hsm->h_on_exit = exit;
+    hsm->h_flags = flags;
+    hsm->h_owner = os_sched_get_current_task();
 
     rc = os_mutex_init(&hsm->h_lock);
     if (rc)
@@ -30,92 +307,277 @@ int hsm_init(hsm_s * hsm, const hsm_state_s * top, hsm_entry_fn entry,
         return rc;
     }
     hsm->h_cur_state = NULL;
+    hsm->h_next_state = NULL;
+    hsm->h_transition_pending = false;
+    hsm->h_cur_event = NULL;
+    hsm->h_queue = NULL;
+    hsm->h_regions = NULL;
+    hsm->h_num_regions = 0;
+    hsm->h_region_map = NULL;
+    hsm->h_region_map_len = 0;
+    hsm->h_history = NULL;
+    hsm->h_num_history = 0;
+    hsm->h_cur_region = NULL;
+    hsm->h_dispatch_hook = NULL;
+    hsm->h_hook_arg = NULL;
 
     return 0;
 }
 
-void hsm_enter(hsm_s * hsm)
+int hsm_set_regions(hsm_s * hsm, hsm_region_s * regions, uint8_t num_regions,
+        uint32_t * region_map, uint16_t num_signals)
 {
+    hsm_region_s * region;
+    uint8_t i, j;
+    int rc = 0;
+
+    if ((num_regions > 32) || ((num_regions != 0) && (regions == NULL)))
+    {
+        return OS_EINVAL;
+    }
+
+    for (i = 0; i < num_regions; i++)
+    {
+        region = &regions[i];
+
+        if (region->hr_top == NULL)
+        {
+            return OS_EINVAL;
+        }
+
+        for (j = 0; j < region->hr_num_signals; j++)
+        {
+            if ((region->hr_signals[j] < 0) ||
+                (region->hr_signals[j] >= num_signals))
+            {
+                return OS_EINVAL;
+            }
+        }
+    }
+
+    hsm_lock(hsm);
+
     if (hsm_is_active(hsm))
     {
-        return;
+        rc = OS_EINVAL;
+    }
+    else
+    {
+        for (i = 0; i < num_signals; i++)
+        {
+            region_map[i] = 0;
+        }
+
+        for (i = 0; i < num_regions; i++)
+        {
+            region = &regions[i];
+
+            for (j = 0; j < region->hr_num_signals; j++)
+            {
+                region_map[region->hr_signals[j]] |= (uint32_t)1 << i;
+            }
+
+            region->hr_cur_state = NULL;
+            region->hr_next_state = NULL;
+            region->hr_transition_pending = false;
+        }
+
+        hsm->h_regions = regions;
+        hsm->h_num_regions = num_regions;
+        hsm->h_region_map = region_map;
+        hsm->h_region_map_len = num_signals;
     }
 
-    if (hsm->h_on_entry != NULL)
+    hsm_unlock(hsm);
+
+    return rc;
+}
+
+int hsm_set_history(hsm_s * hsm, hsm_history_s * history, uint8_t num_history)
+{
+    uint8_t i;
+    int rc = 0;
+
+    hsm_lock(hsm);
+
+    if (hsm_is_active(hsm))
+    {
+        rc = OS_EINVAL;
+    }
+    else
     {
-        hsm->h_on_entry(hsm);
+        for (i = 0; i < num_history; i++)
+        {
+            history[i].hh_shallow = NULL;
+            history[i].hh_deep = NULL;
+        }
+
+        hsm->h_history = (num_history != 0) ? history : NULL;
+        hsm->h_num_history = num_history;
     }
 
-    hsm_transition(hsm, hsm->h_top);
+    hsm_unlock(hsm);
+
+    return rc;
 }
 
-void hsm_exit(hsm_s * hsm)
+void hsm_set_owner(hsm_s * hsm, struct os_task * owner)
+{
+    hsm->h_owner = owner;
+}
+
+void hsm_enter(hsm_s * hsm)
 {
+    uint8_t i;
+
+    hsm_lock(hsm);
+
+    // The active status is checked under the lock so that concurrent calls
+    // cannot both enter the state machine
     if (!hsm_is_active(hsm))
     {
-        return;
+        if (hsm->h_on_entry != NULL)
+        {
+            hsm->h_on_entry(hsm);
+        }
+
+        hsm_transition_locked(hsm, NULL, hsm->h_top);
+
+        for (i = 0; i < hsm->h_num_regions; i++)
+        {
+            hsm_transition_locked(hsm, &hsm->h_regions[i],
+                hsm->h_regions[i].hr_top);
+        }
     }
 
-    os_mutex_pend(&hsm->h_lock, OS_TIMEOUT_NEVER);
-    hsm_transition(hsm, NULL);
+    hsm_unlock(hsm);
+}
 
-    if (hsm->h_on_exit != NULL)
+void hsm_exit(hsm_s * hsm)
+{
+    uint8_t i;
+
+    hsm_lock(hsm);
+
+    if (hsm_is_active(hsm))
     {
-        hsm->h_on_exit(hsm);
+        // Exiting is never deferred, and supersedes any transition requested
+        // by the handler being run. Regions are exited before the main state
+        for (i = hsm->h_num_regions; i > 0; i--)
+        {
+            hsm->h_regions[i - 1].hr_transition_pending = false;
+            hsm_transition_locked(hsm, &hsm->h_regions[i - 1], NULL);
+        }
+
+        hsm->h_transition_pending = false;
+        hsm_transition_locked(hsm, NULL, NULL);
+
+        if (hsm->h_on_exit != NULL)
+        {
+            hsm->h_on_exit(hsm);
+        }
     }
 
-    os_mutex_release(&hsm->h_lock);
+    hsm_unlock(hsm);
 }
 
 void hsm_raise(hsm_s * hsm, int signal)
 {
-    const hsm_state_s * current;
-    int rc;
+    hsm_event_s event = {
+        .he_signal = signal,
+        .he_count = 1,
+        .he_data = NULL,
+    };
 
-    if (!hsm_is_active(hsm))
-    {
-        return;
-    }
+    hsm_dispatch(hsm, &event);
+}
 
-    os_mutex_pend(&hsm->h_lock, OS_TIMEOUT_NEVER);
+int hsm_dispatch(hsm_s * hsm, const hsm_event_s * event)
+{
+    int rc = HSM_SIG_STATUS_NOT_HANDLED;
 
-    current = hsm->h_cur_state;
+    hsm_lock(hsm);
 
-    do
+    if (hsm_is_active(hsm))
     {
-        rc = current->hst_on_signal(hsm, signal);
-        current = current->hst_parent;
-    } while((current != NULL) && (rc != 0));
+        rc = hsm_dispatch_locked(hsm, event);
+    }
+
+    hsm_unlock(hsm);
 
-    os_mutex_release(&hsm->h_lock);
+    return rc;
 }
 
-void hsm_transition(hsm_s * hsm, const hsm_state_s * dst)
+int hsm_raise_batch(hsm_s * hsm, const hsm_event_s * events, int num_events,
+        int * results)
 {
-    hsm_state_s * src;
-    os_mutex_pend(&hsm->h_lock, OS_TIMEOUT_NEVER);
+    int dispatched;
+    int i;
 
-    src = hsm->h_cur_state;
+    hsm_lock(hsm);
 
-    if (src != NULL)
+    // A handler may exit the state machine part way through the batch; the
+    // remaining events are then reported as not handled
+    for (i = 0; (i < num_events) && hsm_is_active(hsm); i++)
     {
-        if (src->hst_on_exit != NULL)
+        if (results != NULL)
         {
-            src->hst_on_exit(hsm);
+            results[i] = hsm_dispatch_locked(hsm, &events[i]);
+        }
+        else
+        {
+            hsm_dispatch_locked(hsm, &events[i]);
         }
     }
 
-    hsm->h_cur_state = (hsm_state_s *)dst;
+    hsm_unlock(hsm);
 
-    if (dst != NULL)
+    dispatched = i;
+
+    if (results != NULL)
     {
-        if (dst->hst_on_entry != NULL)
+        for (; i < num_events; i++)
         {
-            dst->hst_on_entry(hsm);
+            results[i] = HSM_SIG_STATUS_NOT_HANDLED;
         }
     }
 
-    os_mutex_release(&hsm->h_lock);
+    return dispatched;
+}
+
+void hsm_transition(hsm_s * hsm, const hsm_state_s * dst)
+{
+    // The lock is owned by the current task while one of its handlers runs,
+    // so there is no need to pend it again to record the destination
+    if ((hsm->h_flags & HSM_F_RTC) && (hsm->h_cur_event != NULL) &&
+        hsm_lock_held(hsm))
+    {
+        if (hsm->h_cur_region != NULL)
+        {
+            hsm->h_cur_region->hr_next_state = dst;
+            hsm->h_cur_region->hr_transition_pending = true;
+        }
+        else
+        {
+            hsm->h_next_state = dst;
+            hsm->h_transition_pending = true;
+        }
+        return;
+    }
+
+    // h_cur_region is only set while the current task runs a region handler;
+    // other tasks wait for the lock and find it cleared
+    hsm_lock(hsm);
+    hsm_transition_locked(hsm, hsm->h_cur_region, dst);
+    hsm_unlock(hsm);
+}
+
+void hsm_set_dispatch_hook(hsm_s * hsm, hsm_dispatch_hook_fn hook, void * arg)
+{
+    hsm_lock(hsm);
+    hsm->h_dispatch_hook = hook;
+    hsm->h_hook_arg = arg;
+    hsm_unlock(hsm);
 }
 
 bool hsm_is_active(hsm_s * hsm)
@@ -123,14 +585,40 @@ bool hsm_is_active(hsm_s * hsm)
     return hsm->h_cur_state != NULL;
 }
 
+const hsm_event_s * hsm_get_event(hsm_s * hsm)
+{
+    return hsm->h_cur_event;
+}
+
 int hsm_get_current_state(hsm_s * hsm)
 {
-    if (!hsm_is_active(hsm))
+    // Read the current state once; it may be cleared concurrently by hsm_exit
+    const hsm_state_s * state = hsm->h_cur_state;
+
+    if (state == NULL)
+    {
+        return -1;
+    }
+
+    return state->hst_state_num;
+}
+
+int hsm_get_region_state(hsm_s * hsm, int region)
+{
+    const hsm_state_s * state;
+
+    if ((region < 0) || (region >= hsm->h_num_regions))
+    {
+        return -1;
+    }
+
+    state = hsm->h_regions[region].hr_cur_state;
+    if (state == NULL)
     {
         return -1;
     }
 
-    return hsm->h_cur_state->hst_state_num;
+    return state->hst_state_num;
 }
 
 // =================================================================
@@ -0,0 +1,95 @@
+/**
+ *  @file   hsm_priv.h
+ *  @brief  Definitions shared between the hsm library source files.
+ */
+
+#ifndef __HSM_PRIV_H__
+#define __HSM_PRIV_H__
+
+#include <assert.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_trace_format.h"
+
+#if MYNEWT_VAL(HSM_OWNER_CHECK)
+#define HSM_ASSERT_OWNER(hsm_) \
+    assert((hsm_)->h_owner == os_sched_get_current_task())
+#else
+#define HSM_ASSERT_OWNER(hsm_)
+#endif
+
+#if MYNEWT_VAL(HSM_LOCK_COUNT)
+#define HSM_LOCK_COUNT()    (hsm_lock_count++)
+#else
+#define HSM_LOCK_COUNT()
+#endif
+
+#if MYNEWT_VAL(HSM_TRACE)
+/** Writes a trace record if a trace file is open (see hsm/hsm_trace.h) */
+void hsm_trace_record(hsm_s * hsm, const hsm_region_s * region, uint8_t type,
+        const hsm_state_s * state, int arg);
+
+#define HSM_TRACE(hsm_, region_, type_, state_, arg_) \
+    hsm_trace_record((hsm_), (region_), (type_), (state_), (arg_))
+#else
+#define HSM_TRACE(hsm_, region_, type_, state_, arg_)
+#endif
+
+/** Acquires the state machine lock. State machines confined to their owner
+ *  task (HSM_F_OWNED) do not use the OS mutex */
+static inline void hsm_lock(hsm_s * hsm)
+{
+    if (hsm->h_flags & HSM_F_OWNED)
+    {
+        HSM_ASSERT_OWNER(hsm);
+        return;
+    }
+
+    HSM_LOCK_COUNT();
+    os_mutex_pend(&hsm->h_lock, OS_TIMEOUT_NEVER);
+}
+
+/** Releases the state machine lock */
+static inline void hsm_unlock(hsm_s * hsm)
+{
+    if (hsm->h_flags & HSM_F_OWNED)
+    {
+        return;
+    }
+
+    HSM_LOCK_COUNT();
+    os_mutex_release(&hsm->h_lock);
+}
+
+/** Indicates whether the current task holds the state machine lock */
+static inline bool hsm_lock_held(hsm_s * hsm)
+{
+    if (hsm->h_flags & HSM_F_OWNED)
+    {
+        HSM_ASSERT_OWNER(hsm);
+        return true;
+    }
+
+    return hsm->h_lock.mu_owner == os_sched_get_current_task();
+}
+
+/** Exits the current state of the region (or of the state machine if region
+ *  is NULL) and enters dst. Must be called with the state machine lock held */
+void hsm_transition_locked(hsm_s * hsm, hsm_region_s * region,
+        const hsm_state_s * dst);
+
+/** Queues an event without any checks on the state machine. The caller's
+ *  reference on shared (if any) is transferred to the queue on success. The
+ *  queue's os_event is only scheduled if schedule is true */
+int hsm_queue_post(hsm_s * hsm, int signal, void * data, hsm_shared_s * shared,
+        bool schedule);
+
+/** Adds a reference to a published payload */
+void hsm_shared_acquire(hsm_shared_s * shared);
+
+/** Drops a reference to a published payload, releasing it when the last
+ *  reference is dropped. NULL is ignored */
+void hsm_shared_release(hsm_shared_s * shared);
+
+#endif // __HSM_PRIV_H__
@@ -0,0 +1,341 @@
+/**
+ *  @file   hsm_pubsub.c
+ *  @brief  Publish/subscribe delivery of signals to many state machines.
+ */
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_queue.h"
+#include "hsm/hsm_pubsub.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+#if MYNEWT_VAL(HSM_PUBSUB_MAX_SUBSCRIBERS) > 32
+#error "HSM_PUBSUB_MAX_SUBSCRIBERS cannot exceed 32"
+#endif
+
+#define HSM_PUBSUB_NO_WORKER            0xFF
+
+/** Event queue on which a group of subscribers is processed */
+typedef struct
+{
+    /** Event queue processing the subscribers */
+    struct os_eventq *      hw_evq;
+    /** Event scheduled on hw_evq after a publish */
+    struct os_event         hw_ev;
+    /** Bitmap of subscribers with published events to process */
+    uint32_t                hw_pending;
+} hsm_worker_s;
+
+/** Subscribed state machines, indexed by subscriber bit */
+static hsm_s * g_hsm_subscribers[MYNEWT_VAL(HSM_PUBSUB_MAX_SUBSCRIBERS)];
+/** Worker of each subscriber or HSM_PUBSUB_NO_WORKER */
+static uint8_t g_hsm_subscriber_worker[MYNEWT_VAL(HSM_PUBSUB_MAX_SUBSCRIBERS)];
+/** Bitmap of subscribers, indexed by signal */
+static uint32_t g_hsm_sub_map[MYNEWT_VAL(HSM_PUBSUB_MAX_SIGNALS)];
+
+static hsm_worker_s g_hsm_workers[MYNEWT_VAL(HSM_PUBSUB_MAX_WORKERS)];
+static hsm_shared_s g_hsm_shared[MYNEWT_VAL(HSM_PUBSUB_MAX_SHARED)];
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+/** Processes every subscriber of the worker which received a publish */
+static void hsm_worker_ev_cb(struct os_event * ev)
+{
+    hsm_worker_s * worker = (hsm_worker_s *)ev->ev_arg;
+    uint32_t pending;
+    os_sr_t sr;
+    int idx;
+
+    OS_ENTER_CRITICAL(sr);
+    pending = worker->hw_pending;
+    worker->hw_pending = 0;
+    OS_EXIT_CRITICAL(sr);
+
+    while (pending != 0)
+    {
+        idx = __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        hsm_process(g_hsm_subscribers[idx]);
+    }
+}
+
+/** Returns the worker processing evq, allocating it if needed. Must be called
+ *  from within a critical section */
+static uint8_t hsm_worker_get(struct os_eventq * evq)
+{
+    uint8_t i;
+
+    if (evq == NULL)
+    {
+        return HSM_PUBSUB_NO_WORKER;
+    }
+
+    for (i = 0; i < MYNEWT_VAL(HSM_PUBSUB_MAX_WORKERS); i++)
+    {
+        if (g_hsm_workers[i].hw_evq == evq)
+        {
+            return i;
+        }
+
+        if (g_hsm_workers[i].hw_evq == NULL)
+        {
+            g_hsm_workers[i].hw_evq = evq;
+            g_hsm_workers[i].hw_ev.ev_cb = hsm_worker_ev_cb;
+            g_hsm_workers[i].hw_ev.ev_arg = &g_hsm_workers[i];
+            return i;
+        }
+    }
+
+    return HSM_PUBSUB_NO_WORKER;
+}
+
+/** Returns the subscriber index of hsm, or -1 if not a subscriber */
+static int hsm_subscriber_find(const hsm_s * hsm)
+{
+    int i;
+
+    for (i = 0; i < MYNEWT_VAL(HSM_PUBSUB_MAX_SUBSCRIBERS); i++)
+    {
+        if (g_hsm_subscribers[i] == hsm)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static hsm_shared_s * hsm_shared_alloc(void * data, hsm_release_fn release)
+{
+    hsm_shared_s * shared = NULL;
+    os_sr_t sr;
+    int i;
+
+    OS_ENTER_CRITICAL(sr);
+
+    for (i = 0; i < MYNEWT_VAL(HSM_PUBSUB_MAX_SHARED); i++)
+    {
+        if (g_hsm_shared[i].hs_refcnt == 0)
+        {
+            shared = &g_hsm_shared[i];
+            shared->hs_refcnt = 1;
+            shared->hs_data = data;
+            shared->hs_release = release;
+            break;
+        }
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return shared;
+}
+
+void hsm_shared_acquire(hsm_shared_s * shared)
+{
+    os_sr_t sr;
+
+    if (shared == NULL)
+    {
+        return;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+    shared->hs_refcnt++;
+    OS_EXIT_CRITICAL(sr);
+}
+
+void hsm_shared_release(hsm_shared_s * shared)
+{
+    hsm_release_fn release = NULL;
+    void * data = NULL;
+    os_sr_t sr;
+
+    if (shared == NULL)
+    {
+        return;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+
+    shared->hs_refcnt--;
+    if (shared->hs_refcnt == 0)
+    {
+        release = shared->hs_release;
+        data = shared->hs_data;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    // The slot may be reused as soon as the count drops to zero, so the
+    // release function was captured above
+    if (release != NULL)
+    {
+        release(data);
+    }
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+int hsm_subscribe(hsm_s * hsm, int signal)
+{
+    os_sr_t sr;
+    int idx;
+    int rc = 0;
+
+    if ((signal < 0) || (signal >= MYNEWT_VAL(HSM_PUBSUB_MAX_SIGNALS)) ||
+        (hsm->h_queue == NULL))
+    {
+        return OS_EINVAL;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+
+    idx = hsm_subscriber_find(hsm);
+    if (idx < 0)
+    {
+        idx = hsm_subscriber_find(NULL);
+        if (idx < 0)
+        {
+            rc = OS_ENOMEM;
+        }
+        else
+        {
+            g_hsm_subscriber_worker[idx] =
+                hsm_worker_get(hsm->h_queue->hq_evq);
+
+            if ((hsm->h_queue->hq_evq != NULL) &&
+                (g_hsm_subscriber_worker[idx] == HSM_PUBSUB_NO_WORKER))
+            {
+                rc = OS_ENOMEM;
+            }
+            else
+            {
+                g_hsm_subscribers[idx] = hsm;
+            }
+        }
+    }
+
+    if (rc == 0)
+    {
+        g_hsm_sub_map[signal] |= (uint32_t)1 << idx;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return rc;
+}
+
+int hsm_unsubscribe(hsm_s * hsm, int signal)
+{
+    os_sr_t sr;
+    int idx;
+    int rc = 0;
+
+    if ((signal < 0) || (signal >= MYNEWT_VAL(HSM_PUBSUB_MAX_SIGNALS)))
+    {
+        return OS_EINVAL;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+
+    idx = hsm_subscriber_find(hsm);
+    if ((idx < 0) || !(g_hsm_sub_map[signal] & ((uint32_t)1 << idx)))
+    {
+        rc = OS_ENOENT;
+    }
+    else
+    {
+        g_hsm_sub_map[signal] &= ~((uint32_t)1 << idx);
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return rc;
+}
+
+int hsm_publish(int signal, void * data, hsm_release_fn release)
+{
+    hsm_shared_s * shared = NULL;
+    uint32_t subscribers;
+    uint32_t workers = 0;
+    uint8_t worker;
+    hsm_s * hsm;
+    os_sr_t sr;
+    int idx;
+
+    if ((signal < 0) || (signal >= MYNEWT_VAL(HSM_PUBSUB_MAX_SIGNALS)))
+    {
+        return OS_EINVAL;
+    }
+
+    // The publisher holds a reference until every subscriber has been
+    // posted to, so that the payload cannot be released part way through
+    if (release != NULL)
+    {
+        shared = hsm_shared_alloc(data, release);
+        if (shared == NULL)
+        {
+            return OS_ENOMEM;
+        }
+    }
+
+    OS_ENTER_CRITICAL(sr);
+    subscribers = g_hsm_sub_map[signal];
+    OS_EXIT_CRITICAL(sr);
+
+    while (subscribers != 0)
+    {
+        idx = __builtin_ctz(subscribers);
+        subscribers &= subscribers - 1;
+
+        hsm = g_hsm_subscribers[idx];
+        if (!hsm_is_active(hsm))
+        {
+            continue;
+        }
+
+        hsm_shared_acquire(shared);
+        if (hsm_queue_post(hsm, signal, data, shared, false) != 0)
+        {
+            hsm_shared_release(shared);
+            continue;
+        }
+
+        worker = g_hsm_subscriber_worker[idx];
+        if (worker != HSM_PUBSUB_NO_WORKER)
+        {
+            OS_ENTER_CRITICAL(sr);
+            g_hsm_workers[worker].hw_pending |= (uint32_t)1 << idx;
+            OS_EXIT_CRITICAL(sr);
+
+            workers |= (uint32_t)1 << worker;
+        }
+    }
+
+    // One event per worker, regardless of the number of subscribers on it
+    while (workers != 0)
+    {
+        worker = __builtin_ctz(workers);
+        workers &= workers - 1;
+
+        os_eventq_put(g_hsm_workers[worker].hw_evq,
+            &g_hsm_workers[worker].hw_ev);
+    }
+
+    hsm_shared_release(shared);
+
+    return 0;
+}
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
@@ -0,0 +1,451 @@
+/**
+ *  @file   hsm_queue.c
+ *  @brief  Event queue for the hierarchical state machine.
+ */
+
+#include <string.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_queue.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+static uint8_t hsm_queue_policy(const hsm_queue_s * queue, int signal)
+{
+    if ((queue->hq_sig_cfg == NULL) || (signal < 0) ||
+        (signal >= queue->hq_num_signals))
+    {
+        return HSM_SIG_POLICY_QUEUE;
+    }
+
+    return queue->hq_sig_cfg[signal].hsc_policy;
+}
+
+static void hsm_queue_ev_cb(struct os_event * ev)
+{
+    hsm_process((hsm_s *)ev->ev_arg);
+}
+
+/** Returns the priority level a signal is queued on */
+static hsm_queue_level_s * hsm_queue_level(hsm_queue_s * queue, int signal)
+{
+    uint8_t prio;
+
+    if ((queue->hq_sig_cfg == NULL) || (signal < 0) ||
+        (signal >= queue->hq_num_signals))
+    {
+        return &queue->hq_levels[0];
+    }
+
+    prio = queue->hq_sig_cfg[signal].hsc_prio;
+    if (prio >= queue->hq_num_levels)
+    {
+        prio = queue->hq_num_levels - 1;
+    }
+
+    return &queue->hq_levels[prio];
+}
+
+/** Removes the oldest event of a non-empty level. Must be called from within
+ *  a critical section */
+static void hsm_queue_level_pop(hsm_queue_s * queue, hsm_queue_level_s * level,
+        hsm_event_s * event)
+{
+    hsm_event_s * head;
+    uint8_t policy;
+
+    head = &level->hql_buf[level->hql_head];
+    *event = *head;
+
+    // Once the event leaves the queue, later posts of the same signal can no
+    // longer be absorbed by it
+    policy = hsm_queue_policy(queue, head->he_signal);
+    if ((policy == HSM_SIG_POLICY_COALESCE) || (policy == HSM_SIG_POLICY_MERGE))
+    {
+        queue->hq_pending[head->he_signal] = NULL;
+    }
+
+    level->hql_head = (level->hql_head + 1) % level->hql_size;
+    level->hql_count--;
+
+    if (level->hql_count == 0)
+    {
+        queue->hq_ready &= ~(1UL << (level - queue->hq_levels));
+    }
+}
+
+/** Removes the oldest pending event of the most urgent non-empty level.
+ *  Returns false if the queue is empty */
+static bool hsm_queue_pop(hsm_queue_s * queue, hsm_event_s * event)
+{
+    os_sr_t sr;
+
+    OS_ENTER_CRITICAL(sr);
+
+    if (queue->hq_ready == 0)
+    {
+        OS_EXIT_CRITICAL(sr);
+        return false;
+    }
+
+    hsm_queue_level_pop(queue,
+        &queue->hq_levels[31 - __builtin_clz(queue->hq_ready)], event);
+
+    OS_EXIT_CRITICAL(sr);
+
+    return true;
+}
+
+/** Holds back an event that no active state handled */
+static void hsm_queue_defer(hsm_queue_s * queue, const hsm_event_s * event)
+{
+    if (queue->hq_deferred_count >= queue->hq_deferred_size)
+    {
+        queue->hq_stats.hqs_dropped++;
+        hsm_shared_release(event->he_shared);
+        return;
+    }
+
+    queue->hq_deferred[queue->hq_deferred_count++] = *event;
+    queue->hq_stats.hqs_deferred++;
+}
+
+/** Retries the deferred events after a state change. Events which are still
+ *  not handled keep their relative order. Must be called with the state
+ *  machine lock held. Returns the number of dispatched events */
+static int hsm_queue_recall(hsm_s * hsm, hsm_queue_s * queue)
+{
+    const hsm_state_s * prev_state;
+    hsm_event_s event;
+    uint16_t i, kept, count;
+    int dispatched = 0;
+    int recalled;
+    bool changed;
+    int rc;
+
+    // A recalled event may itself change the state, which gives the events
+    // still deferred another chance. Every such pass handles at least one
+    // event, so the loop is bounded by the number of deferred events
+    do
+    {
+        changed = false;
+        recalled = 0;
+        kept = 0;
+        count = queue->hq_deferred_count;
+
+        for (i = 0; (i < count) && hsm_is_active(hsm); i++)
+        {
+            event = queue->hq_deferred[i];
+            prev_state = hsm->h_cur_state;
+
+            rc = hsm_dispatch(hsm, &event);
+            dispatched++;
+
+            if (rc == HSM_SIG_STATUS_HANDLED)
+            {
+                hsm_shared_release(event.he_shared);
+                recalled++;
+            }
+            else
+            {
+                queue->hq_deferred[kept++] = event;
+            }
+
+            if (hsm->h_cur_state != prev_state)
+            {
+                changed = true;
+            }
+        }
+
+        // Keep the events which were not attempted (state machine exited)
+        for (; i < count; i++)
+        {
+            queue->hq_deferred[kept++] = queue->hq_deferred[i];
+        }
+
+        queue->hq_deferred_count = kept;
+        queue->hq_stats.hqs_recalled += recalled;
+    } while (changed && (recalled != 0) && (kept != 0));
+
+    return dispatched;
+}
+
+int hsm_queue_post(hsm_s * hsm, int signal, void * data, hsm_shared_s * shared,
+        bool schedule)
+{
+    hsm_queue_s * queue = hsm->h_queue;
+    hsm_queue_level_s * level;
+    hsm_event_s * event = NULL;
+    hsm_shared_s * replaced = NULL;
+    hsm_event_s evicted;
+    uint8_t policy;
+    os_sr_t sr;
+    int rc = 0;
+
+    policy = hsm_queue_policy(queue, signal);
+    level = hsm_queue_level(queue, signal);
+
+    OS_ENTER_CRITICAL(sr);
+
+    if ((policy == HSM_SIG_POLICY_COALESCE) || (policy == HSM_SIG_POLICY_MERGE))
+    {
+        event = queue->hq_pending[signal];
+    }
+
+    if (event != NULL)
+    {
+        // An occurrence of the signal is still pending; fold this one into it
+        replaced = event->he_shared;
+        event->he_data = data;
+        event->he_shared = shared;
+
+        if (policy == HSM_SIG_POLICY_MERGE)
+        {
+            if (event->he_count < UINT16_MAX)
+            {
+                event->he_count++;
+            }
+            queue->hq_stats.hqs_merged++;
+        }
+        else
+        {
+            queue->hq_stats.hqs_coalesced++;
+        }
+    }
+    else if ((level->hql_count >= level->hql_size) &&
+        (level->hql_drop != HSM_QUEUE_DROP_OLDEST))
+    {
+        queue->hq_stats.hqs_dropped++;
+        level->hql_dropped++;
+        rc = OS_ENOMEM;
+    }
+    else
+    {
+        if (level->hql_count >= level->hql_size)
+        {
+            // Make room by discarding the oldest event of the level
+            hsm_queue_level_pop(queue, level, &evicted);
+            replaced = evicted.he_shared;
+            queue->hq_stats.hqs_dropped++;
+            level->hql_dropped++;
+        }
+
+        event = &level->hql_buf[(level->hql_head + level->hql_count) %
+            level->hql_size];
+        event->he_signal = signal;
+        event->he_count = 1;
+        event->he_data = data;
+        event->he_shared = shared;
+        level->hql_count++;
+        queue->hq_ready |= 1UL << (level - queue->hq_levels);
+
+        if (level->hql_count > level->hql_high_water)
+        {
+            level->hql_high_water = level->hql_count;
+        }
+
+        if ((policy == HSM_SIG_POLICY_COALESCE) ||
+            (policy == HSM_SIG_POLICY_MERGE))
+        {
+            queue->hq_pending[signal] = event;
+        }
+    }
+
+    if (rc == 0)
+    {
+        queue->hq_stats.hqs_posted++;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    hsm_shared_release(replaced);
+
+    // The event is only queued once no matter how many posts precede the
+    // next hsm_process
+    if ((rc == 0) && schedule && (queue->hq_evq != NULL))
+    {
+        os_eventq_put(queue->hq_evq, &queue->hq_ev);
+    }
+
+    return rc;
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+int hsm_queue_init(hsm_s * hsm, hsm_queue_s * queue, struct os_eventq * evq)
+{
+    uint8_t i;
+
+    if ((queue->hq_levels == NULL) ||
+        (queue->hq_levels == &queue->hq_default_level))
+    {
+        // Single level queue built from hq_buf / hq_size
+        memset(&queue->hq_default_level, 0, sizeof(queue->hq_default_level));
+        queue->hq_default_level.hql_buf = queue->hq_buf;
+        queue->hq_default_level.hql_size = queue->hq_size;
+        queue->hq_levels = &queue->hq_default_level;
+        queue->hq_num_levels = 1;
+    }
+
+    if ((queue->hq_num_levels == 0) || (queue->hq_num_levels > 32))
+    {
+        return OS_EINVAL;
+    }
+
+    for (i = 0; i < queue->hq_num_levels; i++)
+    {
+        if ((queue->hq_levels[i].hql_buf == NULL) ||
+            (queue->hq_levels[i].hql_size == 0))
+        {
+            return OS_EINVAL;
+        }
+    }
+
+    if ((queue->hq_sig_cfg != NULL) && (queue->hq_pending == NULL))
+    {
+        return OS_EINVAL;
+    }
+
+    if ((queue->hq_deferred == NULL) && (queue->hq_deferred_size != 0))
+    {
+        return OS_EINVAL;
+    }
+
+    for (i = 0; i < queue->hq_num_levels; i++)
+    {
+        queue->hq_levels[i].hql_head = 0;
+        queue->hq_levels[i].hql_count = 0;
+        queue->hq_levels[i].hql_high_water = 0;
+        queue->hq_levels[i].hql_dropped = 0;
+    }
+
+    queue->hq_ready = 0;
+    queue->hq_deferred_count = 0;
+    memset(&queue->hq_stats, 0, sizeof(queue->hq_stats));
+
+    if (queue->hq_pending != NULL)
+    {
+        memset(queue->hq_pending, 0,
+            queue->hq_num_signals * sizeof(queue->hq_pending[0]));
+    }
+
+    memset(&queue->hq_ev, 0, sizeof(queue->hq_ev));
+    queue->hq_ev.ev_cb = hsm_queue_ev_cb;
+    queue->hq_ev.ev_arg = hsm;
+    queue->hq_evq = evq;
+
+    hsm->h_queue = queue;
+
+    return 0;
+}
+
+int hsm_post(hsm_s * hsm, int signal, void * data)
+{
+    if ((hsm->h_queue == NULL) || !hsm_is_active(hsm))
+    {
+        return OS_EINVAL;
+    }
+
+    return hsm_queue_post(hsm, signal, data, NULL, true);
+}
+
+int hsm_process(hsm_s * hsm)
+{
+    hsm_queue_s * queue = hsm->h_queue;
+    const hsm_state_s * prev_state;
+    hsm_event_s event;
+    int dispatched = 0;
+    int rc;
+
+    if (queue == NULL)
+    {
+        return 0;
+    }
+
+    hsm_lock(hsm);
+
+    while (hsm_is_active(hsm) && hsm_queue_pop(queue, &event))
+    {
+        prev_state = hsm->h_cur_state;
+
+        rc = hsm_dispatch(hsm, &event);
+        dispatched++;
+
+        if ((rc != HSM_SIG_STATUS_HANDLED) && hsm_is_active(hsm) &&
+            (hsm_queue_policy(queue, event.he_signal) == HSM_SIG_POLICY_DEFER))
+        {
+            hsm_queue_defer(queue, &event);
+            continue;
+        }
+
+        hsm_shared_release(event.he_shared);
+
+        if ((hsm->h_cur_state != prev_state) && (queue->hq_deferred_count != 0))
+        {
+            dispatched += hsm_queue_recall(hsm, queue);
+        }
+    }
+
+    queue->hq_stats.hqs_dispatched += dispatched;
+
+    // Signals are not processed by an inactive state machine
+    if (!hsm_is_active(hsm))
+    {
+        hsm_queue_flush(hsm);
+    }
+
+    hsm_unlock(hsm);
+
+    return dispatched;
+}
+
+void hsm_queue_flush(hsm_s * hsm)
+{
+    hsm_queue_s * queue = hsm->h_queue;
+    hsm_event_s event;
+    uint16_t i;
+
+    if (queue == NULL)
+    {
+        return;
+    }
+
+    // Events are removed one at a time so that published payloads are not
+    // released from within a critical section
+    while (hsm_queue_pop(queue, &event))
+    {
+        hsm_shared_release(event.he_shared);
+    }
+
+    for (i = 0; i < queue->hq_deferred_count; i++)
+    {
+        hsm_shared_release(queue->hq_deferred[i].he_shared);
+    }
+    queue->hq_deferred_count = 0;
+}
+
+int hsm_queue_get_stats(hsm_s * hsm, hsm_queue_stats_s * stats)
+{
+    os_sr_t sr;
+
+    if (hsm->h_queue == NULL)
+    {
+        return OS_EINVAL;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+    *stats = hsm->h_queue->hq_stats;
+    OS_EXIT_CRITICAL(sr);
+
+    return 0;
+}
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
@@ -0,0 +1,296 @@
+/**
+ *  @file   hsm_record.c
+ *  @brief  Recording and replay of the signal stream of a state machine.
+ */
+
+#include <string.h>
+
+#include "os/os.h"
+#include "os/os_cputime.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_record.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+#define HSM_RECORD_MAGIC                0x5248
+#define HSM_RECORD_VERSION              1
+
+/** Largest encoding of a varint holding 32 bits (or 34 bits once tagged) */
+#define HSM_RECORD_VARINT_MAX           5
+/** Room kept at the end of the buffer for the end record */
+#define HSM_RECORD_END_MAX              (2 * HSM_RECORD_VARINT_MAX)
+/** Largest encoding of an event record */
+#define HSM_RECORD_EVENT_MAX            (3 * HSM_RECORD_VARINT_MAX)
+/** Largest encoding of the header */
+#define HSM_RECORD_HDR_MAX              (8 + HSM_RECORD_VARINT_MAX)
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+static uint32_t hsm_record_zigzag(int32_t val)
+{
+    return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+}
+
+static int32_t hsm_record_unzigzag(uint32_t val)
+{
+    return (int32_t)(val >> 1) ^ -(int32_t)(val & 1);
+}
+
+/** Appends a varint to the recording; the caller guarantees the room */
+static void hsm_record_put_varint(hsm_recorder_s * rec, uint64_t val)
+{
+    while (val >= 0x80)
+    {
+        rec->hr_buf[rec->hr_len++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+
+    rec->hr_buf[rec->hr_len++] = val;
+}
+
+/** Reads a varint from a recording. Returns false if it is truncated */
+static bool hsm_record_get_varint(const uint8_t * buf, uint32_t len,
+        uint32_t * off, uint64_t * val)
+{
+    unsigned int shift = 0;
+    uint8_t byte;
+
+    *val = 0;
+
+    do
+    {
+        if ((*off >= len) || (shift > 35))
+        {
+            return false;
+        }
+
+        byte = buf[(*off)++];
+        *val |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return true;
+}
+
+/** Appends a tag carrying the time elapsed since the previous record */
+static void hsm_record_put_tag(hsm_recorder_s * rec, uint8_t tag)
+{
+    uint32_t now = os_cputime_get32();
+
+    hsm_record_put_varint(rec, ((uint64_t)(now - rec->hr_last_ticks) << 2) |
+        tag);
+    rec->hr_last_ticks = now;
+}
+
+static void hsm_record_hook(hsm_s * hsm, const hsm_event_s * event, void * arg)
+{
+    hsm_recorder_s * rec = (hsm_recorder_s *)arg;
+
+    if (rec->hr_len + HSM_RECORD_EVENT_MAX + HSM_RECORD_END_MAX > rec->hr_size)
+    {
+        rec->hr_dropped++;
+        return;
+    }
+
+    if (event->he_count == 1)
+    {
+        hsm_record_put_tag(rec, HSM_RECORD_TAG_EVENT);
+        hsm_record_put_varint(rec, hsm_record_zigzag(event->he_signal));
+    }
+    else
+    {
+        hsm_record_put_tag(rec, HSM_RECORD_TAG_COUNTED);
+        hsm_record_put_varint(rec, hsm_record_zigzag(event->he_signal));
+        hsm_record_put_varint(rec, event->he_count);
+    }
+
+    rec->hr_events++;
+}
+
+/** Waits until the given os_cputime */
+static void hsm_replay_wait_until(uint32_t ticks)
+{
+    while ((int32_t)(os_cputime_get32() - ticks) < 0)
+    {
+    }
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+int hsm_record_start(hsm_s * hsm, hsm_recorder_s * rec, uint8_t * buf,
+        uint32_t size)
+{
+    uint32_t freq = MYNEWT_VAL(OS_CPUTIME_FREQ);
+    int rc = 0;
+
+    // Cleared first so that hsm_record_stop finds the recorder inactive
+    memset(rec, 0, sizeof(*rec));
+
+    if (size < HSM_RECORD_HDR_MAX + HSM_RECORD_END_MAX)
+    {
+        return OS_ENOMEM;
+    }
+
+    rec->hr_buf = buf;
+    rec->hr_size = size;
+
+    hsm_lock(hsm);
+
+    if (!hsm_is_active(hsm))
+    {
+        rc = OS_EINVAL;
+    }
+    else
+    {
+        buf[0] = HSM_RECORD_MAGIC & 0xFF;
+        buf[1] = HSM_RECORD_MAGIC >> 8;
+        buf[2] = HSM_RECORD_VERSION;
+        buf[3] = 0;
+        buf[4] = freq & 0xFF;
+        buf[5] = (freq >> 8) & 0xFF;
+        buf[6] = (freq >> 16) & 0xFF;
+        buf[7] = freq >> 24;
+        rec->hr_len = 8;
+
+        hsm_record_put_varint(rec,
+            hsm_record_zigzag(hsm_get_current_state(hsm)));
+
+        rec->hr_last_ticks = os_cputime_get32();
+
+        hsm_set_dispatch_hook(hsm, hsm_record_hook, rec);
+        rec->hr_active = true;
+    }
+
+    hsm_unlock(hsm);
+
+    return rc;
+}
+
+uint32_t hsm_record_stop(hsm_s * hsm, hsm_recorder_s * rec)
+{
+    if (!rec->hr_active)
+    {
+        return 0;
+    }
+
+    hsm_lock(hsm);
+
+    hsm_set_dispatch_hook(hsm, NULL, NULL);
+    rec->hr_active = false;
+
+    hsm_record_put_tag(rec, HSM_RECORD_TAG_END);
+    hsm_record_put_varint(rec, hsm_record_zigzag(hsm_get_current_state(hsm)));
+
+    hsm_unlock(hsm);
+
+    return rec->hr_len;
+}
+
+int hsm_replay(hsm_s * hsm, const uint8_t * buf, uint32_t len, uint8_t flags,
+        hsm_replay_stats_s * stats)
+{
+    hsm_event_s event = { 0 };
+    uint32_t rec_freq;
+    uint32_t deadline;
+    uint32_t start;
+    uint32_t ticks;
+    uint32_t off;
+    uint64_t val;
+    uint64_t tag;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if ((len < 8) || ((buf[0] | (buf[1] << 8)) != HSM_RECORD_MAGIC) ||
+        (buf[2] != HSM_RECORD_VERSION))
+    {
+        return OS_EINVAL;
+    }
+
+    rec_freq = buf[4] | (buf[5] << 8) | (buf[6] << 16) |
+        ((uint32_t)buf[7] << 24);
+    if (rec_freq == 0)
+    {
+        return OS_EINVAL;
+    }
+
+    off = 8;
+    if (!hsm_record_get_varint(buf, len, &off, &val) ||
+        (hsm_record_unzigzag(val) != hsm_get_current_state(hsm)))
+    {
+        return OS_EINVAL;
+    }
+
+    deadline = os_cputime_get32();
+
+    while (1)
+    {
+        if (!hsm_record_get_varint(buf, len, &off, &tag))
+        {
+            return OS_EINVAL;
+        }
+
+        if (flags & HSM_REPLAY_F_TIMED)
+        {
+            // Convert the recorded delay to local os_cputime ticks
+            deadline += (uint32_t)(((tag >> 2) * MYNEWT_VAL(OS_CPUTIME_FREQ)) /
+                rec_freq);
+            hsm_replay_wait_until(deadline);
+        }
+
+        if ((tag & 0x3) == HSM_RECORD_TAG_END)
+        {
+            break;
+        }
+
+        if (!hsm_record_get_varint(buf, len, &off, &val))
+        {
+            return OS_EINVAL;
+        }
+        event.he_signal = hsm_record_unzigzag(val);
+        event.he_count = 1;
+
+        if ((tag & 0x3) == HSM_RECORD_TAG_COUNTED)
+        {
+            if (!hsm_record_get_varint(buf, len, &off, &val))
+            {
+                return OS_EINVAL;
+            }
+            event.he_count = val;
+        }
+
+        start = os_cputime_get32();
+        if (hsm_dispatch(hsm, &event) == HSM_SIG_STATUS_HANDLED)
+        {
+            stats->hrp_handled++;
+        }
+        ticks = os_cputime_get32() - start;
+
+        stats->hrp_events++;
+        stats->hrp_dispatch_ticks += ticks;
+        if (ticks > stats->hrp_max_dispatch_ticks)
+        {
+            stats->hrp_max_dispatch_ticks = ticks;
+        }
+    }
+
+    if (!hsm_record_get_varint(buf, len, &off, &val))
+    {
+        return OS_EINVAL;
+    }
+
+    stats->hrp_expected_state = hsm_record_unzigzag(val);
+    stats->hrp_final_state = hsm_get_current_state(hsm);
+
+    return stats->hrp_expected_state == stats->hrp_final_state ? 0 : OS_ERROR;
+}
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
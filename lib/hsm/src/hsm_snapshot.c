@@ -0,0 +1,395 @@
+/**
+ *  @file   hsm_snapshot.c
+ *  @brief  Snapshot and restore of the state of a hierarchical state machine.
+ */
+
+#include <string.h>
+
+#include "os/os.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_snapshot.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+/* Record layout (little endian):
+ *  0   magic           u16
+ *  2   version         u8
+ *  3   record length   u8
+ *  4   state number    i32
+ *  8   sections        u8 (HSM_SNAPSHOT_S_* bits)
+ *  9   sections, in the order of their bits
+ *  n   checksum        u16 (Fletcher-16 of the preceding bytes)
+ *
+ * History section:
+ *      entries         u8
+ *      per entry       shallow state number i32, deep state number i32
+ *                      (HSM_SNAPSHOT_NO_STATE if never exited)
+ *
+ * Regions section:
+ *      regions         u8
+ *      per region      state number i32
+ */
+#define HSM_SNAPSHOT_MAGIC              0x4853
+#define HSM_SNAPSHOT_VERSION            4
+#define HSM_SNAPSHOT_HDR_LEN            4
+#define HSM_SNAPSHOT_BODY_LEN           5
+#define HSM_SNAPSHOT_CHECKSUM_LEN       2
+#define HSM_SNAPSHOT_MIN_LEN            (HSM_SNAPSHOT_HDR_LEN + \
+    HSM_SNAPSHOT_BODY_LEN + HSM_SNAPSHOT_CHECKSUM_LEN)
+
+/** The record holds the history table */
+#define HSM_SNAPSHOT_S_HISTORY          0x01
+/** The record holds the current state of each region */
+#define HSM_SNAPSHOT_S_REGIONS          0x02
+
+/** State number of an empty history entry */
+#define HSM_SNAPSHOT_NO_STATE           (-1)
+
+#if HSM_SNAPSHOT_MAX_LEN > 255
+#error "HSM_SNAPSHOT_MAX_HISTORY and HSM_SNAPSHOT_MAX_REGIONS are too large"
+#endif
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+static uint16_t hsm_snapshot_checksum(const uint8_t * buf, size_t len)
+{
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        sum1 = (sum1 + buf[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+static void hsm_snapshot_put_le16(uint8_t * buf, uint16_t val)
+{
+    buf[0] = val & 0xFF;
+    buf[1] = val >> 8;
+}
+
+static uint16_t hsm_snapshot_get_le16(const uint8_t * buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+static void hsm_snapshot_put_le32(uint8_t * buf, uint32_t val)
+{
+    hsm_snapshot_put_le16(buf, val & 0xFFFF);
+    hsm_snapshot_put_le16(buf + 2, val >> 16);
+}
+
+static uint32_t hsm_snapshot_get_le32(const uint8_t * buf)
+{
+    return hsm_snapshot_get_le16(buf) |
+        ((uint32_t)hsm_snapshot_get_le16(buf + 2) << 16);
+}
+
+static void hsm_snapshot_put_state(uint8_t * buf, const hsm_state_s * state)
+{
+    hsm_snapshot_put_le32(buf, (state != NULL) ?
+        (uint32_t)state->hst_state_num : (uint32_t)HSM_SNAPSHOT_NO_STATE);
+}
+
+/** Looks up a state number of the record in the state table. Returns 0, or
+ *  OS_EINVAL if the state is unknown or (unless allow_none) missing */
+static int hsm_snapshot_get_state(const hsm_state_s * const * states,
+        int num_states, int32_t state_num, bool allow_none,
+        const hsm_state_s ** state)
+{
+    if (allow_none && (state_num == HSM_SNAPSHOT_NO_STATE))
+    {
+        *state = NULL;
+        return 0;
+    }
+
+    if ((state_num < 0) || (state_num >= num_states) ||
+        (states[state_num] == NULL) ||
+        (states[state_num]->hst_state_num != state_num))
+    {
+        return OS_EINVAL;
+    }
+
+    *state = states[state_num];
+
+    return 0;
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+int hsm_snapshot(hsm_s * hsm, uint8_t * buf, size_t len, size_t * out_len,
+        uint8_t flags)
+{
+    hsm_history_s * history;
+    uint8_t sections = 0;
+    size_t off;
+    uint8_t i;
+    int rc = 0;
+
+    if (len < HSM_SNAPSHOT_MAX_LEN)
+    {
+        return OS_ENOMEM;
+    }
+
+    hsm_lock(hsm);
+
+    if ((flags & HSM_SNAPSHOT_F_HISTORY) && (hsm->h_history != NULL))
+    {
+        sections |= HSM_SNAPSHOT_S_HISTORY;
+    }
+
+    // The regions are part of the active configuration, so they are always
+    // recorded
+    if (hsm->h_num_regions != 0)
+    {
+        sections |= HSM_SNAPSHOT_S_REGIONS;
+    }
+
+    if (!hsm_is_active(hsm))
+    {
+        rc = OS_EINVAL;
+    }
+    else if ((sections & HSM_SNAPSHOT_S_HISTORY) &&
+        (hsm->h_num_history > MYNEWT_VAL(HSM_SNAPSHOT_MAX_HISTORY)))
+    {
+        rc = OS_ENOMEM;
+    }
+    else if (hsm->h_num_regions > MYNEWT_VAL(HSM_SNAPSHOT_MAX_REGIONS))
+    {
+        rc = OS_ENOMEM;
+    }
+    else
+    {
+        hsm_snapshot_put_le16(buf, HSM_SNAPSHOT_MAGIC);
+        buf[2] = HSM_SNAPSHOT_VERSION;
+        off = HSM_SNAPSHOT_HDR_LEN;
+
+        hsm_snapshot_put_le32(buf + off, hsm->h_cur_state->hst_state_num);
+        off += 4;
+        buf[off++] = sections;
+
+        if (sections & HSM_SNAPSHOT_S_HISTORY)
+        {
+            buf[off++] = hsm->h_num_history;
+
+            for (i = 0; i < hsm->h_num_history; i++)
+            {
+                history = &hsm->h_history[i];
+                hsm_snapshot_put_state(buf + off, history->hh_shallow);
+                hsm_snapshot_put_state(buf + off + 4, history->hh_deep);
+                off += 8;
+            }
+        }
+
+        if (sections & HSM_SNAPSHOT_S_REGIONS)
+        {
+            buf[off++] = hsm->h_num_regions;
+
+            for (i = 0; i < hsm->h_num_regions; i++)
+            {
+                hsm_snapshot_put_state(buf + off,
+                    hsm->h_regions[i].hr_cur_state);
+                off += 4;
+            }
+        }
+
+        buf[3] = off + HSM_SNAPSHOT_CHECKSUM_LEN;
+        hsm_snapshot_put_le16(buf + off, hsm_snapshot_checksum(buf, off));
+        off += HSM_SNAPSHOT_CHECKSUM_LEN;
+
+        *out_len = off;
+    }
+
+    hsm_unlock(hsm);
+
+    return rc;
+}
+
+int hsm_restore(hsm_s * hsm, const hsm_state_s * const * states,
+        int num_states, const uint8_t * buf, size_t len, uint8_t flags)
+{
+    const hsm_state_s * state;
+    const hsm_state_s * shallow;
+    const hsm_state_s * deep;
+    const hsm_state_s * region_state;
+    hsm_region_s * region;
+    const uint8_t * history = NULL;
+    const uint8_t * regions = NULL;
+    uint8_t num_history = 0;
+    uint8_t num_regions = 0;
+    uint8_t sections;
+    size_t rec_len;
+    size_t off;
+    uint8_t i;
+    int rc = 0;
+
+    // Validate the record before touching the state machine; retained RAM
+    // holds garbage after a cold boot
+    if ((len < HSM_SNAPSHOT_HDR_LEN) ||
+        (hsm_snapshot_get_le16(buf) != HSM_SNAPSHOT_MAGIC) ||
+        (buf[2] != HSM_SNAPSHOT_VERSION))
+    {
+        return OS_EINVAL;
+    }
+
+    rec_len = buf[3];
+    if ((rec_len < HSM_SNAPSHOT_MIN_LEN) || (rec_len > len) ||
+        (hsm_snapshot_checksum(buf, rec_len - HSM_SNAPSHOT_CHECKSUM_LEN) !=
+            hsm_snapshot_get_le16(buf + rec_len - HSM_SNAPSHOT_CHECKSUM_LEN)))
+    {
+        return OS_EINVAL;
+    }
+
+    rc = hsm_snapshot_get_state(states, num_states,
+        (int32_t)hsm_snapshot_get_le32(buf + HSM_SNAPSHOT_HDR_LEN), false,
+        &state);
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    off = HSM_SNAPSHOT_HDR_LEN + 4;
+    sections = buf[off++];
+
+    if (sections & ~(HSM_SNAPSHOT_S_HISTORY | HSM_SNAPSHOT_S_REGIONS))
+    {
+        return OS_EINVAL;
+    }
+
+    if (sections & HSM_SNAPSHOT_S_HISTORY)
+    {
+        num_history = buf[off++];
+        history = buf + off;
+        off += (size_t)num_history * 8;
+
+        if (off > rec_len - HSM_SNAPSHOT_CHECKSUM_LEN)
+        {
+            return OS_EINVAL;
+        }
+
+        for (i = 0; i < num_history; i++)
+        {
+            if ((hsm_snapshot_get_state(states, num_states,
+                    (int32_t)hsm_snapshot_get_le32(history + i * 8), true,
+                    &shallow) != 0) ||
+                (hsm_snapshot_get_state(states, num_states,
+                    (int32_t)hsm_snapshot_get_le32(history + i * 8 + 4), true,
+                    &deep) != 0))
+            {
+                return OS_EINVAL;
+            }
+        }
+    }
+
+    if (sections & HSM_SNAPSHOT_S_REGIONS)
+    {
+        if (off >= rec_len - HSM_SNAPSHOT_CHECKSUM_LEN)
+        {
+            return OS_EINVAL;
+        }
+
+        num_regions = buf[off++];
+        regions = buf + off;
+        off += (size_t)num_regions * 4;
+
+        if (off > rec_len - HSM_SNAPSHOT_CHECKSUM_LEN)
+        {
+            return OS_EINVAL;
+        }
+
+        for (i = 0; i < num_regions; i++)
+        {
+            if (hsm_snapshot_get_state(states, num_states,
+                    (int32_t)hsm_snapshot_get_le32(regions + i * 4), false,
+                    &region_state) != 0)
+            {
+                return OS_EINVAL;
+            }
+        }
+    }
+
+    if (off != rec_len - HSM_SNAPSHOT_CHECKSUM_LEN)
+    {
+        return OS_EINVAL;
+    }
+
+    hsm_lock(hsm);
+
+    // The history table and the regions must have the layout they were
+    // recorded with
+    if (hsm_is_active(hsm) ||
+        ((history != NULL) && (num_history != hsm->h_num_history)) ||
+        ((regions != NULL) && (num_regions != hsm->h_num_regions)))
+    {
+        rc = OS_EINVAL;
+    }
+    else
+    {
+        // Entries were validated above
+        for (i = 0; i < num_history; i++)
+        {
+            hsm_snapshot_get_state(states, num_states,
+                (int32_t)hsm_snapshot_get_le32(history + i * 8), true,
+                &hsm->h_history[i].hh_shallow);
+            hsm_snapshot_get_state(states, num_states,
+                (int32_t)hsm_snapshot_get_le32(history + i * 8 + 4), true,
+                &hsm->h_history[i].hh_deep);
+        }
+
+        if (flags & HSM_RESTORE_F_ENTRY)
+        {
+            if (hsm->h_on_entry != NULL)
+            {
+                hsm->h_on_entry(hsm);
+            }
+
+            hsm_transition_locked(hsm, NULL, state);
+        }
+        else
+        {
+            hsm->h_cur_state = (hsm_state_s *)state;
+        }
+
+        // Regions are entered after the main state, as by hsm_enter
+        for (i = 0; i < hsm->h_num_regions; i++)
+        {
+            region = &hsm->h_regions[i];
+            region_state = region->hr_top;
+
+            if (regions != NULL)
+            {
+                hsm_snapshot_get_state(states, num_states,
+                    (int32_t)hsm_snapshot_get_le32(regions + i * 4), false,
+                    &region_state);
+            }
+
+            if (flags & HSM_RESTORE_F_ENTRY)
+            {
+                hsm_transition_locked(hsm, region, region_state);
+            }
+            else
+            {
+                region->hr_cur_state = (hsm_state_s *)region_state;
+            }
+        }
+    }
+
+    hsm_unlock(hsm);
+
+    return rc;
+}
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
@@ -0,0 +1,224 @@
+/**
+ *  @file   hsm_trace.c
+ *  @brief  Binary trace of the state machines, for the native (simulator) BSP.
+ */
+
+#include "os/os.h"
+
+#if MYNEWT_VAL(HSM_TRACE)
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "os/os_cputime.h"
+#include "hsm/hsm.h"
+#include "hsm/hsm_trace.h"
+#include "hsm_priv.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+#define HSM_TRACE_NUM_SEGMENTS          MYNEWT_VAL(HSM_TRACE_MAX_SEGMENTS)
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+/** Mapped trace file; NULL while no trace is open */
+static hsm_trace_file_hdr_s * volatile g_hsm_trace_hdr;
+static size_t g_hsm_trace_len;
+static int g_hsm_trace_fd = -1;
+/** Task writing each segment, in the order they were assigned */
+static struct os_task * g_hsm_trace_tasks[HSM_TRACE_NUM_SEGMENTS];
+
+static hsm_trace_seg_hdr_s * hsm_trace_seg_hdr(hsm_trace_file_hdr_s * hdr,
+        uint16_t idx)
+{
+    size_t seg_len = sizeof(hsm_trace_seg_hdr_s) +
+        (size_t)hdr->htf_seg_records * sizeof(hsm_trace_rec_s);
+
+    return (hsm_trace_seg_hdr_s *)((uint8_t *)(hdr + 1) + idx * seg_len);
+}
+
+/** Returns the segment of a task, assigning one on its first record. Returns
+ *  NULL once every segment has been assigned to another task */
+static hsm_trace_seg_hdr_s * hsm_trace_segment(hsm_trace_file_hdr_s * hdr,
+        struct os_task * task)
+{
+    hsm_trace_seg_hdr_s * seg = NULL;
+    uint16_t idx;
+    os_sr_t sr;
+
+    // Segments are never released while the trace is open, so the tasks
+    // already assigned can be looked up without entering a critical section
+    for (idx = 0; idx < hdr->htf_used_segments; idx++)
+    {
+        if (g_hsm_trace_tasks[idx] == task)
+        {
+            return hsm_trace_seg_hdr(hdr, idx);
+        }
+    }
+
+    OS_ENTER_CRITICAL(sr);
+
+    for (idx = 0; idx < hdr->htf_used_segments; idx++)
+    {
+        if (g_hsm_trace_tasks[idx] == task)
+        {
+            break;
+        }
+    }
+
+    if (idx < hdr->htf_used_segments)
+    {
+        seg = hsm_trace_seg_hdr(hdr, idx);
+    }
+    else if (idx < hdr->htf_num_segments)
+    {
+        seg = hsm_trace_seg_hdr(hdr, idx);
+        if ((task != NULL) && (task->t_name != NULL))
+        {
+            strncpy(seg->hts_task, task->t_name, sizeof(seg->hts_task) - 1);
+        }
+        g_hsm_trace_tasks[idx] = task;
+        hdr->htf_used_segments++;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return seg;
+}
+
+void hsm_trace_record(hsm_s * hsm, const hsm_region_s * region, uint8_t type,
+        const hsm_state_s * state, int arg)
+{
+    hsm_trace_file_hdr_s * hdr = g_hsm_trace_hdr;
+    hsm_trace_seg_hdr_s * seg;
+    hsm_trace_rec_s * rec;
+
+    if (hdr == NULL)
+    {
+        return;
+    }
+
+    seg = hsm_trace_segment(hdr, os_sched_get_current_task());
+    if (seg == NULL)
+    {
+        __atomic_fetch_add(&hdr->htf_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Only the task owning the segment writes to it
+    rec = (hsm_trace_rec_s *)(seg + 1) + (seg->hts_written %
+        hdr->htf_seg_records);
+
+    rec->htr_ticks = os_cputime_get32();
+    rec->htr_hsm = (uint32_t)(uintptr_t)hsm;
+    rec->htr_state = (state != NULL) ? state->hst_state_num : -1;
+    rec->htr_arg = arg;
+    rec->htr_type = type;
+    rec->htr_region = (region != NULL) ? (region - hsm->h_regions) + 1 : 0;
+    rec->htr_reserved = 0;
+
+    seg->hts_written++;
+}
+
+// =================================================================
+// ====================== API ======================================
+// =================================================================
+
+int hsm_trace_open(const char * path, uint32_t seg_records)
+{
+    hsm_trace_file_hdr_s * hdr;
+    uint64_t len;
+    void * base;
+    int fd;
+
+    if ((g_hsm_trace_hdr != NULL) || (seg_records == 0))
+    {
+        return OS_EINVAL;
+    }
+
+    len = sizeof(hsm_trace_file_hdr_s) + (uint64_t)HSM_TRACE_NUM_SEGMENTS *
+        (sizeof(hsm_trace_seg_hdr_s) +
+         (uint64_t)seg_records * sizeof(hsm_trace_rec_s));
+    if (len > SIZE_MAX)
+    {
+        return OS_EINVAL;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return OS_ERROR;
+    }
+
+    // The whole file is allocated up front so that recording never has to
+    // wait for the file system to extend it
+    if (posix_fallocate(fd, 0, len) != 0)
+    {
+        close(fd);
+        return OS_ERROR;
+    }
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return OS_ERROR;
+    }
+
+    hdr = (hsm_trace_file_hdr_s *)base;
+    hdr->htf_magic = HSM_TRACE_MAGIC;
+    hdr->htf_version = HSM_TRACE_VERSION;
+    hdr->htf_rec_size = sizeof(hsm_trace_rec_s);
+    hdr->htf_cputime_freq = MYNEWT_VAL(OS_CPUTIME_FREQ);
+    hdr->htf_num_segments = HSM_TRACE_NUM_SEGMENTS;
+    hdr->htf_used_segments = 0;
+    hdr->htf_seg_records = seg_records;
+    hdr->htf_dropped = 0;
+
+    memset(g_hsm_trace_tasks, 0, sizeof(g_hsm_trace_tasks));
+    g_hsm_trace_len = len;
+    g_hsm_trace_fd = fd;
+    g_hsm_trace_hdr = hdr;
+
+    return 0;
+}
+
+int hsm_trace_close(void)
+{
+    hsm_trace_file_hdr_s * hdr = g_hsm_trace_hdr;
+    int rc = 0;
+
+    if (hdr == NULL)
+    {
+        return OS_EINVAL;
+    }
+
+    g_hsm_trace_hdr = NULL;
+
+    if (msync(hdr, g_hsm_trace_len, MS_SYNC) != 0)
+    {
+        rc = OS_ERROR;
+    }
+
+    munmap(hdr, g_hsm_trace_len);
+
+    if (close(g_hsm_trace_fd) != 0)
+    {
+        rc = OS_ERROR;
+    }
+    g_hsm_trace_fd = -1;
+
+    return rc;
+}
+
+#endif // MYNEWT_VAL(HSM_TRACE)
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================
@@ -0,0 +1,437 @@
+/**
+ *  @file   hsm_trace_decode.c
+ *  @brief  Offline decoder of the trace files written by hsm_trace.
+ *
+ *  Host tool; not part of the sys/hsm package. Build with:
+ *
+ *      cc -O2 -I../include -o hsm_trace_decode hsm_trace_decode.c
+ *
+ *  Usage:
+ *
+ *      hsm_trace_decode timeline <file>
+ *          One line per record of every task, in time order:
+ *          <usecs> <task> <hsm> <region> <type> <state> [<signal>|-> <state>]
+ *
+ *      hsm_trace_decode stats <file>
+ *          Time spent in each state of each state machine and region, as CSV:
+ *          hsm,region,state,visits,total_usecs,max_usecs
+ *          States still active at the end of the trace are counted up to the
+ *          last record.
+ *
+ *  Timestamps are unwrapped per segment, assuming that no two consecutive
+ *  records of a task are more than one os_cputime period apart, and that
+ *  every task wrote its first record within the same period.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hsm/hsm_trace_format.h"
+
+// =================================================================
+// ====================== TYPEDEFS AND MACROS ======================
+// =================================================================
+
+/** Read position in a segment */
+typedef struct
+{
+    const hsm_trace_seg_hdr_s * seg;
+    const hsm_trace_rec_s *     recs;
+    /** Number of records present in the segment */
+    uint32_t                    count;
+    /** Index of the next record, from the oldest one present */
+    uint32_t                    next;
+    /** Unwrapped timestamp of the next record */
+    uint64_t                    ticks;
+    /** Raw timestamp of the last record read */
+    uint32_t                    last_raw;
+} cursor_s;
+
+/** Time spent in one state of one region of a state machine */
+typedef struct
+{
+    uint32_t                    hsm;
+    uint8_t                     region;
+    int32_t                     state;
+    uint32_t                    visits;
+    uint64_t                    total;
+    uint64_t                    max;
+} state_stats_s;
+
+/** Current state of one region of a state machine */
+typedef struct
+{
+    uint32_t                    hsm;
+    uint8_t                     region;
+    int32_t                     state;
+    uint64_t                    since;
+} region_ctx_s;
+
+static const char * const g_type_names[] = {
+    [HSM_TRACE_DISPATCH] =      "DISPATCH",
+    [HSM_TRACE_TRANSITION] =    "TRANSITION",
+    [HSM_TRACE_EXIT] =          "EXIT",
+    [HSM_TRACE_ENTRY] =         "ENTRY",
+};
+
+static const hsm_trace_file_hdr_s * g_hdr;
+static cursor_s * g_cursors;
+
+static state_stats_s * g_stats;
+static size_t g_num_stats;
+static region_ctx_s * g_ctxs;
+static size_t g_num_ctxs;
+
+// =================================================================
+// ====================== PRIVATE ==================================
+// =================================================================
+
+static void * grow(void * array, size_t num, size_t size)
+{
+    // Arrays grow by doubling; num is the number of entries already used
+    if ((num & (num - 1)) == 0)
+    {
+        array = realloc(array, (num == 0 ? 1 : num * 2) * size);
+        if (array == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    return array;
+}
+
+static const hsm_trace_rec_s * cursor_peek(const cursor_s * cur)
+{
+    uint32_t start;
+
+    if (cur->next >= cur->count)
+    {
+        return NULL;
+    }
+
+    start = (cur->seg->hts_written > g_hdr->htf_seg_records) ?
+        cur->seg->hts_written % g_hdr->htf_seg_records : 0;
+
+    return &cur->recs[(start + cur->next) % g_hdr->htf_seg_records];
+}
+
+static void cursor_init(cursor_s * cur, const hsm_trace_seg_hdr_s * seg)
+{
+    const hsm_trace_rec_s * rec;
+
+    cur->seg = seg;
+    cur->recs = (const hsm_trace_rec_s *)(seg + 1);
+    cur->count = (seg->hts_written > g_hdr->htf_seg_records) ?
+        g_hdr->htf_seg_records : seg->hts_written;
+    cur->next = 0;
+
+    rec = cursor_peek(cur);
+    if (rec != NULL)
+    {
+        cur->ticks = rec->htr_ticks;
+        cur->last_raw = rec->htr_ticks;
+    }
+}
+
+static void cursor_advance(cursor_s * cur)
+{
+    const hsm_trace_rec_s * rec;
+
+    cur->next++;
+
+    rec = cursor_peek(cur);
+    if (rec != NULL)
+    {
+        cur->ticks += (uint32_t)(rec->htr_ticks - cur->last_raw);
+        cur->last_raw = rec->htr_ticks;
+    }
+}
+
+/** Returns the cursor holding the oldest unread record, or NULL at the end */
+static cursor_s * next_cursor(void)
+{
+    cursor_s * best = NULL;
+    uint16_t i;
+
+    for (i = 0; i < g_hdr->htf_used_segments; i++)
+    {
+        if ((cursor_peek(&g_cursors[i]) != NULL) &&
+            ((best == NULL) || (g_cursors[i].ticks < best->ticks)))
+        {
+            best = &g_cursors[i];
+        }
+    }
+
+    return best;
+}
+
+static double ticks_to_usecs(uint64_t ticks)
+{
+    return (double)ticks * 1000000.0 / g_hdr->htf_cputime_freq;
+}
+
+static state_stats_s * find_stats(uint32_t hsm, uint8_t region, int32_t state)
+{
+    size_t i;
+
+    for (i = 0; i < g_num_stats; i++)
+    {
+        if ((g_stats[i].hsm == hsm) && (g_stats[i].region == region) &&
+            (g_stats[i].state == state))
+        {
+            return &g_stats[i];
+        }
+    }
+
+    g_stats = grow(g_stats, g_num_stats, sizeof(g_stats[0]));
+    memset(&g_stats[g_num_stats], 0, sizeof(g_stats[0]));
+    g_stats[g_num_stats].hsm = hsm;
+    g_stats[g_num_stats].region = region;
+    g_stats[g_num_stats].state = state;
+
+    return &g_stats[g_num_stats++];
+}
+
+static region_ctx_s * find_ctx(uint32_t hsm, uint8_t region)
+{
+    size_t i;
+
+    for (i = 0; i < g_num_ctxs; i++)
+    {
+        if ((g_ctxs[i].hsm == hsm) && (g_ctxs[i].region == region))
+        {
+            return &g_ctxs[i];
+        }
+    }
+
+    g_ctxs = grow(g_ctxs, g_num_ctxs, sizeof(g_ctxs[0]));
+    g_ctxs[g_num_ctxs].hsm = hsm;
+    g_ctxs[g_num_ctxs].region = region;
+    g_ctxs[g_num_ctxs].state = -1;
+    g_ctxs[g_num_ctxs].since = 0;
+
+    return &g_ctxs[g_num_ctxs++];
+}
+
+static void account(region_ctx_s * ctx, uint64_t now)
+{
+    state_stats_s * stats;
+    uint64_t elapsed;
+
+    if (ctx->state < 0)
+    {
+        return;
+    }
+
+    stats = find_stats(ctx->hsm, ctx->region, ctx->state);
+    elapsed = now - ctx->since;
+
+    stats->visits++;
+    stats->total += elapsed;
+    if (elapsed > stats->max)
+    {
+        stats->max = elapsed;
+    }
+
+    ctx->state = -1;
+}
+
+static void print_record(const cursor_s * cur, const hsm_trace_rec_s * rec,
+        uint64_t origin)
+{
+    const char * type = (rec->htr_type < sizeof(g_type_names) /
+        sizeof(g_type_names[0])) ? g_type_names[rec->htr_type] : "?";
+
+    printf("%.3f %s 0x%08x %u %s %d", ticks_to_usecs(cur->ticks - origin),
+        cur->seg->hts_task[0] != '\0' ? cur->seg->hts_task : "-",
+        rec->htr_hsm, rec->htr_region, type, rec->htr_state);
+
+    if (rec->htr_type == HSM_TRACE_DISPATCH)
+    {
+        printf(" %d", rec->htr_arg);
+    }
+    else if (rec->htr_type == HSM_TRACE_TRANSITION)
+    {
+        printf(" -> %d", rec->htr_arg);
+    }
+
+    printf("\n");
+}
+
+static void decode(bool timeline)
+{
+    const hsm_trace_rec_s * rec;
+    region_ctx_s * ctx;
+    cursor_s * cur;
+    uint64_t origin = UINT64_MAX;
+    uint64_t now = 0;
+    uint16_t i;
+    size_t s;
+
+    for (i = 0; i < g_hdr->htf_used_segments; i++)
+    {
+        if ((cursor_peek(&g_cursors[i]) != NULL) &&
+            (g_cursors[i].ticks < origin))
+        {
+            origin = g_cursors[i].ticks;
+        }
+    }
+
+    while ((cur = next_cursor()) != NULL)
+    {
+        rec = cursor_peek(cur);
+        now = cur->ticks;
+
+        if (timeline)
+        {
+            print_record(cur, rec, origin);
+        }
+        else if (rec->htr_type == HSM_TRACE_ENTRY)
+        {
+            ctx = find_ctx(rec->htr_hsm, rec->htr_region);
+            account(ctx, now);
+            ctx->state = rec->htr_state;
+            ctx->since = now;
+        }
+        else if (rec->htr_type == HSM_TRACE_EXIT)
+        {
+            ctx = find_ctx(rec->htr_hsm, rec->htr_region);
+            if (ctx->state == rec->htr_state)
+            {
+                account(ctx, now);
+            }
+        }
+
+        cursor_advance(cur);
+    }
+
+    if (timeline)
+    {
+        return;
+    }
+
+    for (s = 0; s < g_num_ctxs; s++)
+    {
+        account(&g_ctxs[s], now);
+    }
+
+    printf("hsm,region,state,visits,total_usecs,max_usecs\n");
+    for (s = 0; s < g_num_stats; s++)
+    {
+        printf("0x%08x,%u,%d,%u,%.3f,%.3f\n", g_stats[s].hsm,
+            g_stats[s].region, g_stats[s].state, g_stats[s].visits,
+            ticks_to_usecs(g_stats[s].total), ticks_to_usecs(g_stats[s].max));
+    }
+}
+
+static int usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s <timeline|stats> <file>\n", prog);
+    return 1;
+}
+
+// =================================================================
+// ====================== MAIN =====================================
+// =================================================================
+
+int main(int argc, char ** argv)
+{
+    const hsm_trace_seg_hdr_s * seg;
+    struct stat st;
+    size_t seg_len;
+    void * base;
+    bool timeline;
+    uint16_t i;
+    int fd;
+
+    if (argc != 3)
+    {
+        return usage(argv[0]);
+    }
+
+    if (strcmp(argv[1], "timeline") == 0)
+    {
+        timeline = true;
+    }
+    else if (strcmp(argv[1], "stats") == 0)
+    {
+        timeline = false;
+    }
+    else
+    {
+        return usage(argv[0]);
+    }
+
+    fd = open(argv[2], O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &st) != 0))
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    if ((size_t)st.st_size < sizeof(hsm_trace_file_hdr_s))
+    {
+        fprintf(stderr, "%s: not a trace file\n", argv[2]);
+        return 1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    g_hdr = (const hsm_trace_file_hdr_s *)base;
+    seg_len = sizeof(hsm_trace_seg_hdr_s) +
+        (size_t)g_hdr->htf_seg_records * sizeof(hsm_trace_rec_s);
+
+    if ((g_hdr->htf_magic != HSM_TRACE_MAGIC) ||
+        (g_hdr->htf_version != HSM_TRACE_VERSION) ||
+        (g_hdr->htf_rec_size != sizeof(hsm_trace_rec_s)) ||
+        (g_hdr->htf_seg_records == 0) || (g_hdr->htf_cputime_freq == 0) ||
+        (g_hdr->htf_used_segments > g_hdr->htf_num_segments) ||
+        ((size_t)st.st_size < sizeof(hsm_trace_file_hdr_s) +
+            g_hdr->htf_num_segments * seg_len))
+    {
+        fprintf(stderr, "%s: not a trace file\n", argv[2]);
+        return 1;
+    }
+
+    if (g_hdr->htf_dropped != 0)
+    {
+        fprintf(stderr, "%s: %u records dropped (no segment left)\n", argv[2],
+            g_hdr->htf_dropped);
+    }
+
+    g_cursors = calloc(g_hdr->htf_used_segments + 1, sizeof(g_cursors[0]));
+    if (g_cursors == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+
+    for (i = 0; i < g_hdr->htf_used_segments; i++)
+    {
+        seg = (const hsm_trace_seg_hdr_s *)((const uint8_t *)(g_hdr + 1) +
+            i * seg_len);
+        cursor_init(&g_cursors[i], seg);
+    }
+
+    decode(timeline);
+
+    return 0;
+}
+
+// =================================================================
+// ====================== EOF ======================================
+// =================================================================